@@ -0,0 +1,244 @@
+/* batch.c -- runs one program on many inputs */
+/* ver. 1.02 */
+
+/* The runs are cut in chunks which the threads claim in order from a
+ * shared counter. A finished chunk goes in a ring of slots, where the calling
+ * thread picks it up and passes it on in order. A chunk is claimed only if
+ * its slot is free, so a slow run holds back at most a ring of chunks. While
+ * the calling thread waits for the next chunk, it runs chunks itself. */
+
+/* Author: Vladimir Dinev */
+#include "os_def.h"
+#include <stdlib.h>
+#include <string.h>
+#ifdef WINDOWS
+#define yield()		SwitchToThread()
+#else
+#include <pthread.h>
+#include <sched.h>
+#define yield()		sched_yield()
+#endif
+#include "batch.h"
+#include "cache.h"
+
+#define RING_PER_THRD	4		// slots in the ring for every thread
+#define ld_acq(p)	__atomic_load_n((p), __ATOMIC_ACQUIRE)
+#define st_rel(p,v)	__atomic_store_n((p), (v), __ATOMIC_RELEASE)
+
+typedef struct slot_ {
+	long done;						// the number of the chunk in it + 1
+	batch_res res[BATCH_CHUNK];		// its results
+} slot;
+
+typedef struct batch_ {
+	const byte * code;				// the program
+	int csize;						// its size
+	const batch_poke * pokes;		// the inputs of all runs
+	const long * first;				// where the inputs of every run begin
+	long nruns;						// how many runs
+	long nchunks;					// how many chunks
+	unsigned long steps;			// instructions a run gets
+	cache * rc;						// the results of earlier runs, or NULL
+	slot * ring;					// the finished chunks
+	long nslots;					// how many fit
+	long next;						// the next chunk to claim
+	long passed;					// chunks given to out() so far
+} batch;
+
+typedef struct worker_ {
+	batch * bt;						// the work
+	jcpu cpu;						// a machine of its own
+	byte ram[RAM_S];				// and its ram
+} worker;
+
+static long claim(batch * bt);
+static void run_chunk(worker * wk, long chunk);
+
+/* -------------------- PUBLIC INTERFACE START -------------------- */
+#ifdef WINDOWS
+static DWORD WINAPI work(LPVOID arg)
+#else
+static void * work(void * arg)
+#endif
+{
+	/* run chunks until none is left */
+	worker * wk = arg;
+	long chunk;
+	
+	while ((chunk = claim(wk->bt)) != -1)
+	{
+		if (chunk >= 0)
+			run_chunk(wk, chunk);
+		else
+			yield();
+	}
+	
+	return 0;
+}
+
+int batch_run(const byte * code, int csize, const batch_poke * pokes, const long * first,
+		long nruns, int nthreads, unsigned long steps, struct cache_ * rc,
+		batch_out out, void * ctx)
+{
+	/* start the threads
+	 * pass the chunks on in order, running chunks while waiting
+	 * wait for the threads */
+	batch bt;
+	worker * wks;
+	slot * sl;
+	long ch, i, run;
+	int n, started, res = 0;
+#ifdef WINDOWS
+	HANDLE thrd[BATCH_MAX_THRDS];
+#else
+	pthread_t thrd[BATCH_MAX_THRDS];
+#endif
+
+	if (nthreads < 1)
+		nthreads = 1;
+	if (nthreads > BATCH_MAX_THRDS)
+		nthreads = BATCH_MAX_THRDS;
+	
+	bt.code = code;
+	bt.csize = csize;
+	bt.pokes = pokes;
+	bt.first = first;
+	bt.nruns = nruns;
+	bt.nchunks = (nruns + BATCH_CHUNK - 1) / BATCH_CHUNK;
+	bt.steps = steps;
+	bt.rc = rc;
+	bt.nslots = nthreads * RING_PER_THRD;
+	bt.next = bt.passed = 0;
+	
+	wks = calloc(nthreads, sizeof(*wks));
+	bt.ring = calloc(bt.nslots, sizeof(*bt.ring));
+	if (NULL == wks || NULL == bt.ring)
+	{
+		res = -1;
+		goto cleanup;
+	}
+	
+	for (n = 0; n < nthreads; ++n)
+	{
+		wks[n].bt = &bt;
+		jcpu_init(&wks[n].cpu, wks[n].ram, 0);
+		jcpu_load(&wks[n].cpu, code, csize);
+	}
+	
+	// worker 0 is the calling thread
+	for (started = 0; started < nthreads - 1; ++started)
+	{
+#ifdef WINDOWS
+		if ((thrd[started] = CreateThread(NULL, 0, work, &wks[started + 1], 0, NULL)) == NULL)
+			break;
+#else
+		if (pthread_create(&thrd[started], NULL, work, &wks[started + 1]) != 0)
+			break;
+#endif
+	}
+	
+	for (ch = 0; ch < bt.nchunks; ++ch)
+	{
+		sl = &bt.ring[ch % bt.nslots];
+		while (ld_acq(&sl->done) != ch + 1)
+		{
+			if ((i = claim(&bt)) >= 0)
+				run_chunk(&wks[0], i);
+			else
+				yield();
+		}
+		
+		for (run = ch * BATCH_CHUNK, i = 0; i < BATCH_CHUNK && run < nruns; ++i, ++run)
+			out(ctx, run, &sl->res[i]);
+		
+		st_rel(&bt.passed, ch + 1);
+	}
+	
+	for (n = 0; n < started; ++n)
+	{
+#ifdef WINDOWS
+		WaitForSingleObject(thrd[n], INFINITE);
+		CloseHandle(thrd[n]);
+#else
+		pthread_join(thrd[n], NULL);
+#endif
+	}
+
+cleanup:
+	free(bt.ring);
+	free(wks);
+	return res;
+}
+/* -------------------- PUBLIC INTERFACE END -------------------- */
+
+static long claim(batch * bt)
+{
+	/* take the next chunk
+	 * return its number, -2 if its slot is still full, or -1 if none is left */
+	long ch = ld_acq(&bt->next);
+	
+	while (true)
+	{
+		if (ch >= bt->nchunks)
+			return -1;
+		
+		if (ch >= ld_acq(&bt->passed) + bt->nslots)
+			return -2;
+		
+		if (__atomic_compare_exchange_n(&bt->next, &ch, ch + 1, false,
+				__ATOMIC_ACQ_REL, __ATOMIC_ACQUIRE))
+			return ch;
+	}
+}
+
+static void run_chunk(worker * wk, long chunk)
+{
+	/* look every run up in the cache
+	 * if it isn't there, poke its inputs, run it, and keep the result
+	 * jcpu_reset() takes the pokes back too */
+	batch * bt = wk->bt;
+	jcpu * cpu = &wk->cpu;
+	slot * sl = &bt->ring[chunk % bt->nslots];
+	batch_res * res;
+	const batch_poke * pk, * start, * end;
+	unsigned long n;
+	long run = chunk * BATCH_CHUNK;
+	int i;
+	
+	for (i = 0; i < BATCH_CHUNK && run < bt->nruns; ++i, ++run)
+	{
+		res = &sl->res[i];
+		start = bt->pokes + bt->first[run];
+		end = bt->pokes + bt->first[run + 1];
+		if (bt->rc != NULL && cache_get(bt->rc, start, end - start, res))
+		{
+			res->cached = 1;
+			continue;
+		}
+		
+		for (pk = start; pk < end; ++pk)
+		{
+			if (pk->where < RAM_S)
+				jcpu_poke(cpu, pk->where, pk->val);
+			else
+				cpu->regs[pk->where - RAM_S] = pk->val;
+		}
+		
+		for (n = bt->steps; n > 0 && !jcpu_halted(cpu); --n)
+			jcpu_step(cpu);
+		
+		memcpy(res->regs, cpu->regs, NUM_REGS);
+		memcpy(res->ram, cpu->ram, RAM_S);
+		res->icount = cpu->icount;
+		res->digest = cpu->digest;
+		res->state = jcpu_halted(cpu) ? BATCH_HALTED : BATCH_STOPPED;
+		res->cached = 0;
+		jcpu_reset(cpu);
+		
+		if (bt->rc != NULL)
+			cache_put(bt->rc, start, end - start, res);
+	}
+	
+	st_rel(&sl->done, chunk + 1);
+	return;
+}
@@ -0,0 +1,51 @@
+/* batch.h -- runs one program on many inputs public interface */
+/* ver. 1.02 */
+#ifndef BATCH_H
+#define BATCH_H
+
+#include "jcpu.h"
+
+#define BATCH_MAX_THRDS	64		// the most threads batch_run() uses
+#define BATCH_CHUNK		64		// runs a thread takes at once
+#define BATCH_REG(r)	(RAM_S + (r))	// poke.where of register r
+
+enum {BATCH_HALTED, BATCH_STOPPED};
+/* how a run ended up; halted or out of steps */
+
+// a byte put in the machine before a run
+typedef struct batch_poke_ {
+	unsigned short where;	// a ram address, or BATCH_REG() of a register
+	byte val;				// what goes there
+} batch_poke;
+
+// the final state of a run
+typedef struct batch_res_ {
+	byte regs[NUM_REGS];	// the registers
+	byte state;				// BATCH_HALTED or BATCH_STOPPED
+	byte cached;			// taken from the cache instead of run
+	unsigned long icount;	// instructions executed
+	uint64_t digest;		// jcpu_digest() of the ram
+	byte ram[RAM_S];		// the ram
+} batch_res;
+
+typedef void (*batch_out)(void * ctx, long run, const batch_res * res);
+/* gets the result of every run, in the order of the runs */
+
+struct cache_;
+/* cache.h */
+
+int batch_run(const byte * code, int csize, const batch_poke * pokes, const long * first,
+		long nruns, int nthreads, unsigned long steps, struct cache_ * rc,
+		batch_out out, void * ctx);
+/* returns: 0 on success, -1 if there is no memory.
+ *
+ * description: Loads code and runs it nruns times, until it halts or executes
+ * steps instructions. Run n starts with pokes[first[n]] to pokes[first[n+1]-1]
+ * applied; first is nruns+1 long. The runs are dealt in chunks of BATCH_CHUNK
+ * to nthreads threads, the caller included. Every thread has a machine of its
+ * own which it puts back with jcpu_reset() between runs. out() is called on the
+ * calling thread as soon as a run and all before it are done. Only a few
+ * chunks are kept ahead of out(), so memory doesn't grow with nruns. If rc
+ * isn't NULL, a run found in it isn't run again, and one which isn't is put
+ * there; rc must be open for the same code and steps. */
+#endif
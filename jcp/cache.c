@@ -0,0 +1,394 @@
+/* cache.c -- the on-disk cache of batch results */
+/* ver. 1.0 */
+
+/* The file is a head and a table of sets of CACHE_WAYS entries, like a
+ * hardware cache. A run goes in the set its key picks, in place of the one
+ * used the longest time ago. Every set has a byte range lock in the file for
+ * other processes, and a spin lock in the cache for the threads of this one,
+ * since a file lock doesn't keep out the threads of the process that holds
+ * it. A new file is made under another name and moved in place only if the
+ * name is still free, so the processes which race to make it all end up with
+ * the same one. */
+
+/* Author: Vladimir Dinev */
+#include "os_def.h"
+#include <stdio.h>
+#include <stdlib.h>
+#include <string.h>
+#include <stddef.h>
+#ifdef WINDOWS
+#define yield()		SwitchToThread()
+#else
+#include <fcntl.h>
+#include <unistd.h>
+#include <errno.h>
+#include <sched.h>
+#define yield()		sched_yield()
+#endif
+#include "cache.h"
+
+#define SET_S		(CACHE_WAYS * sizeof(cache_ent))	// the size of a set
+#define set_off(s)	(sizeof(cache_head) + (s) * SET_S)	// where a set starts
+#define SEED0		0x6A09E667F3BCC908ULL
+#define SEED1		0xBB67AE8584CAA73BULL
+
+static int file_open(cache * ch, const char * fname);
+static int file_make(const char * fname, long size);
+static int rd_at(cache * ch, void * buf, size_t len, uint64_t off);
+static int wr_at(cache * ch, const void * buf, size_t len, uint64_t off);
+static void lock_set(cache * ch, uint64_t s);
+static void unlock_set(cache * ch, uint64_t s);
+static int lock_file(cache * ch, uint64_t s, int lock);
+static uint64_t mix(uint64_t h, uint64_t w);
+static uint64_t hash_bytes(uint64_t h, const byte * p, size_t len);
+static void key_of(const cache * ch, const batch_poke * pokes, long npokes, uint64_t * key);
+static uint64_t check_of(const cache_ent * ent);
+
+/* -------------------- PUBLIC INTERFACE START -------------------- */
+int cache_open(cache * ch, const char * fname, long size, const byte * code, int csize,
+		unsigned long steps)
+{
+	/* open the file, make it first if there's none
+	 * check the head
+	 * hash the binary and the steps for the keys */
+	cache_head hd;
+	
+	memset(ch, 0, sizeof(*ch));
+	if (file_open(ch, fname) != 0 &&
+		(file_make(fname, size) != 0 || file_open(ch, fname) != 0))
+		return -1;
+	
+	if (rd_at(ch, &hd, sizeof(hd), 0) != 0 ||
+		strncmp(hd.magic, CACHE_MAGIC, sizeof(hd.magic)) != 0 ||
+		hd.version != CACHE_VER || hd.size != sizeof(cache_ent) || 0 == hd.nsets)
+	{
+		cache_close(ch);
+		return -1;
+	}
+	
+	ch->nsets = hd.nsets;
+	ch->base[0] = mix(hash_bytes(SEED0, code, csize), steps);
+	ch->base[1] = mix(hash_bytes(SEED1, code, csize), steps);
+	return 0;
+}
+
+int cache_get(cache * ch, const batch_poke * pokes, long npokes, batch_res * res)
+{
+	/* read the set of the key
+	 * on a hit copy the result and make it the last used one in the set */
+	cache_ent set[CACHE_WAYS];
+	uint64_t key[2], s, top = 0;
+	int i, hit = -1;
+	
+	key_of(ch, pokes, npokes, key);
+	s = key[0] % ch->nsets;
+	
+	lock_set(ch, s);
+	if (rd_at(ch, set, sizeof(set), set_off(s)) == 0)
+	{
+		for (i = 0; i < CACHE_WAYS; ++i)
+		{
+			if (set[i].stamp > top)
+				top = set[i].stamp;
+			if (set[i].key[0] == key[0] && set[i].key[1] == key[1] &&
+				set[i].check == check_of(&set[i]))
+				hit = i;
+		}
+		
+		if (hit >= 0)
+		{
+			memcpy(res->regs, set[hit].regs, NUM_REGS);
+			memcpy(res->ram, set[hit].ram, RAM_S);
+			res->state = set[hit].state;
+			res->icount = set[hit].icount;
+			res->digest = set[hit].digest;
+			
+			set[hit].stamp = top + 1;
+			wr_at(ch, &set[hit].stamp, sizeof(set[hit].stamp),
+					set_off(s) + hit * sizeof(cache_ent) + offsetof(cache_ent, stamp));
+		}
+	}
+	unlock_set(ch, s);
+	
+	return hit >= 0;
+}
+
+int cache_put(cache * ch, const batch_poke * pokes, long npokes, const batch_res * res)
+{
+	/* read the set of the key
+	 * write over the entry of the same key, a broken or empty one,
+	 * or the one used the longest time ago, in this order */
+	cache_ent set[CACHE_WAYS], * ent;
+	uint64_t key[2], s, top = 0;
+	int i, way = 0, rank = 0, r, ret = -1;
+	
+	key_of(ch, pokes, npokes, key);
+	s = key[0] % ch->nsets;
+	
+	lock_set(ch, s);
+	if (rd_at(ch, set, sizeof(set), set_off(s)) == 0)
+	{
+		for (i = 0; i < CACHE_WAYS; ++i)
+		{
+			if (set[i].stamp > top)
+				top = set[i].stamp;
+			
+			if (set[i].check != check_of(&set[i]))
+				r = 2;
+			else if (set[i].key[0] == key[0] && set[i].key[1] == key[1])
+				r = 3;
+			else
+				r = 1;
+			
+			if (r > rank || (r == rank && set[i].stamp < set[way].stamp))
+			{
+				rank = r;
+				way = i;
+			}
+		}
+		
+		ent = &set[way];
+		memset(ent, 0, sizeof(*ent));
+		ent->key[0] = key[0];
+		ent->key[1] = key[1];
+		ent->stamp = top + 1;
+		ent->icount = res->icount;
+		ent->digest = res->digest;
+		memcpy(ent->regs, res->regs, NUM_REGS);
+		memcpy(ent->ram, res->ram, RAM_S);
+		ent->state = res->state;
+		ent->check = check_of(ent);
+		
+		ret = wr_at(ch, ent, sizeof(*ent), set_off(s) + way * sizeof(cache_ent));
+	}
+	unlock_set(ch, s);
+	
+	return ret;
+}
+
+void cache_close(cache * ch)
+{
+	/* close the file */
+#ifdef WINDOWS
+	CloseHandle(ch->fd);
+#else
+	close(ch->fd);
+#endif
+	return;
+}
+/* -------------------- PUBLIC INTERFACE END -------------------- */
+
+static int file_open(cache * ch, const char * fname)
+{
+	/* open an existing file for reading and writing */
+#ifdef WINDOWS
+	ch->fd = CreateFileA(fname, GENERIC_READ | GENERIC_WRITE,
+			FILE_SHARE_READ | FILE_SHARE_WRITE, NULL, OPEN_EXISTING,
+			FILE_ATTRIBUTE_NORMAL, NULL);
+	return (INVALID_HANDLE_VALUE == ch->fd) ? -1 : 0;
+#else
+	ch->fd = open(fname, O_RDWR);
+	return (-1 == ch->fd) ? -1 : 0;
+#endif
+}
+
+static int file_make(const char * fname, long size)
+{
+	/* make a file of empty sets with the head in front under another name
+	 * move it to fname unless some other process has made fname by now */
+	cache_head hd;
+	char * tmp;
+	int res = -1;
+	
+	if ((tmp = malloc(strlen(fname) + 32)) == NULL)
+		return -1;
+	
+	memset(&hd, 0, sizeof(hd));
+	memcpy(hd.magic, CACHE_MAGIC, sizeof(hd.magic));
+	hd.version = CACHE_VER;
+	hd.size = sizeof(cache_ent);
+	hd.nsets = (size > (long)(sizeof(hd) + SET_S)) ? (size - sizeof(hd)) / SET_S : 1;
+
+#ifdef WINDOWS
+	HANDLE fd;
+	DWORD wrote;
+	LARGE_INTEGER end;
+	
+	sprintf(tmp, "%s.%lu", fname, (unsigned long)GetCurrentProcessId());
+	fd = CreateFileA(tmp, GENERIC_WRITE, 0, NULL, CREATE_ALWAYS, FILE_ATTRIBUTE_NORMAL, NULL);
+	if (fd != INVALID_HANDLE_VALUE)
+	{
+		end.QuadPart = set_off(hd.nsets);
+		if (WriteFile(fd, &hd, sizeof(hd), &wrote, NULL) && sizeof(hd) == wrote &&
+			SetFilePointerEx(fd, end, NULL, FILE_BEGIN) && SetEndOfFile(fd))
+			res = 0;
+		CloseHandle(fd);
+		
+		// fails if fname is there
+		if (0 == res && !MoveFileA(tmp, fname) && GetLastError() != ERROR_ALREADY_EXISTS)
+			res = -1;
+		DeleteFileA(tmp);
+	}
+#else
+	int fd;
+	
+	sprintf(tmp, "%s.%ld", fname, (long)getpid());
+	if ((fd = open(tmp, O_WRONLY | O_CREAT | O_TRUNC, 0644)) != -1)
+	{
+		if (write(fd, &hd, sizeof(hd)) == sizeof(hd) && ftruncate(fd, set_off(hd.nsets)) == 0)
+			res = 0;
+		if (close(fd) != 0)
+			res = -1;
+		
+		// unlike rename(), fails if fname is there
+		if (0 == res && link(tmp, fname) != 0 && errno != EEXIST)
+			res = -1;
+		unlink(tmp);
+	}
+#endif
+
+	free(tmp);
+	return res;
+}
+
+static int rd_at(cache * ch, void * buf, size_t len, uint64_t off)
+{
+	/* read len bytes from off */
+#ifdef WINDOWS
+	OVERLAPPED ov;
+	DWORD got;
+	
+	memset(&ov, 0, sizeof(ov));
+	ov.Offset = (DWORD)off;
+	ov.OffsetHigh = (DWORD)(off >> 32);
+	return (ReadFile(ch->fd, buf, len, &got, &ov) && got == len) ? 0 : -1;
+#else
+	return (pread(ch->fd, buf, len, off) == (ssize_t)len) ? 0 : -1;
+#endif
+}
+
+static int wr_at(cache * ch, const void * buf, size_t len, uint64_t off)
+{
+	/* write len bytes at off */
+#ifdef WINDOWS
+	OVERLAPPED ov;
+	DWORD wrote;
+	
+	memset(&ov, 0, sizeof(ov));
+	ov.Offset = (DWORD)off;
+	ov.OffsetHigh = (DWORD)(off >> 32);
+	return (WriteFile(ch->fd, buf, len, &wrote, &ov) && wrote == len) ? 0 : -1;
+#else
+	return (pwrite(ch->fd, buf, len, off) == (ssize_t)len) ? 0 : -1;
+#endif
+}
+
+static void lock_set(cache * ch, uint64_t s)
+{
+	/* keep the other threads, then the other processes, out of set s
+	 * if the file can't be locked the set is used anyway; the
+	 * check of an entry catches one written by two at once */
+	int * lk = &ch->lock[s % CACHE_STRIPES];
+	
+	while (__atomic_exchange_n(lk, 1, __ATOMIC_ACQUIRE))
+		yield();
+	
+	lock_file(ch, s, 1);
+	return;
+}
+
+static void unlock_set(cache * ch, uint64_t s)
+{
+	/* let the other processes, then the other threads, in set s */
+	lock_file(ch, s, 0);
+	__atomic_store_n(&ch->lock[s % CACHE_STRIPES], 0, __ATOMIC_RELEASE);
+	return;
+}
+
+static int lock_file(cache * ch, uint64_t s, int lock)
+{
+	/* lock or unlock the bytes of set s in the file; waits for the lock */
+#ifdef WINDOWS
+	OVERLAPPED ov;
+	
+	memset(&ov, 0, sizeof(ov));
+	ov.Offset = (DWORD)set_off(s);
+	ov.OffsetHigh = (DWORD)(set_off(s) >> 32);
+	if (lock)
+		return LockFileEx(ch->fd, LOCKFILE_EXCLUSIVE_LOCK, 0, SET_S, 0, &ov) ? 0 : -1;
+	return UnlockFileEx(ch->fd, 0, SET_S, 0, &ov) ? 0 : -1;
+#else
+	struct flock fl;
+	
+	memset(&fl, 0, sizeof(fl));
+	fl.l_type = lock ? F_WRLCK : F_UNLCK;
+	fl.l_whence = SEEK_SET;
+	fl.l_start = set_off(s);
+	fl.l_len = SET_S;
+	
+	while (fcntl(ch->fd, F_SETLKW, &fl) == -1)
+	{
+		if (errno != EINTR)
+			return -1;
+	}
+	
+	return 0;
+#endif
+}
+
+static uint64_t mix(uint64_t h, uint64_t w)
+{
+	/* take in w; splitmix64 of the two */
+	h = (h ^ w) + 0x9E3779B97F4A7C15ULL;
+	h = (h ^ (h >> 30)) * 0xBF58476D1CE4E5B9ULL;
+	h = (h ^ (h >> 27)) * 0x94D049BB133111EBULL;
+	return h ^ (h >> 31);
+}
+
+static uint64_t hash_bytes(uint64_t h, const byte * p, size_t len)
+{
+	/* take in len bytes from p, 8 at a time, and then len */
+	uint64_t w;
+	size_t i;
+	
+	for (i = 0; i + 8 <= len; i += 8)
+	{
+		memcpy(&w, p + i, 8);
+		h = mix(h, w);
+	}
+	
+	for (w = 0; i < len; ++i)
+		w = (w << 8) | p[i];
+	
+	return mix(mix(h, w), len);
+}
+
+static void key_of(const cache * ch, const batch_poke * pokes, long npokes, uint64_t * key)
+{
+	/* the key of a run; the binary and the steps, then every poke in order
+	 * 0, 0 is left for the empty entries */
+	long i;
+	int n;
+	
+	for (n = 0; n < 2; ++n)
+	{
+		key[n] = ch->base[n];
+		for (i = 0; i < npokes; ++i)
+			key[n] = mix(key[n], ((uint64_t)pokes[i].where << 8) | pokes[i].val);
+		key[n] = mix(key[n], npokes);
+	}
+	
+	if (0 == key[0] && 0 == key[1])
+		key[0] = 1;
+	return;
+}
+
+static uint64_t check_of(const cache_ent * ent)
+{
+	/* the hash of the key and the result
+	 * the stamp changes on every hit, so it's left out */
+	const byte * res = (const byte *)&ent->icount;
+	
+	return hash_bytes(mix(SEED0, ent->key[0] ^ ent->key[1]), res,
+			sizeof(*ent) - offsetof(cache_ent, icount));
+}
@@ -0,0 +1,76 @@
+/* cache.h -- the on-disk cache of batch results public interface */
+/* ver. 1.0 */
+#ifndef CACHE_H
+#define CACHE_H
+
+#include <stdint.h>
+#include "jcpu.h"
+#include "batch.h"
+
+#define CACHE_MAGIC		"JCPCACHE"	// the first 8 bytes of a cache file
+#define CACHE_VER		1			// the cache file layout version
+#define CACHE_WAYS		8			// entries in a set
+#define CACHE_DEF_SIZE	(16L << 20)	// the size of a new cache file, in bytes
+#define CACHE_STRIPES	64			// locks between the threads of a process
+
+/* the start of a cache file; fixed size fields and no padding, like the
+ * entries after it, so both go to and from the file in one piece */
+typedef struct cache_head_ {
+	char magic[8];				// CACHE_MAGIC, no '\0'
+	uint32_t version;			// CACHE_VER
+	uint32_t size;				// sizeof(cache_ent)
+	uint64_t nsets;				// how many sets of CACHE_WAYS entries follow
+} cache_head;
+
+// an entry; a run and how it ended up
+typedef struct cache_ent_ {
+	uint64_t key[2];			// the hash of the binary, the steps, and the pokes
+	uint64_t stamp;				// the last use; the lowest in a set goes first
+	uint64_t check;				// the hash of key and all after stamp; 0 bytes don't match
+	uint64_t icount;
+	uint64_t digest;
+	byte regs[NUM_REGS];
+	byte state;
+	byte pad[4];				// to 8 bytes
+	byte ram[RAM_S];
+} cache_ent;
+
+// an open cache for one binary and step count
+typedef struct cache_ {
+#ifdef WINDOWS
+	HANDLE fd;
+#else
+	int fd;
+#endif
+	uint64_t nsets;				// from the head of the file
+	uint64_t base[2];			// the key of the binary and the steps
+	int lock[CACHE_STRIPES];	// the sets one of the threads is using
+} cache;
+
+int cache_open(cache * ch, const char * fname, long size, const byte * code, int csize,
+		unsigned long steps);
+/* returns: 0 on success, -1 if fname can't be opened or made, or isn't a cache.
+ *
+ * description: Opens the cache in fname for the runs of code for steps
+ * instructions. If there is no such file, one of size bytes is made, and
+ * moved in place only if no other process made it first. The size of a file
+ * never changes; new runs push out the least recently used ones of the same
+ * set. Many processes can share a file and many threads a cache. */
+
+int cache_get(cache * ch, const batch_poke * pokes, long npokes, batch_res * res);
+/* returns: 1 if the run with pokes is in the cache and res now holds its result,
+ * 0 if it isn't, or the file can't be read.
+ *
+ * description: Looks up the run which starts with the npokes pokes applied. */
+
+int cache_put(cache * ch, const batch_poke * pokes, long npokes, const batch_res * res);
+/* returns: 0 on success, -1 if the file can't be written.
+ *
+ * description: Keeps res as the result of the run which starts with the npokes
+ * pokes applied. */
+
+void cache_close(cache * ch);
+/* returns: Nothing.
+ *
+ * description: Closes the file of ch. */
+#endif
@@ -1,17 +1,24 @@
 /* disasm.c -- the disassembler engine */
-/* ver. 1.02 */
+/* ver. 1.05 */
 
-/* Reads binary, outputs jcpu assembly language */
+/* Reads binary, outputs jcpu assembly language. disasm_instr() keeps
+ * nothing between calls, so any number of threads can use it at once.
+ * With a symbol map, the address operands which have a label show it
+ * instead of the number; the map is indexed by address, so that's a
+ * single lookup. */
 
 /* Author: Vladimir Dinev */
 #include <stdio.h>
 #include <stdlib.h>
 #include <string.h>
+#include <stdarg.h>
+#include <ctype.h>
 #include "disasm.h"
 #include "mach_code.h"
 
 #define ROWS 			(256 + 4)	// four more for the screen
-#define COLS 			32			// max instruction string width
+#define COLS 			64			// max instruction string width
+#define SYM_LINE		128			// max symbol map line length
 #define INST_NBL		4			// >> 4 for the instruction nibble of a byte
 #define FLAGS_NBL		0x0F		// & 0x0F for the flags nibble of a conditional jump
 #define FLAG_C			0x08		// & 0x08 for the carry flag
@@ -20,20 +27,26 @@
 #define FLAG_Z			0x01		// & 0x01 for the zero flag
 #define REG_A			0x0C		// & 0x0C to get reg a
 #define REG_B			0x03		// & 0x03 to get reg b
-#define get_next_byte()	sprintf(str_instr, pref_nopref, str_instr, code[*offset+1])
-
-const char * pref_nopref;
 
 // disassemble the next instruction
-static char * diasm_get_instr(byte * code, int * offset);
+static void diasm_get_instr(const byte * code, int size, int offset, const char * hexfmt,
+		char * const * syms, char * out, int outsz);
+static void put(char * out, int outsz, const char * fmt, ...);
+static void put_addr(char * out, int outsz, const char * hexfmt, char * const * syms, byte addr);
 
 char ** disasm_dis(byte * code, int size, int prefhex)
+{
+	/* disassemble without symbols */
+	return disasm_dis_sym(code, size, prefhex, NULL);
+}
+
+char ** disasm_dis_sym(byte * code, int size, int prefhex, char * const * syms)
 {
 	/* place the disassembled result in disasm_code
 	 * and return it's address */
 	static char dcode[ROWS][COLS];
 	static char * disasm_code[ROWS] = {NULL};
-	static char * hexpr[] = {"%s %02X", "%s %#02X"};
+	char str_instr[COLS];
 	
 	if (prefhex < NO_PREF || prefhex > PREF_HEX)
 	{
@@ -42,8 +55,6 @@ char ** disasm_dis(byte * code, int size, int prefhex)
 		exit(EXIT_FAILURE);
 	}
 	
-	pref_nopref = hexpr[prefhex];
-	
 	// mark end of code for the display module
 	disasm_code[ROWS-4] = "--- --      -- --  --";
 	disasm_code[ROWS-3] = "--- --      -- --  --";
@@ -53,22 +64,106 @@ char ** disasm_dis(byte * code, int size, int prefhex)
 	int i, ins_addr;
 	for (i = 0; i < size;)
 	{
-		// Note: i gets incremented in diasm_get_instr()
 		ins_addr = i;
-		sprintf(dcode[ins_addr], "%02X> %s", ins_addr, diasm_get_instr(code, &i));
+		i += disasm_instr_sym(code, size, ins_addr, prefhex, syms, str_instr, sizeof(str_instr));
+		sprintf(dcode[ins_addr], "%02X> %s", ins_addr, str_instr);
 		disasm_code[ins_addr] = dcode[ins_addr];
 	}
 	
 	return disasm_code;
 }
 
-static char * diasm_get_instr(byte * code, int * offset)
+int disasm_instr(const byte * code, int size, int addr, int prefhex, char * out, int outsz)
 {
-	/* build a string mnemonic */
-	static char str_instr[COLS];
+	/* disassemble without symbols */
+	return disasm_instr_sym(code, size, addr, prefhex, NULL, out, outsz);
+}
+
+int disasm_instr_sym(const byte * code, int size, int addr, int prefhex, char * const * syms,
+		char * out, int outsz)
+{
+	/* disassemble the instruction at addr in out
+	 * return its size */
+	static const char * hexfmt[] = {"%02X", "%#02X"};
+	
+	if (prefhex < NO_PREF || prefhex > PREF_HEX || addr < 0 || addr >= size || outsz < 1)
+		return -1;
+	
+	out[0] = '\0';
+	diasm_get_instr(code, size, addr, hexfmt[prefhex], syms, out, outsz);
+	return mcode[code[addr] >> INST_NBL].size;
+}
+
+int disasm_read_syms(const char * fname, char * syms[DIS_SYMS])
+{
+	/* read the map of labels jcpasm writes
+	 * the first label of an address is the one kept
+	 * empty lines and lines starting with '#' are skipped
+	 * a bad line frees all that was read */
+	char line[SYM_LINE], name[SYM_LINE], * ch;
+	unsigned int addr;
+	int n = 0, line_no = 0;
+	FILE * fp;
+	
+	if ((fp = fopen(fname, "r")) == NULL)
+		return -1;
+	
+	while (fgets(line, sizeof(line), fp) != NULL)
+	{
+		++line_no;
+		
+		for (ch = line; isspace((unsigned char)*ch); ++ch)
+			continue;
+		
+		if ('\0' == *ch || '#' == *ch)
+			continue;
+		
+		if (sscanf(ch, "%x %s", &addr, name) != 2 || addr >= DIS_SYMS)
+		{
+			fprintf(stderr, "Err: \"%s\" line %d: not an address and a label\n",
+					fname, line_no);
+			n = -1;
+			break;
+		}
+		
+		if (syms[addr] != NULL)
+			continue;
+		
+		if ((syms[addr] = malloc(strlen(name) + 1)) == NULL)
+		{
+			n = -1;
+			break;
+		}
+		
+		strcpy(syms[addr], name);
+		++n;
+	}
+	
+	fclose(fp);
+	
+	if (-1 == n)
+	{
+		/* no half maps; syms started out all NULL */
+		for (addr = 0; addr < DIS_SYMS; ++addr)
+		{
+			free(syms[addr]);
+			syms[addr] = NULL;
+		}
+	}
+	
+	return n;
+}
+
+static void diasm_get_instr(const byte * code, int size, int offset, const char * hexfmt,
+		char * const * syms, char * out, int outsz)
+{
+	/* build a string mnemonic
+	 * the byte after the end of code reads as 0 */
 	
 	// get higher nibble
-	int inst_code = code[*offset] >> INST_NBL;
+	int inst_code = code[offset] >> INST_NBL;
+	// the second byte of the instruction
+	byte next = (offset + 1 < size) ? code[offset + 1] : 0;
 	// for reg a and reg b from lower nibble
 	int rega = 0, regb = 0;
 	int flgs;
@@ -77,17 +172,23 @@ static char * diasm_get_instr(byte * code, int * offset)
 	switch (mcode[inst_code].size)
 	{
 		case 1:
-			sprintf(str_instr, "%02X     ", code[*offset]);
+			put(out, outsz, "%02X     ", code[offset]);
 			break;
 		case 2:
-			sprintf(str_instr, "%02X  %02X ", code[*offset], code[*offset+1]);
+			put(out, outsz, "%02X  %02X ", code[offset], next);
 			break;
 		default:
 			break;
 	}
 	
 	// get instriction mnemonic in the string
-	sprintf(str_instr, "%s %s", str_instr, mcode[inst_code].name);
+	if (IO == inst_code)
+		put(out, outsz, " %s %s", 
+				iodir[(code[offset] & IO_OUT) > 0], iokind[(code[offset] & IO_ADDR) > 0]);
+	else if (IRET_INSTR == code[offset])
+		put(out, outsz, " %s", iret_name);
+	else
+		put(out, outsz, " %s", mcode[inst_code].name);
 	
 	switch (inst_code)
 	{
@@ -102,42 +203,64 @@ static char * diasm_get_instr(byte * code, int * offset)
 		case XOR:
 		case CMP:
 			// get source - dest registers
-			rega = code[*offset] & REG_A;
-			regb = code[*offset] & REG_B;
+			rega = code[offset] & REG_A;
+			regb = code[offset] & REG_B;
 			// get register strings
-			sprintf(str_instr, "%s %s, %s", str_instr, gregs[rega >> 2], gregs[regb]);
+			put(out, outsz, " %s, %s", gregs[rega >> 2], gregs[regb]);
 			break;
 		case DATA:
 			// get dest register
-			regb = code[*offset] & REG_B;
-			sprintf(str_instr, "%s %s,", str_instr, gregs[regb]);
+			regb = code[offset] & REG_B;
+			put(out, outsz, " %s,", gregs[regb]);
 			// get load source
-			get_next_byte();
+			put(out, outsz, " ");
+			put_addr(out, outsz, hexfmt, syms, next);
 			break;
 		case JMP:
 			// get jump address
-			get_next_byte();
+			put(out, outsz, " ");
+			put_addr(out, outsz, hexfmt, syms, next);
 			break;
 		case JMPR:
+		case IO:
 			// get dest register
-			regb = code[*offset] & REG_B;
-			sprintf(str_instr, "%s %s", str_instr, gregs[regb]);
+			regb = code[offset] & REG_B;
+			put(out, outsz, " %s", gregs[regb]);
 			break;
 		case JCOND:
 			// get flags
-			flgs = code[*offset] & FLAGS_NBL;
-			strcat(str_instr, flags[flgs & FLAG_C]);
-			strcat(str_instr, flags[flgs & FLAG_A]);
-			strcat(str_instr, flags[flgs & FLAG_E]);
-			strcat(str_instr, flags[flgs & FLAG_Z]);
+			flgs = code[offset] & FLAGS_NBL;
+			put(out, outsz, "%s%s%s%s", flags[flgs & FLAG_C], flags[flgs & FLAG_A],
+					flags[flgs & FLAG_E], flags[flgs & FLAG_Z]);
 			// get jump address
-			get_next_byte();
+			put(out, outsz, " ");
+			put_addr(out, outsz, hexfmt, syms, next);
 			break;
 		default:
 			break;
 	}
+	
+	return;
+}
 
-	*offset += mcode[inst_code].size;
+static void put(char * out, int outsz, const char * fmt, ...)
+{
+	/* add to the end of out, as much as fits */
+	int len = strlen(out);
+	va_list args;
 	
-	return str_instr;
+	va_start(args, fmt);
+	vsnprintf(out + len, outsz - len, fmt, args);
+	va_end(args);
+	return;
+}
+
+static void put_addr(char * out, int outsz, const char * hexfmt, char * const * syms, byte addr)
+{
+	/* add the label of addr if there is one, addr otherwise */
+	if (syms != NULL && syms[addr] != NULL)
+		put(out, outsz, "%s", syms[addr]);
+	else
+		put(out, outsz, hexfmt, addr);
+	return;
 }
@@ -1,10 +1,12 @@
 /* disasm.h -- the header for the disassembler engine */
-/* ver. 1.01 */
+/* ver. 1.03 */
 #ifndef DISASM_H
 #define DISASM_H
 // the byte type
 typedef unsigned char byte;
 
+#define DIS_SYMS	256		// entries in a symbol map; one for every address
+
 enum {NO_PREF, PREF_HEX};
 char ** disasm_dis(byte * code, int size, int prefhex);
 /*
@@ -13,5 +15,45 @@ char ** disasm_dis(byte * code, int size, int prefhex);
  * description: Reads a binary array code of size size and returns it's 
  * equivalent in jcpu assembly. All literas are disassembled in hex. 
  * prefhex specifies whether they should be prefixed with 0x or not. 
- * It should be set to NO_PREF or PREF_HEX. */
+ * It should be set to NO_PREF or PREF_HEX. The strings live in a static
+ * array which the next call overwrites. */
+
+int disasm_instr(const byte * code, int size, int addr, int prefhex, char * out, int outsz);
+/*
+ * returns: The size of the instruction at addr, -1 if addr or prefhex is bad.
+ * 
+ * description: Puts the instruction at addr of the size bytes of code in out,
+ * as disasm_dis() does but without the address in front. No more than outsz
+ * bytes are written, '\0' included. The second byte of an instruction which
+ * doesn't fit in code reads as 0. Keeps no state, so it is safe to call from
+ * many threads. */
+
+char ** disasm_dis_sym(byte * code, int size, int prefhex, char * const * syms);
+/*
+ * returns: As disasm_dis().
+ * 
+ * description: As disasm_dis(), but the jump addresses and the DATA values
+ * with a label in syms show the label. syms has DIS_SYMS entries, one for
+ * every address; NULL entries have no label. syms may be NULL. */
+
+int disasm_instr_sym(const byte * code, int size, int addr, int prefhex, char * const * syms,
+		char * out, int outsz);
+/*
+ * returns: As disasm_instr().
+ * 
+ * description: As disasm_instr(), with the labels in syms as in
+ * disasm_dis_sym(). */
+
+int disasm_read_syms(const char * fname, char * syms[DIS_SYMS]);
+/*
+ * returns: The number of labels read, -1 if fname can't be read or is not
+ * a symbol map.
+ * 
+ * description: Reads the symbol map jcpasm -m writes in syms, which should
+ * start out all NULL. Every line of the map is an address in hex and the
+ * label there. When an address has more than one label, the first is kept.
+ * Empty lines and lines starting with '#' are skipped; any other line which
+ * isn't an entry is reported with its line number on stderr, and then the
+ * labels already read are freed and syms is all NULL again. Otherwise the
+ * label strings are allocated and live as long as the program. */
 #endif
@@ -1,84 +1,209 @@
 /* display.c -- provides display functionality for the jcpvm */
-/* ver. 1.03 */
+/* ver. 1.10 */
 
 /* Creates a frame buffer and fills it with what
- * represents the current machine state of the jcpu. 
- * A new frame gets created after every interactive step. */
+ * represents the current machine state of the jcpu.
+ * A new frame gets created after every interactive step.
+ * The frame is a grid of characters, no line ends. The ram and the
+ * registers go in it from tables of ready made cells. The frame last
+ * shown is kept, and only the cells which differ from it are sent to the
+ * terminal, each run of them after a cursor move, and the prompt under the
+ * frame after them, all in one write. A Windows console which doesn't take
+ * escape sequences gets the cursor moved by the console api instead, and a
+ * write for every run.
+ * The disassembly follows stores into the code: when the digest of the ram
+ * is not the one disassembled, only the changed bytes are disassembled
+ * again, from the start of the instruction they are in up to where the
+ * instructions line up with the old ones again. With a symbol map, the
+ * jump addresses and the DATA values with a label show it.
+ * Right of the code is a pane of the last executed instructions, from the
+ * history the emulation thread keeps, each with the registers it changed.
+ * Above it a status line counts the instructions, the cycles under the
+ * stepper, and how fast the last run went. */
 
 /* Author: Vladimir Dinev */
 #include <stdio.h>
 #include <string.h>
 #include <stdlib.h>
 #include "os_def.h"
+#ifndef WINDOWS
+#include <unistd.h>
+#elif !defined(ENABLE_VIRTUAL_TERMINAL_PROCESSING)
+#define ENABLE_VIRTUAL_TERMINAL_PROCESSING	0x0004
+#endif
 #include "display.h"
 #include "disasm.h"
-#include "jcpu.h"
 #include "mach_code.h"
 
 #define BYTE_CELL	4		// cells conatining the ram info are 4 chars wide
 #define RAM_LINE	2		// the ram begins at row index 2 of the frame buffer
+#define RAM_COL		3		// and column index 3
 #define REG_LINE	2		// registers begin at the same line as the ram
+#define REG_COL		67		// right after it
+#define REG_NAME	6		// the mark and the name of a register take 6 chars
+#define REG_VAL		3		// and its value 3
+#define STEP_LINE	18		// the status is at line index 18
 #define CODE_LINE	20		// disassembled code begins at line index 20
+#define INSTR_COL	24		// the arrow after the next instruction is at column index 24
 #define INSTR_NUM	4		// the number of disassembled instructions minus the last executed
 #define INSTR_MAX	256		// maximum number of instructions to disassemble
+#define HIST_LINE	(CODE_LINE - 1)	// the history pane begins at the last instruction line
+#define HIST_COL	30		// and column index 30
+#define HIST_W		(FRAME_COLS - HIST_COL)	// it takes the rest of the row
+#define HIST_SKIP	8		// the bytes before the mnemonic of a disassembled instruction
 #define MARK_IAR	'@'		// '@' marks the address pointed to by IAR
 #define MARK_MAR	'*'		// '*' marks the address pointed to by MAR
+#define RUN_GAP		6		// changed cells closer than this go out as one run
+#define DIS_COLS	64		// room for a disassembled instruction and its address
+#define OUT_SZ		((FRAME_ROWS + 1) * FRAME_COLS * 8)	// the most a frame and the prompt take to send
+#define ESC			"\033"	// starts a terminal escape sequence
 
-char frame[FRAME_ROWS][FRAME_COLS];	// the frame buffer
-char ** disasm_str;					// a pointer to an array of strings; holds the disasm text
+static char frame[FRAME_ROWS][FRAME_COLS];	// the frame buffer
+static char shown[FRAME_ROWS][FRAME_COLS];	// what the terminal shows; 0 is unknown
+static bool vt = true;						// the terminal takes escape sequences
+static char * disasm_str[RAM_S + INSTR_NUM];	// the instruction at every address; NULL if none starts there
+static char dis_txt[RAM_S][DIS_COLS];		// the text disasm_str points to
+static byte dis_ram[RAM_S];					// the ram as disassembled
+static char * const * dis_syms = NULL;		// the labels of the addresses; NULL if none
+static const emu_hist * hist = NULL;		// the history ring to show
+static unsigned long hist_count = 0;		// instructions put in it
+static int hist_back = 0;					// how far back from the newest the pane is
+static double mips = -1;					// millions of instructions a second; < 0 if none
+static uint64_t dis_digest;					// and its digest
+static char ram_cell[2][RAM_S][BYTE_CELL];	// " %02X " and " %-3d" of every byte
+static char reg_cell[2][RAM_S][REG_VAL];	// "%02X " and "%-3d" of every byte
 
-static void make_frame(int hex_dec, int last_instr);
-static void do_ram(int hex_dec);
-static void do_code(int last_instr);
-static void do_regs(int hex_dec);
+static void make_frame(const jcpu * cpu, int hex_dec, int last_instr);
+static void do_ram(const jcpu * cpu, int hex_dec);
+static void do_code(const jcpu * cpu, int last_instr);
+static void dis_update(const jcpu * cpu);
+static int dis_from(const byte * ram, int addr, int upto);
+static void do_regs(const jcpu * cpu, int hex_dec);
+static void do_hist(const jcpu * cpu, int hex_dec);
+static void do_status(const jcpu * cpu);
+static void put_str(int row, int col, const char * str, int width);
+static int put_diff(char * out);
+static void out_write(const char * out, int len);
 
 void disp_clear(void)
 {
-	/* clear the terminal
+	/* clear the terminal with an escape sequence; older
+	 * Windows consoles which don't take them run cls, and
+	 * the frames after go without them
 	 * 1st of 2 system specific functions */
 #ifdef WINDOWS
-	system("cls");
+	HANDLE h = GetStdHandle(STD_OUTPUT_HANDLE);
+	DWORD mode;
+	
+	vt = GetConsoleMode(h, &mode) &&
+		SetConsoleMode(h, mode | ENABLE_VIRTUAL_TERMINAL_PROCESSING);
+	if (!vt)
+		system("cls");
+	else
+		out_write(ESC "[2J" ESC "[H", 7);
 #else
-	system("clear");
+	out_write(ESC "[2J" ESC "[H", 7);
 #endif
+	memset(shown, 0, sizeof(shown));
+	return;
+}
+
+void disp_set_syms(char * const * syms)
+{
+	/* show the labels in syms from the next disp_init_frame() on */
+	dis_syms = syms;
 	return;
 }
 
-void disp_init_frame(void)
+void disp_init_frame(const jcpu * cpu)
 {
-	/* put constant strings in the frame */
+	/* put constant strings in the frame
+	 * fill the tables of cells */
+	char cell[BYTE_CELL + 1];
 	int i;
 	
-	sprintf(&frame[0][0],  
-	"    00  01  02  03  04  05  06  07  08  09  0A  0B  0C  0D  0E  0F");
-	sprintf(&frame[1][0],
-	"    ______________________________________________________________");
+	memset(frame, ' ', sizeof(frame));
+	memset(shown, 0, sizeof(shown));
+	
+	put_str(0, 0,
+	"    00  01  02  03  04  05  06  07  08  09  0A  0B  0C  0D  0E  0F", 0);
+	put_str(1, 0,
+	"    ______________________________________________________________", 0);
 	
 	for (i = 0; i <= 0x0F; ++i)
-		sprintf(&frame[2+i][0], "%02X|%63s  ", i << 4, " ");
+	{
+		sprintf(cell, "%02X|", i << 4);
+		put_str(RAM_LINE + i, 0, cell, 0);
+	}
+	
+	for (i = 0; i < RAM_S; ++i)
+	{
+		sprintf(cell, " %02X ", i);
+		memcpy(ram_cell[HEX_DSP][i], cell, BYTE_CELL);
+		sprintf(cell, " %-3d", i);
+		memcpy(ram_cell[DEC_DSP][i], cell, BYTE_CELL);
+		sprintf(cell, "%02X ", i);
+		memcpy(reg_cell[HEX_DSP][i], cell, REG_VAL);
+		sprintf(cell, "%-3d", i);
+		memcpy(reg_cell[DEC_DSP][i], cell, REG_VAL);
+	}
 	
-	// disassemble the whole ram
-	disasm_str = disasm_dis(ram, sizeof(ram), NO_PREF);
+	// disassemble the whole ram; past its end is the end of the code
+	for (i = 0; i < RAM_S; ++i)
+		disasm_str[i] = NULL;
+	for ( ; i < RAM_S + INSTR_NUM; ++i)
+		disasm_str[i] = "--- --      -- --  --";
 	
+	memcpy(dis_ram, cpu->ram, RAM_S);
+	dis_digest = cpu->digest;
+	dis_from(cpu->ram, 0, RAM_S - 1);
+	
+	return;
+}
+
+void disp_hist(const emu_hist * ring, unsigned long count, int back)
+{
+	/* show ring in the next frames */
+	hist = ring;
+	hist_count = count;
+	hist_back = back;
+	return;
+}
+
+void disp_rate(double rate)
+{
+	/* show rate in the next frames */
+	mips = rate;
 	return;
 }
 
-void disp_print(int hex_dec, int last_instr)
+void disp_print(const jcpu * cpu, int hex_dec, int last_instr, const char * prompt)
 {
-	/* print the frame */
-	int row;
+	/* make the frame and send what changed, then the prompt
+	 * on a blank line under it
+	 * whatever the caller printed goes first */
+	static char out[OUT_SZ];
+	int len;
 	
-	make_frame(hex_dec, last_instr);
+	make_frame(cpu, hex_dec, last_instr);
+	len = put_diff(out);
 	
-	for (row = 0; row < FRAME_ROWS; ++row)
-		printf("%s\n", frame[row]);
-
+	if (vt)
+		len += sprintf(out + len, ESC "[%d;1H" ESC "[K%.*s", FRAME_ROWS + 1,
+				FRAME_COLS, prompt);
+	else
+	{
+		disp_move_cursor_xy(FRAME_ROWS, 0);
+		len += sprintf(out + len, "%*s\r%.*s", FRAME_COLS, "", FRAME_COLS, prompt);
+	}
+	
+	out_write(out, len);
 	return;
 }
 
 void disp_move_cursor_xy(int row, int col)
 {
-	/* move the console cursor to row, col 
+	/* move the console cursor to row, col
 	 * 2nd of 2 system specific functions */
 #ifdef WINDOWS
 	HANDLE h;
@@ -93,12 +218,16 @@ void disp_move_cursor_xy(int row, int col)
 #endif
 }
 
-static void make_frame(int hex_dec, int last_instr)
+static void make_frame(const jcpu * cpu, int hex_dec, int last_instr)
 {
 	/* assemble the frame */
-	do_ram(hex_dec);
-	do_code(last_instr);
-	do_regs(hex_dec);
+	const byte * regs = cpu->regs;
+	
+	do_ram(cpu, hex_dec);
+	do_code(cpu, last_instr);
+	do_regs(cpu, hex_dec);
+	do_hist(cpu, hex_dec);
+	do_status(cpu);
 	
 	int row = regs[MAR] >> 4;
 	int col = regs[MAR] & 0x0F;
@@ -115,47 +244,58 @@ static void make_frame(int hex_dec, int last_instr)
 	return;
 }
 
-static void do_ram(int hex_dec)
+static void do_ram(const jcpu * cpu, int hex_dec)
 {
 	/* place ram values in the frame */
 	int i;
-	char * pf;
-	static char * ram_base[] = {" %02X ", " %-3d"};
 	
-	for (i = 0; i < RAM_S; ++i, pf += BYTE_CELL)
+	for (i = 0; i < RAM_S; ++i)
 	{
-		if ((i % 16) == 0)
-			pf = &frame[i/16+RAM_LINE][BYTE_CELL-1];
-		
-		sprintf(pf, ram_base[hex_dec], ram[i]);
+		memcpy(&frame[RAM_LINE + i / 16][RAM_COL + (i % 16) * BYTE_CELL],
+				ram_cell[hex_dec][cpu->ram[i]], BYTE_CELL);
 	}
-		
+	
 	return;
 }
 
-static void do_code(int last_instr)
+static void do_code(const jcpu * cpu, int last_instr)
 {
 	/* print the last executed instruction
 	 * place INSTR_NUM instructions in the frame */
-	static char * last = NULL;
+	static bool shown_once = false;
+	const byte * regs = cpu->regs;
+	char last[DIS_COLS];
+	int len;
 	
-	if (last != NULL && last_instr != regs[IAR])
-	{
-		last[strchr(last, '<') - last] = '\0';
-		sprintf(&frame[CODE_LINE - 1][0], "%s %8s", disasm_str[last_instr], " ");
-	}
+	dis_update(cpu);
 	
 	// blank out last instruction line on reset
+	// it may have been jumped in the middle of, so it's disassembled here
 	if (-1 == last_instr)
-		sprintf(&frame[CODE_LINE - 1][0], "%28s", " ");
+		put_str(CODE_LINE - 1, 0, "", HIST_COL);
+	else if (shown_once && last_instr != regs[IAR])
+	{
+		len = sprintf(last, "%02X> ", last_instr);
+		disasm_instr_sym(cpu->ram, RAM_S, last_instr, NO_PREF, dis_syms, last + len,
+				sizeof(last) - len);
+		put_str(CODE_LINE - 1, 0, last, HIST_COL);
+	}
 	
 	int row, nuls;
 	for (row = nuls = 0; row < INSTR_NUM; ++row)
-	{	
-		if (disasm_str[regs[IAR] + row + nuls] != NULL)
+	{
+		const char * instr = disasm_str[regs[IAR] + row + nuls];
+		
+		if (instr != NULL)
 		{
-			sprintf(&frame[CODE_LINE + row][0], "%-23s %s %8s", 
-					disasm_str[regs[IAR] + row + nuls], (row == 0) ? "<--" : " ", " ");
+			// a long label pushes the arrow right, up to the history
+			put_str(CODE_LINE + row, 0, instr, HIST_COL);
+			if (0 == row)
+			{
+				len = strlen(instr) + 1;
+				len = (len < INSTR_COL) ? INSTR_COL : len;
+				put_str(CODE_LINE, (len < HIST_COL - 4) ? len : HIST_COL - 4, "<--", 0);
+			}
 		}
 		else
 		{
@@ -163,52 +303,248 @@ static void do_code(int last_instr)
 			++nuls;
 		}
 	}
+	
+	shown_once = true;
+	
+	return;
+}
+
+static void dis_update(const jcpu * cpu)
+{
+	/* disassemble again what changed since the last frame
+	 * and from IAR if it points in the middle of an instruction */
+	int i;
+	
+	if (cpu->digest != dis_digest)
+	{
+		for (i = 0; i < RAM_S; ++i)
+		{
+			if (cpu->ram[i] == dis_ram[i])
+				continue;
 			
-	last = &frame[CODE_LINE][0];
+			// a byte where no instruction starts is the second of the one before it
+			i = dis_from(cpu->ram, (i > 0 && NULL == disasm_str[i]) ? i - 1 : i, i) - 1;
+		}
+		
+		memcpy(dis_ram, cpu->ram, RAM_S);
+		dis_digest = cpu->digest;
+	}
+	
+	if (NULL == disasm_str[cpu->regs[IAR]])
+		dis_from(cpu->ram, cpu->regs[IAR], cpu->regs[IAR]);
 	
 	return;
 }
 
-static void do_regs(int hex_dec)
+static int dis_from(const byte * ram, int addr, int upto)
 {
-	/* place the register values in the frame */
-	static char * regs_str[] = 	{
-		"MAR", "IAR", "IR", " ", 
-		"C", "A", "E", "Z", " ", 
-		"R0", "R1", "R2", "R3"	
-	};
+	/* disassemble from addr past upto, until an instruction
+	 * starts where one started before
+	 * return the address after the last one done */
+	int len;
+	
+	do
+	{
+		len = sprintf(dis_txt[addr], "%02X> ", addr);
+		len = disasm_instr_sym(ram, RAM_S, addr, NO_PREF, dis_syms, dis_txt[addr] + len,
+				DIS_COLS - len);
+		disasm_str[addr] = dis_txt[addr];
 		
-	static char * reg_base[] =  {
-		"%s %c%-3s %02X ", 
-		"%s %c%-3s %-3d"
+		if (2 == len && addr + 1 < RAM_S)
+			disasm_str[addr + 1] = NULL;
+		addr += len;
+	} while (addr < RAM_S && (addr <= upto || NULL == disasm_str[addr]));
+	
+	return addr;
+}
+
+static void do_regs(const jcpu * cpu, int hex_dec)
+{
+	/* place the register values in the frame */
+	static const char * regs_str[] = 	{
+		" *MAR ", " @IAR ", "  IR  ", NULL,
+		"  C   ", "  A   ", "  E   ", "  Z   ", NULL,
+		"  R0  ", "  R1  ", "  R2  ", "  R3  "
 	};
 	
-	int i, j;
+	const byte * regs = cpu->regs;
 	char * cp;
+	int i, j;
 	
 	// NUM_REGS + 2 empty lines
 	for (i = j = 0; i < NUM_REGS + 2; ++i)
 	{
-		cp = &frame[REG_LINE+i][0];
-		switch (i)
+		// skip the empty lines
+		if (NULL == regs_str[i])
+			continue;
+		
+		cp = &frame[REG_LINE + i][REG_COL];
+		memcpy(cp, regs_str[i], REG_NAME);
+		memcpy(cp + REG_NAME, reg_cell[hex_dec][regs[j++]], REG_VAL);
+	}
+	
+	// the bus and the alu registers under the others; only the stepper uses them
+	if (cpu->stepper)
+	{
+		cp = &frame[REG_LINE + i][REG_COL];
+		memcpy(cp, "  BUS ", REG_NAME);
+		memcpy(cp + REG_NAME, reg_cell[hex_dec][cpu->bus], REG_VAL);
+		cp = &frame[REG_LINE + i + 1][REG_COL];
+		memcpy(cp, "  TMP ", REG_NAME);
+		memcpy(cp + REG_NAME, reg_cell[hex_dec][cpu->tmp], REG_VAL);
+		cp = &frame[REG_LINE + i + 2][REG_COL];
+		memcpy(cp, "  ACC ", REG_NAME);
+		memcpy(cp + REG_NAME, reg_cell[hex_dec][cpu->acc], REG_VAL);
+	}
+	
+	return;
+}
+
+static void do_status(const jcpu * cpu)
+{
+	/* place the counters and the rate in the frame */
+	char line[FRAME_COLS + 1];
+	int len;
+	
+	if (cpu->stepper)
+		len = snprintf(line, sizeof(line), "stepper: step %d, %lu cycles, %lu instructions",
+				cpu->step, cpu->cycles, cpu->icount);
+	else
+		len = snprintf(line, sizeof(line), "%lu instructions", cpu->icount);
+	
+	// a slow run reads better in instructions a second
+	if (mips >= 0.01 && len < (int)sizeof(line))
+		snprintf(line + len, sizeof(line) - len, ", %.2f MIPS", mips);
+	else if (mips >= 0 && len < (int)sizeof(line))
+		snprintf(line + len, sizeof(line) - len, ", %.0f ips", mips * 1e6);
+	
+	put_str(STEP_LINE, 0, line, FRAME_COLS);
+	return;
+}
+
+static void do_hist(const jcpu * cpu, int hex_dec)
+{
+	/* place the history, newest at the bottom, in the frame
+	 * the slot past the newest is being written, so it's not shown */
+	static const int show[] = {R0, R1, R2, R3, CF, AF, EF, ZF};
+	static const char * names[] = {"R0", "R1", "R2", "R3", "C", "A", "E", "Z"};
+	static const char * fmt[] = {" %s %02X>%02X", " %s %d>%d"};
+	unsigned long has = (hist_count < EMU_HIST - 1) ? hist_count : EMU_HIST - 1;
+	unsigned long back, e;
+	const byte * after;
+	char line[FRAME_COLS + 1], dis[DIS_COLS];
+	int row, len, i;
+	
+	for (row = 0; row < DISP_HIST; ++row)
+	{
+		back = hist_back + DISP_HIST - 1 - row;
+		if (NULL == hist || back >= has)
+		{
+			put_str(HIST_LINE + row, HIST_COL, "", HIST_W);
+			continue;
+		}
+		
+		// the registers after an instruction are the ones before the next
+		e = hist_count - 1 - back;
+		after = (0 == back) ? cpu->regs : hist[(e + 1) & (EMU_HIST - 1)].regs;
+		const emu_hist * h = &hist[e & (EMU_HIST - 1)];
+		
+		disasm_instr_sym(h->code, sizeof(h->code), 0, NO_PREF, dis_syms, dis, sizeof(dis));
+		len = snprintf(line, sizeof(line), "-%-3lu %02X> %-14.14s", back + 1, h->addr,
+				dis + HIST_SKIP);
+		
+		for (i = 0; i < (int)(sizeof(show) / sizeof(*show)) && len < (int)sizeof(line); ++i)
+		{
+			if (h->regs[show[i]] != after[show[i]])
+				len += snprintf(line + len, sizeof(line) - len, fmt[hex_dec], names[i],
+						h->regs[show[i]], after[show[i]]);
+		}
+		
+		put_str(HIST_LINE + row, HIST_COL, line, HIST_W);
+	}
+	
+	return;
+}
+
+static void put_str(int row, int col, const char * str, int width)
+{
+	/* copy str in the frame at row, col, padded with
+	 * spaces to width; cut at the end of the row */
+	int i;
+	
+	for (i = 0; col + i < FRAME_COLS && str[i] != '\0'; ++i)
+		frame[row][col + i] = str[i];
+	
+	for ( ; col + i < FRAME_COLS && i < width; ++i)
+		frame[row][col + i] = ' ';
+	
+	return;
+}
+
+static int put_diff(char * out)
+{
+	/* put a cursor move and the cells in out for every run of cells
+	 * which differ from what's shown, and mark them shown
+	 * runs with only a few same cells in between are one run
+	 * without escape sequences move the cursor and write every run here
+	 * return the length of out */
+	int row, col, end, next, len = 0;
+	
+	for (row = 0; row < FRAME_ROWS; ++row)
+	{
+		if (memcmp(frame[row], shown[row], FRAME_COLS) == 0)
+			continue;
+		
+		for (col = 0; col < FRAME_COLS; col = end)
 		{
-			// mark MAR 
-			case 0:
-				sprintf(cp, reg_base[hex_dec], cp, MARK_MAR, regs_str[i], regs[j++]);
-				break;
-			// mark IAR
-			case 1:
-				sprintf(cp, reg_base[hex_dec], cp, MARK_IAR, regs_str[i], regs[j++]);
-				break;
-			// skip the empty lines
-			case 3:
-			case 8:
-				break;
-			default:
-				sprintf(cp, reg_base[hex_dec], cp, ' ', regs_str[i], regs[j++]);
-				break;
+			if (frame[row][col] == shown[row][col])
+			{
+				end = col + 1;
+				continue;
+			}
+			
+			// stretch the run while the next change is near
+			for (end = next = col + 1; next < FRAME_COLS && next - end < RUN_GAP; ++next)
+			{
+				if (frame[row][next] != shown[row][next])
+					end = next + 1;
+			}
+			
+			if (vt)
+			{
+				// the terminal counts from 1
+				len += sprintf(out + len, ESC "[%d;%dH", row + 1, col + 1);
+				memcpy(out + len, &frame[row][col], end - col);
+				len += end - col;
+			}
+			else
+			{
+				disp_move_cursor_xy(row, col);
+				out_write(&frame[row][col], end - col);
+			}
+			memcpy(&shown[row][col], &frame[row][col], end - col);
 		}
 	}
 	
+	return len;
+}
+
+static void out_write(const char * out, int len)
+{
+	/* send out to the terminal in one write
+	 * after whatever is buffered in stdout */
+	fflush(stdout);
+#ifdef WINDOWS
+	fwrite(out, 1, len, stdout);
+	fflush(stdout);
+#else
+	int n;
+	
+	while (len > 0 && (n = write(STDOUT_FILENO, out, len)) > 0)
+	{
+		out += n;
+		len -= n;
+	}
+#endif
 	return;
 }
@@ -1,32 +1,64 @@
 /* display.h -- the display module public interface */
-/* ver. 1.03 */
+/* ver. 1.08 */
 #ifndef DISPLAY_H
 #define DISPLAY_H
 
+#include "jcpu.h"
+#include "emu.h"
+
 #define FRAME_ROWS 24	// 24 lines
 #define FRAME_COLS 79	// 79 characters in each line
+#define DISP_HIST 5		// instructions the history pane shows at once
 
 void disp_clear(void);
 /* returns: Nothing.
  * 
- * description: Clears the console screen. */
+ * description: Clears the console screen. The next disp_print() draws
+ * the whole frame. Call it before the first disp_print(); on Windows it
+ * also finds out if the console takes escape sequences. */
 
-void disp_init_frame(void);
+void disp_set_syms(char * const * syms);
+/* returns: Nothing.
+ * 
+ * description: Makes the disassembly show the labels of syms, a symbol map
+ * as disasm_read_syms() reads it, or none if NULL. Call it before
+ * disp_init_frame(); syms has to outlive the display. */
+
+void disp_init_frame(const jcpu * cpu);
 /* returns: Nothing.
  * 
  * description: Initializes the frame buffer, filling in constant
- * information. */
+ * information. The ram of cpu is disassembled. */
 
 
 enum {HEX_DSP, DEC_DSP};
 /* enum constants for base conversion */
 
-void disp_print(int hex_dec, int last_instr);
+void disp_print(const jcpu * cpu, int hex_dec, int last_instr, const char * prompt);
 /* returns: Nothing.
  * 
- * description: Prints the current state of the jcpu. hex_dec specifies if
+ * description: Prints the current state of cpu. hex_dec specifies if
  * the ram and the registers should be printed in hex or in decimal. last_instr
- * is the value of the IAR register from the previous cpu step. */
+ * is the value of the IAR register from the previous cpu step. Only what
+ * changed since the last frame is sent to the terminal, in one write with
+ * prompt, which goes on a blank line under the frame; the cursor is left
+ * after it. */
+
+void disp_hist(const emu_hist * ring, unsigned long count, int back);
+/* returns: Nothing.
+ * 
+ * description: Makes the next disp_print() calls show the history ring
+ * of an emu_view, count being its hcount, in a pane of DISP_HIST
+ * instructions. The newest is at the bottom, unless back says how many
+ * of the newest to leave out. Each comes with the registers and flags
+ * it changed. ring has to stay put until the next call. */
+
+void disp_rate(double rate);
+/* returns: Nothing.
+ * 
+ * description: Makes the next disp_print() calls show rate, in millions
+ * of instructions a second, after the counters of the core. Nothing is
+ * shown for a negative rate. */
 
 void disp_move_cursor_xy(int row, int col);
 /* returns: Nothing.
@@ -0,0 +1,390 @@
+/* emu.c -- runs the core of the jcpvm on a thread of its own */
+/* ver. 1.03 */
+
+/* The interface of the jcpvm and the core it shows don't wait for each
+ * other. The interface puts commands in a single producer, single consumer
+ * ring, and the thread takes them between slices of execution. After
+ * every command and every slice the thread publishes the core and the ram
+ * under a sequence lock: the sequence is odd while it writes, so a reader
+ * which sees it change copies again. Neither side ever takes a lock.
+ * Every instruction is put in a ring of the last ones before it executes.
+ * The slot is always written and the count moves only at the start of an
+ * instruction, so there is no branch; the slot past the newest is the one
+ * being written and isn't history yet. The counters of a run are added
+ * to once a slice, not once an instruction. */
+
+/* Author: Vladimir Dinev */
+#include "os_def.h"
+#include <string.h>
+#include <time.h>
+#ifdef WINDOWS
+#define yield()		SwitchToThread()
+#else
+#include <sched.h>
+#define yield()		sched_yield()
+#endif
+#include "emu.h"
+
+#define SLICE		1024	// instructions between looks at the queue while running
+#define IDLE_NS		1000000	// how long the thread naps with nothing to do
+#define ld_acq(p)	__atomic_load_n((p), __ATOMIC_ACQUIRE)
+#define ld_rlx(p)	__atomic_load_n((p), __ATOMIC_RELAXED)
+#define st_rel(p,v)	__atomic_store_n((p), (v), __ATOMIC_RELEASE)
+#define st_rlx(p,v)	__atomic_store_n((p), (v), __ATOMIC_RELAXED)
+
+static void do_cmd(emu * em, const emu_cmd * cmd);
+static void run_slice(emu * em);
+static bool step_cpu(emu * em);
+static void record(emu * em);
+static void load(emu * em, bool keep);
+static void publish(emu * em);
+static void nap(void);
+static double now(void);
+
+#ifdef WINDOWS
+static DWORD WINAPI emu_thread(LPVOID arg)
+#else
+static void * emu_thread(void * arg)
+#endif
+{
+	/* take commands, run when told to, publish the state */
+	emu * em = arg;
+	unsigned long head;
+	
+	while (true)
+	{
+		head = ld_rlx(&em->head);
+		if (head != ld_acq(&em->tail))
+		{
+			emu_cmd * cmd = &em->cmds[head & (EMU_QUEUE - 1)];
+			
+			if (EMU_QUIT == cmd->op)
+				break;
+			
+			do_cmd(em, cmd);
+			publish(em);
+			st_rel(&em->head, head + 1);
+		}
+		else if (em->running)
+			run_slice(em);
+		else
+			nap();
+	}
+	
+	st_rel(&em->head, head + 1);
+	return 0;
+}
+
+/* -------------------- PUBLIC INTERFACE START -------------------- */
+int emu_start(emu * em, jcpu * cpu, int last_inst)
+{
+	/* set em up and start its thread */
+	memset(em, 0, sizeof(*em));
+	em->cpu = cpu;
+	em->last_inst = last_inst;
+	em->at = now();
+	publish(em);
+
+#ifdef WINDOWS
+	if ((em->thrd = CreateThread(NULL, 0, emu_thread, em, 0, NULL)) == NULL)
+		return -1;
+#else
+	if (pthread_create(&em->thrd, NULL, emu_thread, em) != 0)
+		return -1;
+#endif
+	return 0;
+}
+
+unsigned long emu_send(emu * em, int op, unsigned long arg)
+{
+	/* put a command in the queue; wait for room if it's full */
+	unsigned long tail = ld_rlx(&em->tail);
+	
+	while (tail - ld_acq(&em->head) >= EMU_QUEUE)
+		yield();
+	
+	em->cmds[tail & (EMU_QUEUE - 1)].op = op;
+	em->cmds[tail & (EMU_QUEUE - 1)].arg = arg;
+	st_rel(&em->tail, tail + 1);
+	return tail + 1;
+}
+
+unsigned long emu_load(emu * em, const byte * code, int size, bool keep)
+{
+	/* the thread may still read the last program until
+	 * the commands before are done */
+	emu_wait(em, ld_rlx(&em->tail));
+	
+	if (size > RAM_S)
+		size = RAM_S;
+	memcpy(em->code, code, size);
+	em->csize = size;
+	return emu_send(em, EMU_LOAD, keep);
+}
+
+void emu_wait(emu * em, unsigned long cmd)
+{
+	/* wait for the thread to get through cmd */
+	while (ld_acq(&em->head) < cmd)
+		yield();
+	return;
+}
+
+void emu_look(emu * em, emu_view * view)
+{
+	/* copy the view until the sequence is even and the same
+	 * before and after */
+	unsigned long seq;
+	
+	while (true)
+	{
+		if ((seq = ld_acq(&em->seq)) & 1)
+		{
+			yield();
+			continue;
+		}
+		
+		memcpy(view, &em->view, sizeof(*view));
+		__atomic_thread_fence(__ATOMIC_ACQUIRE);
+		
+		if (ld_rlx(&em->seq) == seq)
+			break;
+	}
+	
+	view->cpu.ram = view->ram;
+	return;
+}
+
+void emu_quit(emu * em)
+{
+	/* stop the thread and wait for it */
+	emu_wait(em, emu_send(em, EMU_QUIT, 0));
+#ifdef WINDOWS
+	WaitForSingleObject(em->thrd, INFINITE);
+	CloseHandle(em->thrd);
+#else
+	pthread_join(em->thrd, NULL);
+#endif
+	return;
+}
+/* -------------------- PUBLIC INTERFACE END -------------------- */
+
+static void do_cmd(emu * em, const emu_cmd * cmd)
+{
+	/* carry out cmd */
+	jcpu * cpu = em->cpu;
+	unsigned long n;
+	
+	switch (cmd->op)
+	{
+		case EMU_STEP:
+			for (n = 0; n < cmd->arg; ++n)
+			{
+				if (step_cpu(em))
+					break;
+			}
+			break;
+		case EMU_TICK:
+			if (1 == cpu->step)
+				em->last_inst = cpu->regs[IAR];
+			record(em);
+			jcpu_tick(cpu);
+			break;
+		case EMU_RESET:
+			jcpu_reset(cpu);
+			em->last_inst = -1;
+			em->running = false;
+			em->hcount = 0;
+			break;
+		case EMU_RUN:
+		case EMU_UNTIL:
+			em->running = !jcpu_halted(cpu);
+			em->stop = (em->running) ? EMU_NONE : EMU_HALT;
+			em->ips = (EMU_RUN == cmd->op) ? cmd->arg : 0;
+			em->until = (EMU_UNTIL == cmd->op) ? cmd->arg : 0;
+			em->start = now();
+			em->at = em->start;
+			em->count = 0;
+			break;
+		case EMU_PAUSE:
+			if (em->running)
+			{
+				em->running = false;
+				em->stop = EMU_STOP;
+			}
+			break;
+		case EMU_BREAK:
+			em->brk[cmd->arg % RAM_S] = !em->brk[cmd->arg % RAM_S];
+			break;
+		case EMU_LOAD:
+			load(em, cmd->arg);
+			break;
+		default:
+			break;
+	}
+	
+	return;
+}
+
+static void load(emu * em, bool keep)
+{
+	/* put the new program in place of the old
+	 * poke back the data past it if it's kept, so a reset
+	 * knows those lines changed */
+	jcpu * cpu = em->cpu;
+	unsigned long icount = cpu->icount;
+	byte data[RAM_S];
+	int i;
+	
+	memcpy(data, cpu->ram, RAM_S);
+	jcpu_load(cpu, em->code, em->csize);
+	
+	if (keep)
+	{
+		for (i = em->csize; i < RAM_S; ++i)
+		{
+			if (data[i] != cpu->ram[i])
+				jcpu_poke(cpu, i, data[i]);
+		}
+		cpu->icount = icount;
+	}
+	else
+		jcpu_reset(cpu);
+	
+	em->last_inst = -1;
+	em->running = false;
+	em->hcount = 0;
+	return;
+}
+
+static void run_slice(emu * em)
+{
+	/* run up to SLICE instructions, no more than are due
+	 * stop at a halt, at a breakpoint, or at the count to run until */
+	unsigned long n = SLICE, due, done;
+	
+	if (em->ips > 0)
+	{
+		due = (now() - em->start) * em->ips;
+		if (due <= em->count)
+		{
+			nap();
+			return;
+		}
+		
+		if (due - em->count < n)
+			n = due - em->count;
+	}
+	
+	for (done = 0; done < n; ++done)
+	{
+		if (jcpu_halted(em->cpu))
+		{
+			em->running = false;
+			em->stop = EMU_HALT;
+			break;
+		}
+		if (em->until > 0 && em->cpu->icount >= em->until)
+		{
+			em->running = false;
+			em->stop = EMU_STOP;
+			break;
+		}
+		if (step_cpu(em))
+		{
+			++done;
+			em->running = false;
+			em->stop = EMU_BRK;
+			break;
+		}
+	}
+	
+	em->count += done;
+	em->done += done;
+	em->at = now();
+	publish(em);
+	return;
+}
+
+static bool step_cpu(emu * em)
+{
+	/* execute an instruction the selected way
+	 * finish it if it was started with ticks
+	 * return true if the core got to a breakpoint */
+	jcpu * cpu = em->cpu;
+	
+	em->last_inst = (1 == cpu->step) ? cpu->regs[IAR] : em->last_inst;
+	record(em);
+	
+	if (cpu->stepper)
+		jcpu_step_ticks(cpu);
+	else
+		jcpu_step(cpu);
+	
+	return em->brk[cpu->regs[IAR]];
+}
+
+static void record(emu * em)
+{
+	/* put the instruction at IAR in the history; it counts
+	 * only if it's about to start, not if it's been ticked into */
+	jcpu * cpu = em->cpu;
+	emu_hist * h = &em->hist[em->hcount & (EMU_HIST - 1)];
+	byte iar = cpu->regs[IAR];
+	
+	h->addr = iar;
+	h->code[0] = cpu->ram[iar];
+	h->code[1] = cpu->ram[(byte)(iar + 1)];
+	memcpy(h->regs, cpu->regs, NUM_REGS);
+	em->hcount += (1 == cpu->step);
+	return;
+}
+
+static void publish(emu * em)
+{
+	/* copy the state in the view with the sequence odd */
+	unsigned long seq = ld_rlx(&em->seq);
+	emu_view * view = &em->view;
+	
+	st_rlx(&em->seq, seq + 1);
+	__atomic_thread_fence(__ATOMIC_RELEASE);
+	
+	memcpy(&view->cpu, em->cpu, sizeof(view->cpu));
+	memcpy(view->ram, em->cpu->ram, RAM_S);
+	view->last_inst = em->last_inst;
+	view->running = em->running;
+	view->stop = em->stop;
+	memcpy(view->hist, em->hist, sizeof(view->hist));
+	view->hcount = em->hcount;
+	view->done = em->done;
+	view->at = em->at;
+	
+	st_rel(&em->seq, seq + 2);
+	return;
+}
+
+static void nap(void)
+{
+	/* let the host have the core for a while */
+#ifdef WINDOWS
+	Sleep(IDLE_NS / 1000000);
+#else
+	struct timespec ts = {0, IDLE_NS};
+	
+	nanosleep(&ts, NULL);
+#endif
+	return;
+}
+
+static double now(void)
+{
+	/* wall clock seconds for pacing the run */
+#ifdef WINDOWS
+	return GetTickCount() / 1000.0;
+#else
+	struct timespec ts;
+	
+	clock_gettime(CLOCK_MONOTONIC, &ts);
+	return ts.tv_sec + ts.tv_nsec / 1e9;
+#endif
+}
@@ -0,0 +1,124 @@
+/* emu.h -- the emu module public interface */
+/* ver. 1.03 */
+#ifndef EMU_H
+#define EMU_H
+
+#include "os_def.h"
+#include <stdbool.h>
+#ifndef WINDOWS
+#include <pthread.h>
+#endif
+#include "jcpu.h"
+
+#define EMU_QUEUE	64		// commands which fit in the queue; a power of two
+#define EMU_HIST	64		// instructions the history keeps, one of them being written; a power of two
+
+enum {EMU_STEP, EMU_TICK, EMU_RESET, EMU_RUN, EMU_UNTIL, EMU_PAUSE, EMU_BREAK, EMU_LOAD,
+	EMU_QUIT};
+/* enum constants for the commands */
+
+enum {EMU_NONE, EMU_HALT, EMU_BRK, EMU_STOP};
+/* enum constants for why the last run stopped */
+
+// an executed instruction and the registers before it
+typedef struct emu_hist_ {
+	byte addr;				// where it was
+	byte code[2];			// what it was; the code may change later
+	byte regs[NUM_REGS];	// the registers before it
+} emu_hist;
+
+// what the interface sees of the core; always one consistent moment
+typedef struct emu_view_ {
+	jcpu cpu;				// the core; its ram pointer points to ram below
+	byte ram[RAM_S];		// the ram
+	int last_inst;			// IAR of the last executed instruction, -1 after a reset
+	bool running;			// it runs on its own
+	int stop;				// why the last run stopped
+	emu_hist hist[EMU_HIST];	// the last instructions, a ring
+	unsigned long hcount;	// instructions put in hist since the last reset
+	unsigned long done;		// instructions run on its own since the start
+	double at;				// when done was last added to or a run started, in seconds
+} emu_view;
+
+typedef struct emu_cmd_ {
+	int op;					// what to do
+	unsigned long arg;		// how many, how fast, or where
+} emu_cmd;
+
+// the emulation thread and the ways to and from it
+typedef struct emu_ {
+	jcpu * cpu;					// the core; only the thread touches it while it runs
+	int last_inst;				// IAR of the last executed instruction
+	bool brk[RAM_S];			// the breakpoints
+	byte code[RAM_S];			// the program for EMU_LOAD
+	int csize;					// and its size
+	emu_hist hist[EMU_HIST];	// the last instructions, a ring
+	unsigned long hcount;		// instructions put in hist since the last reset
+	emu_cmd cmds[EMU_QUEUE];	// the command queue
+	unsigned long head;			// commands done; only the thread moves it
+	unsigned long tail;			// commands put; only the interface moves it
+	bool running;				// runs on its own
+	int stop;					// why the last run stopped
+	unsigned long ips;			// instructions a second while running; 0 is no limit
+	unsigned long until;		// the instruction count the run stops at; 0 is none
+	double start;				// when the run started
+	unsigned long count;		// instructions since the run started
+	unsigned long done;			// instructions run on its own since the start
+	double at;					// when done was last added to or a run started
+	unsigned long seq;			// odd while view is being written
+	emu_view view;				// the last published state
+#ifdef WINDOWS
+	HANDLE thrd;				// the thread
+#else
+	pthread_t thrd;				// the thread
+#endif
+} emu;
+
+int emu_start(emu * em, jcpu * cpu, int last_inst);
+/* returns: 0 on success, -1 if the thread could not be started.
+ *
+ * description: Starts a thread which owns cpu until emu_quit() and runs
+ * the commands em gets. last_inst is shown as the last executed
+ * instruction until the first one. */
+
+unsigned long emu_send(emu * em, int op, unsigned long arg);
+/* returns: The number of the command, for emu_wait().
+ *
+ * description: Puts a command in the queue without taking a lock. Waits
+ * only if the queue is full. EMU_STEP executes arg instructions, stopping
+ * at a breakpoint. EMU_TICK runs one clock cycle. EMU_RESET resets the core.
+ * EMU_RUN runs it on its own, arg instructions a second or as fast as it
+ * goes if 0, until it halts, gets to a breakpoint, or gets EMU_PAUSE.
+ * EMU_UNTIL runs it the same way as fast as it goes, and also stops once
+ * the core's instruction count gets to arg.
+ * Every instruction executed goes in the history, which EMU_RESET empties.
+ * EMU_BREAK sets a breakpoint at address arg, or clears the one there. */
+
+unsigned long emu_load(emu * em, const byte * code, int size, bool keep);
+/* returns: The number of the command, for emu_wait().
+ *
+ * description: Waits for the commands before it, then has the thread load
+ * the size bytes of code, as jcpu_load() would, in place of the program.
+ * The core is reset, unless keep is true; then the registers, the counters,
+ * and the ram past the code are kept. Either way the run stops, the
+ * history is emptied, and a reset goes back to the new program. */
+
+void emu_wait(emu * em, unsigned long cmd);
+/* returns: Nothing.
+ *
+ * description: Waits until command number cmd is done. */
+
+void emu_look(emu * em, emu_view * view);
+/* returns: Nothing.
+ *
+ * description: Copies the last state the thread published in view. The
+ * thread never waits for this. view->cpu.ram points to view->ram.
+ * view->done only moves once a slice of a run, so the instructions a
+ * second are the change in it over the change in view->at. */
+
+void emu_quit(emu * em);
+/* returns: Nothing.
+ *
+ * description: Stops the thread and waits for it. The core is the
+ * caller's again. */
+#endif
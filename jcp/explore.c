@@ -0,0 +1,383 @@
+/* explore.c -- runs a program on every value of its inputs */
+/* ver. 1.01 */
+
+/* Every input value gets a machine and all of them go in lockstep, a
+ * slice of instructions at a time. After each slice every machine still
+ * running is looked up by its state in a hash table. If another machine is
+ * already there, the two are the same from here on, so the later one is
+ * retired and only remembers which machine it joined. Programs which read
+ * their input and then overwrite it, or drop the bits that don't matter,
+ * end up running as only a handful of machines. */
+
+/* Author: Vladimir Dinev */
+#include "os_def.h"
+#include <stdlib.h>
+#include <string.h>
+#include <limits.h>
+#include <stdint.h>
+#ifndef WINDOWS
+#include <pthread.h>
+#endif
+#include "explore.h"
+#include "adt/chtbl.h"
+
+#define MACHS_PER_THRD	256		// fewer running machines than this share a thread
+#define MERGE_FEW		8		// a slice is few if less than 1 in this many merge
+
+typedef struct mach_ {
+	jcpu cpu;				// the machine
+	byte ram[RAM_S];		// its ram
+	int hash;				// of its state after the last slice
+	long rep;				// the machine it joined, or its own number
+} mach;
+
+typedef struct slice_ {
+	mach * ms;				// all machines
+	const long * live;		// the ones still running
+	long from, to;			// which of them are in this slice
+	unsigned long steps;	// the most instructions a machine takes
+	unsigned long len;		// instructions in this slice
+	unsigned long run;		// instructions executed in this slice
+} slice;
+
+static void run_slices(mach * ms, const long * live, long nlive, int nthreads,
+		unsigned long steps, unsigned long len, unsigned long * run);
+static int hash_of(const void * key);
+static int hash_state(const jcpu * cpu);
+static int compar_state(const void * key1, const void * key2);
+static int hash_final(const jcpu * cpu);
+static int compar_final(const void * key1, const void * key2);
+static uint64_t mix(uint64_t h, const byte * data, int len);
+
+/* -------------------- PUBLIC INTERFACE START -------------------- */
+int expl_run(const byte * code, int csize, const unsigned short * where, int nwhere,
+		int nthreads, unsigned long steps, expl_res * res)
+{
+	/* load a machine for every input value
+	 * run slices and merge the same states until all are done
+	 * find the machine each input value ended up in and group the outcomes */
+	mach * ms, * m;
+	long * live, * oid, nlive, n, i, k;
+	int w, ret = -1;
+	unsigned long len;
+	void * p;
+	CHTbl tbl;
+	
+	memset(res, 0, sizeof(*res));
+	res->ninputs = 1L << (8 * nwhere);
+	
+	ms = calloc(res->ninputs, sizeof(*ms));
+	live = malloc(res->ninputs * sizeof(*live));
+	oid = malloc(res->ninputs * sizeof(*oid));
+	res->outcome = malloc(res->ninputs * sizeof(*res->outcome));
+	res->icount = malloc(res->ninputs * sizeof(*res->icount));
+	res->count = calloc(res->ninputs, sizeof(*res->count));
+	if (NULL == ms || NULL == live || NULL == oid || NULL == res->outcome ||
+		NULL == res->icount || NULL == res->count)
+		goto cleanup;
+	
+	// the machines are copies of the first one, with their input values
+	jcpu_init(&ms[0].cpu, ms[0].ram, 0);
+	jcpu_load(&ms[0].cpu, code, csize);
+	for (i = 0; i < res->ninputs; ++i)
+	{
+		m = &ms[i];
+		*m = ms[0];
+		m->cpu.ram = m->ram;
+		m->rep = live[i] = i;
+		
+		for (w = 0; w < nwhere; ++w)
+		{
+			k = (i >> (8 * (nwhere - 1 - w))) & 0xFF;
+			if (where[w] < RAM_S)
+				jcpu_poke(&m->cpu, where[w], k);
+			else
+				m->cpu.regs[where[w] - RAM_S] = k;
+		}
+	}
+	
+	// a slice starts short and grows while few machines merge
+	for (nlive = res->ninputs, len = 1; nlive > 0; nlive = n)
+	{
+		run_slices(ms, live, nlive, nthreads, steps, len, &res->run);
+		
+		if (chtbl_init(&tbl, nlive, hash_of, compar_state, NULL) != 0)
+			goto cleanup;
+		
+		for (n = i = 0; i < nlive; ++i)
+		{
+			m = &ms[live[i]];
+			if (jcpu_halted(&m->cpu) || m->cpu.icount >= steps)
+				continue;
+			
+			if ((w = chtbl_insert(&tbl, m)) == 0)
+				live[n++] = live[i];
+			else if (CHTBL_ELMT_EXISTS == w && chtbl_lookup(&tbl, (p = m, &p)) == 0)
+			{
+				m->rep = *(mach **)p - ms;
+				++res->merged;
+			}
+			else
+			{
+				chtbl_destroy(&tbl);
+				goto cleanup;
+			}
+		}
+		
+		chtbl_destroy(&tbl);
+		
+		if ((nlive - n) * MERGE_FEW < nlive)
+			len = (2 * len < EXPL_SLICE) ? 2 * len : EXPL_SLICE;
+		else
+			len = 1;
+	}
+	
+	// the machines joined at the same instruction, so they all take as long
+	if (chtbl_init(&tbl, res->ninputs, hash_of, compar_final, NULL) != 0)
+		goto cleanup;
+	
+	for (i = 0; i < res->ninputs; ++i)
+	{
+		for (k = i; ms[k].rep != k; k = ms[k].rep)
+			continue;
+		ms[i].rep = k;
+		
+		// done once for every machine which ran to the end
+		if (k == i)
+		{
+			ms[k].hash = hash_final(&ms[k].cpu);
+			if ((w = chtbl_insert(&tbl, &ms[k])) == 0)
+				oid[k] = res->nouts++;
+			else if (CHTBL_ELMT_EXISTS == w && chtbl_lookup(&tbl, (p = &ms[k], &p)) == 0)
+				oid[k] = oid[*(mach **)p - ms];
+			else
+			{
+				chtbl_destroy(&tbl);
+				goto cleanup;
+			}
+		}
+		
+		res->outcome[i] = oid[k];
+		res->icount[i] = ms[k].cpu.icount;
+		res->total += ms[k].cpu.icount;
+		++res->count[oid[k]];
+	}
+	
+	chtbl_destroy(&tbl);
+	
+	if ((res->outs = malloc(res->nouts * sizeof(*res->outs))) == NULL)
+		goto cleanup;
+	
+	for (i = 0, n = 0; n < res->nouts; ++i)
+	{
+		if (res->outcome[i] != n)
+			continue;
+		
+		m = &ms[ms[i].rep];
+		memcpy(res->outs[n].regs, m->cpu.regs, NUM_REGS);
+		memcpy(res->outs[n].ram, m->ram, RAM_S);
+		res->outs[n].icount = m->cpu.icount;
+		res->outs[n].digest = m->cpu.digest;
+		res->outs[n].state = jcpu_halted(&m->cpu) ? BATCH_HALTED : BATCH_STOPPED;
+		++n;
+	}
+	
+	ret = 0;
+
+cleanup:
+	free(ms);
+	free(live);
+	free(oid);
+	if (ret != 0)
+		expl_free(res);
+	return ret;
+}
+
+void expl_free(expl_res * res)
+{
+	/* free the arrays */
+	free(res->outcome);
+	free(res->icount);
+	free(res->outs);
+	free(res->count);
+	res->outcome = NULL;
+	res->icount = NULL;
+	res->outs = NULL;
+	res->count = NULL;
+	return;
+}
+/* -------------------- PUBLIC INTERFACE END -------------------- */
+
+#ifdef WINDOWS
+static DWORD WINAPI run_slice(LPVOID arg)
+#else
+static void * run_slice(void * arg)
+#endif
+{
+	/* run every machine of the slice for len instructions
+	 * and hash its state for the merging */
+	slice * sl = arg;
+	mach * m;
+	unsigned long n;
+	long i;
+	
+	for (i = sl->from; i < sl->to; ++i)
+	{
+		m = &sl->ms[sl->live[i]];
+		n = sl->steps - m->cpu.icount;
+		if (n > sl->len)
+			n = sl->len;
+		
+		for (; n > 0 && !jcpu_halted(&m->cpu); --n, ++sl->run)
+			jcpu_step(&m->cpu);
+		
+		m->hash = hash_state(&m->cpu);
+	}
+	
+	return 0;
+}
+
+static void run_slices(mach * ms, const long * live, long nlive, int nthreads,
+		unsigned long steps, unsigned long len, unsigned long * run)
+{
+	/* cut the running machines in one slice per thread
+	 * the calling thread takes the first one */
+	slice sl[EXPL_MAX_THRDS];
+	int i, started;
+#ifdef WINDOWS
+	HANDLE thrd[EXPL_MAX_THRDS];
+#else
+	pthread_t thrd[EXPL_MAX_THRDS];
+#endif
+
+	if (nthreads > (nlive + MACHS_PER_THRD - 1) / MACHS_PER_THRD)
+		nthreads = (nlive + MACHS_PER_THRD - 1) / MACHS_PER_THRD;
+	if (nthreads > EXPL_MAX_THRDS)
+		nthreads = EXPL_MAX_THRDS;
+	if (nthreads < 1)
+		nthreads = 1;
+	
+	for (i = 0; i < nthreads; ++i)
+	{
+		sl[i].ms = ms;
+		sl[i].live = live;
+		sl[i].from = nlive * i / nthreads;
+		sl[i].to = nlive * (i + 1) / nthreads;
+		sl[i].steps = steps;
+		sl[i].len = len;
+		sl[i].run = 0;
+	}
+	
+	for (started = 1; started < nthreads; ++started)
+	{
+#ifdef WINDOWS
+		if ((thrd[started] = CreateThread(NULL, 0, run_slice, &sl[started], 0, NULL)) == NULL)
+			break;
+#else
+		if (pthread_create(&thrd[started], NULL, run_slice, &sl[started]) != 0)
+			break;
+#endif
+	}
+	
+	// the slices of the threads which did not start are run here
+	for (i = started; i < nthreads; ++i)
+		run_slice(&sl[i]);
+	run_slice(&sl[0]);
+	
+	for (i = 1; i < started; ++i)
+	{
+#ifdef WINDOWS
+		WaitForSingleObject(thrd[i], INFINITE);
+		CloseHandle(thrd[i]);
+#else
+		pthread_join(thrd[i], NULL);
+#endif
+	}
+	
+	for (i = 0; i < nthreads; ++i)
+		*run += sl[i].run;
+	return;
+}
+
+static int hash_of(const void * key)
+{
+	/* the hash kept with the machine */
+	return ((const mach *)key)->hash;
+}
+
+static int hash_state(const jcpu * cpu)
+{
+	/* hash all of the state that decides what a machine does next
+	 * the counters are left out; running machines have the same ones
+	 * the ram is in the digest kept by the stores */
+	byte misc[10];
+	uint64_t h;
+	
+	misc[0] = cpu->io_sel;
+	misc[1] = cpu->ivec;
+	misc[2] = cpu->iiar;
+	misc[3] = cpu->iflags;
+	misc[4] = cpu->isel;
+	misc[5] = cpu->in_irq;
+	misc[6] = cpu->irq_pend;
+	misc[7] = cpu->tas_addr;
+	misc[8] = cpu->tmr_left;
+	misc[9] = cpu->tmr_period;
+	
+	h = mix(cpu->digest, cpu->regs, NUM_REGS);
+	h = mix(h, misc, sizeof(misc));
+	return (h >> 32) & INT_MAX;
+}
+
+static int compar_state(const void * key1, const void * key2)
+{
+	/* 0 if the two machines would do the same from here on */
+	const jcpu * a = &((const mach *)key1)->cpu;
+	const jcpu * b = &((const mach *)key2)->cpu;
+	
+	if (((const mach *)key1)->hash != ((const mach *)key2)->hash)
+		return 1;
+	
+	return !(memcmp(a->regs, b->regs, NUM_REGS) == 0 && memcmp(a->ram, b->ram, RAM_S) == 0 &&
+		a->tmr_left == b->tmr_left && a->tmr_period == b->tmr_period &&
+		a->io_sel == b->io_sel && a->ivec == b->ivec && a->iiar == b->iiar &&
+		a->iflags == b->iflags && a->isel == b->isel && a->in_irq == b->in_irq &&
+		a->irq_pend == b->irq_pend && a->tas_addr == b->tas_addr);
+}
+
+static int hash_final(const jcpu * cpu)
+{
+	/* hash the registers and the ram a machine ended with */
+	
+	return (mix(cpu->digest, cpu->regs, NUM_REGS) >> 32) & INT_MAX;
+}
+
+static int compar_final(const void * key1, const void * key2)
+{
+	/* 0 if the two machines ended with the same registers and ram */
+	const jcpu * a = &((const mach *)key1)->cpu;
+	const jcpu * b = &((const mach *)key2)->cpu;
+	
+	if (((const mach *)key1)->hash != ((const mach *)key2)->hash)
+		return 1;
+	
+	return !(memcmp(a->regs, b->regs, NUM_REGS) == 0 && memcmp(a->ram, b->ram, RAM_S) == 0);
+}
+
+static uint64_t mix(uint64_t h, const byte * data, int len)
+{
+	/* hash len bytes of data into h, eight at a time */
+	uint64_t w;
+	
+	for (; len >= 8; len -= 8, data += 8)
+	{
+		memcpy(&w, data, 8);
+		h = (h ^ w) * 0x9E3779B97F4A7C15ULL;
+		h ^= h >> 29;
+	}
+	
+	for (; len > 0; --len)
+		h = (h ^ *data++) * 0x100000001B3ULL;
+	
+	return h;
+}
@@ -0,0 +1,44 @@
+/* explore.h -- runs a program on every value of its inputs public interface */
+/* ver. 1.0 */
+#ifndef EXPLORE_H
+#define EXPLORE_H
+
+#include "jcpu.h"
+#include "batch.h"
+
+#define EXPL_MAX_INS	2		// the most input bytes; 65536 machines
+#define EXPL_SLICE		64		// the most instructions between looking for the same states
+#define EXPL_MAX_THRDS	BATCH_MAX_THRDS
+
+// what became of every input value
+typedef struct expl_res_ {
+	long ninputs;			// 256 to the power of the number of inputs
+	long * outcome;			// the outcome of every input value
+	unsigned long * icount;	// the instructions every input value took
+	batch_res * outs;		// the distinct outcomes, in the order first reached
+	long * count;			// how many input values end up in each
+	long nouts;				// how many distinct outcomes
+	unsigned long run;		// instructions actually executed
+	unsigned long total;	// instructions all input values took
+	long merged;			// machines which joined another one on the way
+} expl_res;
+
+int expl_run(const byte * code, int csize, const unsigned short * where, int nwhere,
+		int nthreads, unsigned long steps, expl_res * res);
+/* returns: 0 on success, -1 if there is no memory.
+ *
+ * description: Runs code once for every value of the nwhere input bytes at
+ * where, given like batch_poke.where. Input value n puts its highest byte in
+ * where[0]. All machines run a slice of instructions at a time on nthreads
+ * threads. After every slice, the machines with the same state are merged, so
+ * what is left of the run is done only once for all of them. A slice is one
+ * instruction while many machines merge and doubles up to EXPL_SLICE while few
+ * do. A machine is done when it halts or executes steps instructions. The
+ * outcomes of the input values are the registers and ram they end with; equal
+ * ones are counted once. */
+
+void expl_free(expl_res * res);
+/* returns: Nothing.
+ *
+ * description: Frees the arrays of res. */
+#endif
@@ -0,0 +1,391 @@
+/* gates.c -- the jcpu built from gates */
+/* ver. 1.0 */
+
+/* A gate level model of the computer from "But How Do It Know?" by John
+ * Clark Scott. The registers and the ram are memory bits made of NAND gates,
+ * the ALU is the book's adder, shifters, logic gates, and comparator, and
+ * the control unit wires the stepper and the instruction decoder to the
+ * enables and the sets. Everything is built from nand(), so it's slow by
+ * nature; but every wire is a 64 bit word with a bit for each of 64
+ * machines, so a single pass over the gates runs all of them.
+ * The stepper always goes through the book's six steps, so the machines
+ * never get out of step with each other. It runs what jcpu_step() runs,
+ * flags included. There are no devices on the I/O bus, so IN DATA reads 0 and
+ * OUT DATA goes nowhere, and there is no timer. */
+
+/* Author: Vladimir Dinev */
+#include <string.h>
+#include "gates.h"
+#include "mach_code.h"
+
+#define BITS		8				// wires in a byte
+#define STEPS		6				// steps of the stepper
+#define ALL			(~(lanes)0)		// a wire that is on for every machine
+#define lanes_if(c)	((c) ? ALL : 0)	// on for every machine if c, off otherwise
+
+static inline lanes nand(lanes a, lanes b) {return ~(a & b);}
+static inline lanes not(lanes a) {return nand(a, a);}
+static inline lanes and(lanes a, lanes b) {return not(nand(a, b));}
+static inline lanes or(lanes a, lanes b) {return nand(not(a), not(b));}
+static inline lanes xor(lanes a, lanes b)
+{
+	lanes n = nand(a, b);
+	return nand(nand(a, n), nand(b, n));
+}
+
+static lanes mem_bit(lanes o, lanes i, lanes s);
+static void reg_set(lanes * r, const lanes * in, lanes s);
+static void enable(lanes * bus, const lanes * r, lanes e);
+static void decoder2(lanes hi, lanes lo, lanes * out);
+static void decoder3(lanes hi, lanes mid, lanes lo, lanes * out);
+static void decoder4(const lanes * in, lanes * out);
+static void ram_read(gcpu * gc, lanes * bus, lanes e);
+static void ram_write(gcpu * gc, const lanes * bus, lanes s);
+static void alu(const lanes * a, const lanes * b, lanes cin, const lanes * op,
+				lanes * out, lanes * flags);
+
+void gcpu_init(gcpu * gc)
+{
+	/* everything off, the stepper at step 1 */
+	memset(gc, 0, sizeof(*gc));
+	gc->step = 1;
+	return;
+}
+
+void gcpu_load(gcpu * gc, int lane, const byte * code, int csize)
+{
+	/* clear the bits of lane everywhere
+	 * then set the ones of code in the ram */
+	lanes bit = (lanes)1 << lane;
+	int i, j;
+	
+	for (i = 0; i < BITS; ++i)
+	{
+		for (j = 0; j < NUM_REGS; ++j)
+			gc->regs[j][i] &= ~bit;
+		
+		gc->bus[i] &= ~bit;
+		gc->tmp[i] &= ~bit;
+		gc->acc[i] &= ~bit;
+		gc->io_sel[i] &= ~bit;
+	}
+	
+	for (i = 0; i < RAM_S; ++i)
+	{
+		for (j = 0; j < BITS; ++j)
+		{
+			if (i < csize && (code[i] >> j) & 1)
+				gc->ram[i][j] |= bit;
+			else
+				gc->ram[i][j] &= ~bit;
+		}
+	}
+	
+	return;
+}
+
+void gcpu_tick(gcpu * gc)
+{
+	/* one clock cycle
+	 * decode IR and the step into the control wires
+	 * clk e: the enabled registers go on the bus, the alu works on it
+	 * clk s: the set registers take the bus or the alu output */
+	lanes s[STEPS + 1], ins[INSTR_COUNT], rad[4], rbd[4], op[3];
+	lanes res[BITS], b[BITS], flags[4], bus[BITS];
+	const lanes * ir = gc->regs[IR];
+	lanes alu_i, cmp, carry, match, s5alu, bus1, clf, i_in, i_out;
+	lanes e_iar, e_ram, e_acc, e_ra, e_rb, e_sel;
+	lanes set_mar, set_iar, set_acc, set_rb, set_ram, set_c, set_z, set_ae;
+	int i;
+	
+	for (i = 1; i <= STEPS; ++i)
+		s[i] = lanes_if(gc->step == i);
+	
+	// the instruction decoder; the alu instructions have the top bit on
+	alu_i = ir[7];
+	decoder3(ir[6], ir[5], ir[4], ins);
+	cmp = and(alu_i, ins[CMP - ADD]);
+	carry = and(alu_i, or(ins[ADD - ADD], or(ins[SHR - ADD], ins[SHL - ADD])));
+	for (i = 0; i < ADD; ++i)
+		ins[i] = and(ins[i], not(alu_i));
+	
+	decoder2(ir[3], ir[2], rad);
+	decoder2(ir[1], ir[0], rbd);
+	match = or(or(and(ir[3], gc->regs[CF][0]), and(ir[2], gc->regs[AF][0])),
+				or(and(ir[1], gc->regs[EF][0]), and(ir[0], gc->regs[ZF][0])));
+	
+	s5alu = and(s[5], alu_i);
+	clf = and(and(s[4], ins[CLF]), not(and(and(ir[0], not(ir[1])), not(or(ir[2], ir[3])))));
+	i_in = and(ins[IO], not(ir[3]));
+	i_out = and(ins[IO], ir[3]);
+	bus1 = or(s[1], and(s[4], or(ins[DATA], ins[JCOND])));
+	
+	// what goes on the bus
+	e_iar = or(s[1], and(s[4], or(ins[DATA], or(ins[JMP], ins[JCOND]))));
+	e_ram = or(or(s[2], and(s[5], or(ins[LOAD], or(ins[DATA], ins[JMP])))),
+				and(s[6], and(ins[JCOND], match)));
+	e_acc = or(or(s[3], and(s[5], ins[JCOND])),
+				and(s[6], or(ins[DATA], and(alu_i, not(cmp)))));
+	e_ra = or(and(s[4], or(ins[LOAD], ins[STORE])), s5alu);
+	e_rb = or(and(s[4], or(alu_i, or(ins[JMPR], i_out))), and(s[5], ins[STORE]));
+	e_sel = and(and(s[5], i_in), ir[2]);
+	
+	// what takes it
+	set_mar = or(s[1], and(s[4], or(or(ins[LOAD], ins[STORE]),
+				or(ins[DATA], or(ins[JMP], ins[JCOND])))));
+	set_iar = or(or(s[3], and(s[4], ins[JMPR])),
+				or(and(s[5], or(ins[JMP], ins[JCOND])),
+				and(s[6], or(ins[DATA], and(ins[JCOND], match)))));
+	set_acc = or(or(s[1], and(s[4], or(ins[DATA], ins[JCOND]))), s5alu);
+	set_rb = or(and(s[5], or(or(ins[LOAD], ins[DATA]), i_in)),
+				and(s[6], and(alu_i, not(cmp))));
+	set_ram = and(s[5], ins[STORE]);
+	set_c = and(s[5], carry);
+	set_z = and(s5alu, not(cmp));
+	set_ae = and(s5alu, cmp);
+	
+	// clk e
+	memset(bus, 0, sizeof(bus));
+	enable(bus, gc->regs[IAR], e_iar);
+	ram_read(gc, bus, e_ram);
+	enable(bus, gc->acc, e_acc);
+	enable(bus, gc->io_sel, e_sel);
+	for (i = 0; i < 4; ++i)
+		enable(bus, gc->regs[R0 + i], or(and(e_ra, rad[i]), and(e_rb, rbd[i])));
+	
+	// bus 1 puts 1 instead of TMP on the alu; the operation is ADD unless it's step 5
+	for (i = 0; i < BITS; ++i)
+		b[i] = (0 == i) ? or(gc->tmp[i], bus1) : and(gc->tmp[i], not(bus1));
+	for (i = 0; i < 3; ++i)
+		op[i] = and(ir[4 + i], s5alu);
+	
+	alu(bus, b, and(gc->regs[CF][0], s5alu), op, res, flags);
+	
+	// clk s; the ram goes first, MAR may change after it
+	ram_write(gc, bus, set_ram);
+	reg_set(gc->regs[MAR], bus, set_mar);
+	reg_set(gc->regs[IR], bus, s[2]);
+	reg_set(gc->regs[IAR], bus, set_iar);
+	reg_set(gc->tmp, bus, and(s[4], alu_i));
+	reg_set(gc->acc, res, set_acc);
+	reg_set(gc->io_sel, bus, and(and(s[4], i_out), ir[2]));
+	for (i = 0; i < 4; ++i)
+		reg_set(gc->regs[R0 + i], bus, and(set_rb, rbd[i]));
+	
+	// CLF sets the flags to 0; IRET, CLF with only the low bit on, does nothing here
+	gc->regs[CF][0] = mem_bit(mem_bit(gc->regs[CF][0], flags[0], set_c), 0, clf);
+	gc->regs[AF][0] = mem_bit(mem_bit(gc->regs[AF][0], flags[1], set_ae), 0, clf);
+	gc->regs[EF][0] = mem_bit(mem_bit(gc->regs[EF][0], flags[2], set_ae), 0, clf);
+	gc->regs[ZF][0] = mem_bit(mem_bit(gc->regs[ZF][0], flags[3], set_z), 0, clf);
+	
+	memcpy(gc->bus, bus, sizeof(bus));
+	if (++gc->step > STEPS)
+	{
+		gc->step = 1;
+		++gc->icount;
+	}
+	
+	return;
+}
+
+void gcpu_step(gcpu * gc)
+{
+	/* tick until step 1 comes around */
+	do
+		gcpu_tick(gc);
+	while (gc->step != 1);
+	
+	return;
+}
+
+void gcpu_get(const gcpu * gc, int lane, byte * regs, byte * ram)
+{
+	/* gather the bits of lane */
+	int i, j;
+	
+	for (i = 0; i < NUM_REGS; ++i)
+	{
+		for (regs[i] = 0, j = 0; j < BITS; ++j)
+			regs[i] |= ((gc->regs[i][j] >> lane) & 1) << j;
+	}
+
+	if (NULL == ram)
+		return;
+	
+	for (i = 0; i < RAM_S; ++i)
+	{
+		for (ram[i] = 0, j = 0; j < BITS; ++j)
+			ram[i] |= ((gc->ram[i][j] >> lane) & 1) << j;
+	}
+	
+	return;
+}
+
+static lanes mem_bit(lanes o, lanes i, lanes s)
+{
+	/* the book's memory bit; four NANDs
+	 * o is what it held, i the input, s the set wire */
+	lanes a = nand(i, s);
+	lanes b = nand(a, s);
+	lanes c = nand(o, b);
+	
+	return nand(a, c);
+}
+
+static void reg_set(lanes * r, const lanes * in, lanes s)
+{
+	/* a byte of memory bits sharing a set wire */
+	int i;
+	
+	for (i = 0; i < BITS; ++i)
+		r[i] = mem_bit(r[i], in[i], s);
+	
+	return;
+}
+
+static void enable(lanes * bus, const lanes * r, lanes e)
+{
+	/* an enabler; the bus is the or of everything enabled on it */
+	int i;
+	
+	for (i = 0; i < BITS; ++i)
+		bus[i] = or(bus[i], and(r[i], e));
+	
+	return;
+}
+
+static void decoder2(lanes hi, lanes lo, lanes * out)
+{
+	/* 2 x 4 decoder */
+	out[0] = and(not(hi), not(lo));
+	out[1] = and(not(hi), lo);
+	out[2] = and(hi, not(lo));
+	out[3] = and(hi, lo);
+	return;
+}
+
+static void decoder3(lanes hi, lanes mid, lanes lo, lanes * out)
+{
+	/* 3 x 8 decoder */
+	lanes d[4];
+	int i;
+	
+	decoder2(mid, lo, d);
+	for (i = 0; i < 4; ++i)
+	{
+		out[i] = and(not(hi), d[i]);
+		out[i + 4] = and(hi, d[i]);
+	}
+	
+	return;
+}
+
+static void decoder4(const lanes * in, lanes * out)
+{
+	/* 4 x 16 decoder; in is bit 0 first */
+	lanes hi[4], lo[4];
+	int i;
+	
+	decoder2(in[3], in[2], hi);
+	decoder2(in[1], in[0], lo);
+	for (i = 0; i < 16; ++i)
+		out[i] = and(hi[i >> 2], lo[i & 3]);
+	
+	return;
+}
+
+static void ram_read(gcpu * gc, lanes * bus, lanes e)
+{
+	/* the two MAR decoders pick a cell on the grid
+	 * the picked cell goes on the bus when e is on */
+	lanes row[16], col[16], sel;
+	int i;
+	
+	if (0 == e)
+		return;
+	
+	decoder4(&gc->regs[MAR][4], row);
+	decoder4(&gc->regs[MAR][0], col);
+	
+	for (i = 0; i < RAM_S; ++i)
+	{
+		// a cell nobody picked puts nothing on the bus
+		if ((sel = and(and(row[i >> 4], col[i & 0x0F]), e)) != 0)
+			enable(bus, gc->ram[i], sel);
+	}
+	
+	return;
+}
+
+static void ram_write(gcpu * gc, const lanes * bus, lanes s)
+{
+	/* the picked cell takes the bus when s is on */
+	lanes row[16], col[16], sel;
+	int i;
+	
+	if (0 == s)
+		return;
+	
+	decoder4(&gc->regs[MAR][4], row);
+	decoder4(&gc->regs[MAR][0], col);
+	
+	for (i = 0; i < RAM_S; ++i)
+	{
+		if ((sel = and(and(row[i >> 4], col[i & 0x0F]), s)) != 0)
+			reg_set(gc->ram[i], bus, sel);
+	}
+	
+	return;
+}
+
+static void alu(const lanes * a, const lanes * b, lanes cin, const lanes * op,
+				lanes * out, lanes * flags)
+{
+	/* every part works on a and b at the same time
+	 * the 3 x 8 decoder on op enables one of them on out
+	 * flags are carry out, a larger, equal, and zero */
+	lanes sum[BITS], shr[BITS], shl[BITS], dec[8];
+	lanes c = cin, x, eq = ALL, larger = 0, any = 0;
+	int i;
+	
+	// the adder; a full adder per bit, carry going up
+	for (i = 0; i < BITS; ++i)
+	{
+		x = xor(a[i], b[i]);
+		sum[i] = xor(x, c);
+		c = or(and(a[i], b[i]), and(x, c));
+	}
+	
+	// the shifters are only wires; carry in goes in at the empty end
+	for (i = 0; i < BITS; ++i)
+	{
+		shr[i] = (BITS - 1 == i) ? cin : a[i + 1];
+		shl[i] = (0 == i) ? cin : a[i - 1];
+	}
+	
+	// the comparator; from the top bit down, a is larger at the first difference
+	for (i = BITS - 1; i >= 0; --i)
+	{
+		x = xor(a[i], b[i]);
+		larger = or(larger, and(and(eq, x), a[i]));
+		eq = and(eq, not(x));
+	}
+	
+	// CMP has no output
+	decoder3(op[2], op[1], op[0], dec);
+	for (i = 0; i < BITS; ++i)
+	{
+		out[i] = or(or(or(and(sum[i], dec[ADD - ADD]), and(shr[i], dec[SHR - ADD])),
+					or(and(shl[i], dec[SHL - ADD]), and(not(a[i]), dec[NOT - ADD]))),
+					or(or(and(and(a[i], b[i]), dec[AND - ADD]),
+					and(or(a[i], b[i]), dec[OR - ADD])), and(xor(a[i], b[i]), dec[XOR - ADD])));
+		any = or(any, out[i]);
+	}
+	
+	flags[0] = or(or(and(c, dec[ADD - ADD]), and(a[0], dec[SHR - ADD])),
+				and(a[BITS - 1], dec[SHL - ADD]));
+	flags[1] = larger;
+	flags[2] = eq;
+	flags[3] = not(any);
+	return;
+}
@@ -0,0 +1,55 @@
+/* gates.h -- the gate level jcpu public interface */
+/* ver. 1.0 */
+#ifndef GATES_H
+#define GATES_H
+
+#include <stdint.h>
+#include "jcpu.h"
+
+#define GATE_LANES	64		// machines run at once, one per bit of a wire
+
+typedef uint64_t lanes;
+/* a wire of all machines at once; bit n is the wire of machine n */
+
+typedef lanes gbyte[8];
+/* eight wires carrying a byte for every machine, bit 0 first */
+
+// GATE_LANES book cpus made of gates, all evaluated together
+typedef struct gcpu_ {
+	gbyte ram[RAM_S];		// the memory bits of the ram
+	gbyte regs[NUM_REGS];	// the registers; the flags use only bit 0
+	gbyte bus, tmp, acc;	// the bus and the alu registers
+	gbyte io_sel;			// the address last put on the I/O bus
+	int step;				// the stepper; the same for every machine
+	unsigned long icount;	// instructions executed by every machine
+} gcpu;
+
+void gcpu_init(gcpu * gc);
+/* returns: Nothing.
+ *
+ * description: Powers on every machine of gc with empty ram. */
+
+void gcpu_load(gcpu * gc, int lane, const byte * code, int csize);
+/* returns: Nothing.
+ *
+ * description: Zeroes the ram and the registers of machine lane and loads
+ * code in its ram. Call before running or between instructions. */
+
+void gcpu_tick(gcpu * gc);
+/* returns: Nothing.
+ *
+ * description: Runs one clock cycle of every machine. The enabled
+ * registers go on the bus first, then the set ones take what's on it. */
+
+void gcpu_step(gcpu * gc);
+/* returns: Nothing.
+ *
+ * description: Runs the six steps of an instruction on every machine. */
+
+void gcpu_get(const gcpu * gc, int lane, byte * regs, byte * ram);
+/* returns: Nothing.
+ *
+ * description: Copies the NUM_REGS registers of machine lane in regs
+ * and its ram in ram, laid out like a jcpu. The ram is left out if ram
+ * is NULL; gathering it takes much longer than the registers. */
+#endif
@@ -1,9 +1,11 @@
 /* jcpasm.c -- assembler for the jcpu */
-/* ver. 1.123 */
+/* ver. 1.125 */
 
 /* Reads an assembly text file and outputs
- * the respective binary instructions for the jcpu. */
- 
+ * the respective binary instructions for the jcpu.
+ * Can also write a symbol map, the address of every label, for the
+ * jcpvm and jcpdis to show the labels instead of the numbers. */
+
 /* Author: Vladimir Dinev */
 #include <stdio.h>
 #include <stdlib.h>
@@ -21,13 +23,15 @@
 #define MAX_CODE	256		// no more than 256 bytes can compile
 #define DASH		'-'		// command line arguments begin with -
 #define OUTF		'o'		// output file follows
+#define SYMF		'm'		// symbol map file follows
 #define VERS		'v'		// print version info
 #define HELP		'h'		// print help
 #define LBL_ADDR	':'		// if a label ends with ':', parse it as address mark
 #define LBL_JUMP	'j'		// if a label doesn't end with ':', parse it as a jump destination
 #define DEC_SEP		' '		// separates the label name and decoration number
 #define NUL			'\0'	// ascii null
-#define print_use()	printf("Use:  %s <in file> %c%c <out file>\n", exenm, DASH, OUTF)
+#define print_use()	printf("Use:  %s <in file> %c%c <out file> [%c%c <symbol map>]\n", \
+		exenm, DASH, OUTF, DASH, SYMF)
 #define help_opt()	printf("Help: %s %c%c\n", exenm, DASH, HELP)
 
 typedef struct label_ {
@@ -44,15 +48,18 @@ static int all_size = 0;	// code buffer pointer
 CHTbl * instr_htbl;			// instruction hash table pointer
 CHTbl * lbls_htbl;			// label hash table pointer
 char exenm[] = "jcpasm";	// executable name
-char ver[] = "v1.123";		// executable version
+char ver[] = "v1.125";		// executable version
 int curr_lineno = 0;		// current line number
 char * fin, * fout;			// input/output file strings
+char * fsym = NULL;			// symbol map file string
+static label * syms[RAM_S];	// the first label of every address
 
 extern char ppexenm[];
 extern char ppext[];
 
 // parser functions
 void parse_instr(void);
+void parse_io(void);
 int parse_register(void);
 void parse_label(char context);
 void parse_address(void);
@@ -70,6 +77,8 @@ label * make_lbl_node(char * lbl);
 void free_labels(void * lbl);
 void resolve_lbl_addr(ListElmt * l_element, void * args);
 void look_lone_lbls(ListElmt * l_element, void * args);
+void collect_sym(ListElmt * l_element, void * args);
+void write_syms(void);
 
 // service functions
 bool is_preproc_here(void);
@@ -84,7 +93,7 @@ int main(int argc, char * argv[])
 	 * initiate the lexer,
 	 * transfer control to the parser,
 	 * save the output code */
-	 
+	
 	if (argc > 1 && DASH == argv[1][0])
 	{
 		if (HELP == argv[1][1])
@@ -101,7 +110,7 @@ int main(int argc, char * argv[])
 		return -1;
 	}
 	
-	if (argc != 4)
+	if (argc != 4 && argc != 6)
 	{
 		print_use();
 		help_opt();
@@ -114,6 +123,16 @@ int main(int argc, char * argv[])
 		quit();
 	} 
 	
+	if (6 == argc)
+	{
+		if (DASH != argv[4][0] || SYMF != argv[4][1])
+		{
+			fprintf(stderr, "%s: ", exenm), fprintf(stderr, "Err: unrecognized option %s\n", argv[4]);
+			quit();
+		}
+		fsym = argv[5];
+	}
+	
 	static char curr_text[SUB_STR_SZ];
 	CHTbl instr_htbl_, lbls_htbl_;
 	
@@ -172,7 +191,7 @@ int main(int argc, char * argv[])
 	{
 		if (all_size > MAX_CODE)
 			break;
-	
+		
 		switch (ctok)
 		{
 			case TOK_INSTR:
@@ -204,20 +223,23 @@ int main(int argc, char * argv[])
 		printf("%s: ", exenm), printf("Warning: resulting code is bigger than the maximum of %d bytes\n",
 				MAX_CODE);
 		printf("Only the first %d bytes will be saved in the binary\n", MAX_CODE);
-				
+		
 		all_size = MAX_CODE;
 	}
 	
 	eval_labels();
 	
+	if (fsym != NULL)
+		write_syms();
+	
 	if (fwrite(binary , all_size, 1, output_file) != 1)
 	{
 		fprintf(stderr, "%s: ", exenm), fprintf(stderr, "Err: %s: output file was not written properly\n", exenm);
 		quit();
 	}
-
+	
 	puts("Compilation successful");
-
+	
 	free(run_ppstr);
 	fclose(output_file);
 	fclose(input_file);
@@ -264,6 +286,22 @@ void parse_instr(void)
 		return;
 	}
 	
+	// special case of IN/OUT DATA/ADDR
+	if (strcmp(in_buff, iodir[0]) == 0 || strcmp(in_buff, iodir[1]) == 0)
+	{
+		parse_io();
+		++all_size;
+		return;
+	}
+	
+	// special case of return from interrupt
+	if (strcmp(in_buff, iret_name) == 0)
+	{
+		binary[all_size] = IRET_INSTR;
+		++all_size;
+		return;
+	}
+	
 	instr curr_instr, * tip;
 	curr_instr.name = (char *)in_buff;
 	
@@ -278,6 +316,12 @@ void parse_instr(void)
 		{
 			case CLF:
 				break;
+			case IO:
+				// only reachable by name; IN and OUT are the real mnemonics
+				fprintf(stderr, "%s: ", exenm), fprintf(stderr, "Err: line %d: invalid instruction < %s >\n", 
+						curr_lineno, in_buff);
+				quit();
+				break;
 			case JMP:
 				++all_size;
 				if (Lexer.Current() == TOK_LITERAL)
@@ -313,7 +357,30 @@ void parse_instr(void)
 				curr_lineno, in_buff);
 		quit();
 	}
-					
+	
+	return;
+}
+
+void parse_io(void)
+{
+	/* translate IN/OUT DATA/ADDR RB into binary */
+	binary[all_size] = IO << 4;
+	
+	if (strcmp(in_buff, iodir[1]) == 0)
+		binary[all_size] |= IO_OUT;
+	
+	e_match(TOK_INSTR);
+	if (strcmp(in_buff, iokind[1]) == 0)
+		binary[all_size] |= IO_ADDR;
+	else if (strcmp(in_buff, iokind[0]) != 0)
+	{
+		fprintf(stderr, "%s: ", exenm), fprintf(stderr, "Err: line %d: %s or %s expected but got < %s >\n", 
+				curr_lineno, iokind[0], iokind[1], in_buff);
+		quit();
+	}
+	
+	// get RB
+	binary[all_size] |= parse_register();
 	return;
 }
 
@@ -321,7 +388,7 @@ int parse_register(void)
 {
 	/* translates register mnemonics into binary */
 	e_match(TOK_REGISTER);
-
+	
 	int reg;
 	if ('R' != in_buff[0])
 		goto regerr;
@@ -401,10 +468,10 @@ void parse_address(void)
 			fprintf(stderr, "Hex numbers should be prefixed with \"0x\"\n");
 			quit();
 		}
-	
+		
 		addr_state = sscanf(in_buff, "%d", &num);
 	}
-		
+	
 	if (addr_state != 1 || num > 0xFF)
 	{
 		fprintf(stderr, "%s: ", exenm), fprintf(stderr, "Err: line %d: invalid address < %s >\n", 
@@ -470,7 +537,7 @@ void print_ln_err(void)
 	
 	if ('\n' == src_ln[end])
 		src_ln[end] = NUL;
-		
+	
 	fprintf(stderr, "%s: ", exenm), fprintf(stderr, "%s\n", src_ln);
 	fprintf(stderr, "%s: ", exenm), fprintf(stderr, "%*c\n", Lexer.GetErrPos(), '^');
 	
@@ -513,7 +580,7 @@ label * make_lbl_node(char * lbl)
 	static const int xtra_space = 10;
 	
 	label * newlbl = emalloc(sizeof(*newlbl));
-
+	
 	newlbl->lbl_str = emalloc(endl + xtra_space);
 	strcpy(newlbl->lbl_str, lbl);
 	
@@ -522,14 +589,14 @@ label * make_lbl_node(char * lbl)
 	if (LBL_ADDR != newlbl->lbl_str[endl])
 	{
 		newlbl->context = LBL_JUMP;
-
+		
 		// decorate label with a number so we can remember them all
 		sprintf(newlbl->lbl_str, "%s%c%d", newlbl->lbl_str, DEC_SEP, dec_lbl);
 		++dec_lbl;
 	}
 	else
 		newlbl->context = LBL_ADDR;
-		
+	
 	newlbl->address = all_size;
 	newlbl->lineno = curr_lineno;
 	newlbl->visited = false;
@@ -567,6 +634,37 @@ void eval_labels(void)
 	return;
 }
 
+void write_syms(void)
+{
+	/* write the first label of every address
+	 * in address order, one a line */
+	FILE * sym_file;
+	int i;
+	
+	for (i = 0; i < BUCKETS; ++i)
+	{
+		if (lbls_htbl->table[i].head != NULL)
+			list_apply_all(&lbls_htbl->table[i], collect_sym, NULL);
+	}
+	
+	sym_file = efopen(fsym, "w");
+	for (i = 0; i < RAM_S; ++i)
+	{
+		// the label without the ':'
+		if (syms[i] != NULL)
+			fprintf(sym_file, "%02X %.*s\n", i, (int)strlen(syms[i]->lbl_str) - 1,
+					syms[i]->lbl_str);
+	}
+	
+	if (fclose(sym_file) != 0)
+	{
+		fprintf(stderr, "%s: ", exenm), fprintf(stderr, "Err: %s: symbol map was not written properly\n", exenm);
+		quit();
+	}
+	
+	return;
+}
+
 void resolve_lbl_addr(ListElmt * l_element, void * args)
 {
 	/* go through all jump destination labels
@@ -625,6 +723,21 @@ void look_lone_lbls(ListElmt * l_element, void * args)
 	
 	return;
 }
+
+void collect_sym(ListElmt * l_element, void * args)
+{
+	/* keep the address label which comes first
+	 * in the source for its address */
+	label * lbl = (label *)l_element->data;
+	
+	if (LBL_ADDR != lbl->context || lbl->address >= RAM_S)
+		return;
+	
+	if (NULL == syms[lbl->address] || lbl->lineno < syms[lbl->address]->lineno)
+		syms[lbl->address] = lbl;
+	
+	return;
+}
 /* ---------------------------- HASH TABLE FUNCTIONS END ----------------------------  */
 
 /* ---------------------------- SERVICE FUNCTIONS START ----------------------------  */
@@ -637,7 +750,7 @@ bool is_preproc_here(void)
 		return false;
 	else
 		fclose(pproc);
-		
+	
 	return true;
 }
 
@@ -672,8 +785,10 @@ void * emalloc(size_t nbytes)
 void print_help(void)
 {
 	/* show help */
-	printf("Compile: %s <input text file> %c%c <output binary file>\n", 
-			exenm, DASH, OUTF);
+	printf("Compile: %s <input text file> %c%c <output binary file> [%c%c <symbol map>]\n", 
+			exenm, DASH, OUTF, DASH, SYMF);
+	printf("The symbol map has the address of every label; the jcpvm and jcpdis\n");
+	printf("can show the labels with it.\n");
 	printf("Version: %s %c%c\n", exenm, DASH, VERS);
 	printf("Help:    %s %c%c\n", exenm, DASH, HELP);
 	return;
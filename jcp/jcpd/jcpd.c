@@ -0,0 +1,182 @@
+/* jcpd.c -- the execution server */
+/* ver. 1.0 */
+
+/* Listens on a Unix domain socket for programs to run, with their inputs
+ * and a number of steps, runs them on a pool of workers which stays up
+ * between them, and sends back the final states. Saves starting a jcpvm and
+ * reading a file for every run of a 256 byte program. The protocol is in
+ * serve.h. Also tells how a running server is doing. */
+
+/* Author: Vladimir Dinev */
+#include "../os_def.h"
+#include <stdio.h>
+#include <stdlib.h>
+#ifdef WINDOWS
+#include <io.h>
+#else
+#include <unistd.h>
+#endif
+#include "../serve.h"
+
+#define DASH		'-'			// command line arguments begin with -
+#define VERS		'v'			// print version info
+#define HELP		'h'			// print help
+#define SOCK		's'			// the socket path
+#define THRDS		't'			// number of workers
+#define STEPS		'n'			// the most instructions a run gets
+#define QUERY		'q'			// print how the server is doing
+#define SERVE_SOCK	"jcpd.sock"	// default socket path
+#define SERVE_STEPS	100000000	// default most instructions a run gets
+#define print_use()	printf("Use:  %s [%c%c <socket>] [%c%c <threads>] [%c%c <steps>] [%c%c]\n", \
+						exenm, DASH, SOCK, DASH, THRDS, DASH, STEPS, DASH, QUERY)
+#define help_opt()	printf("Help: %s %c%c\n", exenm, DASH, HELP)
+
+char exenm[] = "jcpd";		// executable name
+char ver[] = "v1.0";		// executable version
+
+int query(const char * path);
+unsigned long num_arg(int argc, char * argv[], int * argn);
+int host_cores(void);
+void print_help(void);
+
+int main(int argc, char * argv[])
+{
+	/* parse command line
+	 * serve, or ask the server how it's doing */
+	const char * path = SERVE_SOCK;
+	unsigned long steps = SERVE_STEPS;
+	int i, nthreads = host_cores();
+	bool qry = false;
+	
+	for (i = 1; i < argc; ++i)
+	{
+		switch ((DASH == argv[i][0]) ? argv[i][1] : '\0')
+		{
+			case HELP:
+				print_help();
+				return -1;
+			case VERS:
+				printf("%s %s\n", exenm, ver);
+				return -1;
+			case SOCK:
+				if (i + 1 >= argc)
+				{
+					fprintf(stderr, "Err: \"%s\" should be followed by a path\n", argv[i]);
+					return -1;
+				}
+				path = argv[++i];
+				break;
+			case THRDS:
+				nthreads = num_arg(argc, argv, &i);
+				break;
+			case STEPS:
+				steps = num_arg(argc, argv, &i);
+				break;
+			case QUERY:
+				qry = true;
+				break;
+			default:
+				fprintf(stderr, "Err: unrecognized argument \"%s\"\n", argv[i]);
+				print_use();
+				help_opt();
+				return -1;
+		}
+	}
+	
+	if (qry)
+		return query(path);
+	
+	return serve_run(path, nthreads, steps);
+}
+
+int query(const char * path)
+{
+	/* ask the server at path for its stats and print them */
+	serve_stats st;
+	double secs;
+	int fd;
+	
+	if ((fd = serve_connect(path)) < 0)
+	{
+		fprintf(stderr, "Err: there is no server on \"%s\"\n", path);
+		return -1;
+	}
+	
+	if (serve_query(fd, &st) != 0)
+	{
+		fprintf(stderr, "Err: the server on \"%s\" didn't answer\n", path);
+		close(fd);
+		return -1;
+	}
+	
+	close(fd);
+	secs = st.usecs / 1e6;
+	printf("%lu queued, %lu running on %lu workers, %lu connections\n",
+			(unsigned long)st.queued, (unsigned long)st.running,
+			(unsigned long)st.workers, (unsigned long)st.conns);
+	printf("%lu runs, %lu instructions in %.3f s; %.2f runs per second, %.2f MIPS\n",
+			(unsigned long)st.done, (unsigned long)st.icount, secs,
+			(secs > 0) ? st.done / secs : 0.0, (secs > 0) ? st.icount / secs / 1e6 : 0.0);
+	return 0;
+}
+
+unsigned long num_arg(int argc, char * argv[], int * argn)
+{
+	/* read the number after the option at *argn
+	 * die if there isn't one */
+	unsigned long num;
+	char * end;
+	
+	if (*argn + 1 >= argc)
+	{
+		fprintf(stderr, "Err: \"%s\" should be followed by a number\n", argv[*argn]);
+		exit(EXIT_FAILURE);
+	}
+	
+	++*argn;
+	num = strtoul(argv[*argn], &end, 0);
+	if (*end != '\0' || DASH == argv[*argn][0])
+	{
+		fprintf(stderr, "Err: \"%s\" is not a number\n", argv[*argn]);
+		exit(EXIT_FAILURE);
+	}
+	
+	return num;
+}
+
+int host_cores(void)
+{
+	/* how many cores the host has */
+#ifdef WINDOWS
+	SYSTEM_INFO si;
+	
+	GetSystemInfo(&si);
+	return si.dwNumberOfProcessors;
+#else
+	long n = sysconf(_SC_NPROCESSORS_ONLN);
+	
+	return (n > 0) ? n : 1;
+#endif
+}
+
+void print_help(void)
+{
+	/* show help */
+	printf("Run:     %s [%c%c <socket>] [%c%c <threads>] [%c%c <steps>]\n",
+			exenm, DASH, SOCK, DASH, THRDS, DASH, STEPS);
+	printf("Stats:   %s [%c%c <socket>] %c%c\n", exenm, DASH, SOCK, DASH, QUERY);
+	printf("Version: %s %c%c\n", exenm, DASH, VERS);
+	printf("Help:    %s %c%c\n", exenm, DASH, HELP);
+	printf("\nListens on the Unix domain socket <socket> (default %s) and runs the\n",
+			SERVE_SOCK);
+	printf("programs its clients send on <threads> workers (default all cores). A\n");
+	printf("request is a binary, the bytes to poke in its ram or registers, and how\n");
+	printf("many instructions it may run, but no more than <steps> (default %d).\n",
+			SERVE_STEPS);
+	printf("The answer is its final state. A client can send many requests without\n");
+	printf("waiting; the answers come as the runs finish. The protocol is in serve.h.\n");
+	printf("%c%c prints how many runs are queued and running on the server at\n",
+			DASH, QUERY);
+	printf("<socket>, and how many it has run, and how fast, since it started.\n");
+	return;
+}
@@ -1,9 +1,11 @@
 /* jcpdis.c -- disassembler for the jcpu */
-/* ver. 1.01 */
+/* ver. 1.02 */
 
 /* Reads a binary file and disassembles it
- * to jcpu assembly language. */
- 
+ * to jcpu assembly language. With the symbol map jcpasm writes, the
+ * labels go back where they were and the jumps and the DATA values
+ * which have one use it. */
+
 /* Author: Vladimir Dinev */
 #include <stdio.h>
 #include <stdlib.h>
@@ -12,14 +14,17 @@
 #define MAX_CODE	256		// no more than 256 bytes can be decompiled
 #define DASH		'-'		// command line arguments begin with -
 #define OUTF		'o'		// output file follows
+#define SYMF		'm'		// symbol map file follows
+#define LBL_ADDR	':'		// ends a label which marks an address
 #define VERS		'v'		// version info flag
 #define HELP		'h'		// help flag
 #define SKIP_ADDR	12
-#define print_use()	printf("Use:  %s <in file> %c%c <out file>\n", exenm, DASH, OUTF)
+#define print_use()	printf("Use:  %s <in file> %c%c <out file> [%c%c <symbol map>]\n", \
+		exenm, DASH, OUTF, DASH, SYMF)
 #define help_opt()	printf("Help: %s %c%c\n", exenm, DASH, HELP)
 
 char exenm[] = "jcpdis";	// executable name
-char ver[] = "v1.01";		// executable version
+char ver[] = "v1.02";		// executable version
 
 FILE * efopen(const char * fname, const char * mode);
 int fsize(FILE *fp);
@@ -47,7 +52,7 @@ int main(int argc, char * argv[])
 		return -1;
 	}
 	
-	if (argc != 4)
+	if (argc != 4 && argc != 6)
 	{
 		print_use();
 		help_opt();
@@ -61,43 +66,63 @@ int main(int argc, char * argv[])
 	}
 	
 	static byte code[MAX_CODE] = {0};
+	static char * syms[DIS_SYMS] = {NULL};
 	char * fin, * fout;
 	fin = argv[1];
 	fout = argv[3];
 	
+	if (6 == argc)
+	{
+		if (DASH != argv[4][0] || SYMF != argv[4][1])
+		{
+			fprintf(stderr, "Err: unrecognized argument \"%s\"\n", argv[4]);
+			return -1;
+		}
+		
+		if (disasm_read_syms(argv[5], syms) < 0)
+		{
+			fprintf(stderr, "Err: \"%s\" could not be read as a symbol map\n", argv[5]);
+			return -1;
+		}
+	}
+	
 	FILE * file_input = efopen(fin, "rb");
 	int file_size = fsize(file_input);
 	
 	if (-1 == file_size)
 		goto readerr;
-		
+	
 	if (file_size > MAX_CODE)
 	{
 		printf("Warning: resulting code is bigger than the maximum of %d bytes\n",
 				MAX_CODE);
 		printf("Only the first %d bytes will be disassembled\n", MAX_CODE);
-				
+		
 		file_size = MAX_CODE;
 	}
 	
 	if (fread(code, file_size, 1, file_input) != 1)
 		goto readerr;
 	
-	char ** disstr = disasm_dis(code, file_size, PREF_HEX);
+	char ** disstr = disasm_dis_sym(code, file_size, PREF_HEX, syms);
 	FILE * file_output = efopen(fout, "w");
 	
 	int i;
 	for (i = 0; i < file_size; ++i)
 	{
 		if (disstr[i] != NULL)
+		{
+			if (syms[i] != NULL)
+				fprintf(file_output, "%s%c\n", syms[i], LBL_ADDR);
 			fprintf(file_output, "%s\n", &disstr[i][SKIP_ADDR]);
+		}
 	}
 	
 	fclose(file_output);
 	fclose(file_input);
 	puts("Disassembling complete");
 	return 0;
-	
+
 readerr:
 	fprintf(stderr, "Err: a reading error has occured\n");
 	fclose(file_input);
@@ -125,7 +150,7 @@ int fsize(FILE * fp)
 	
 	if (fseek(fp, 0L, SEEK_END) != 0)
 		return -1;
-		
+	
 	size = ftell(fp);
 	rewind(fp);
 	
@@ -135,9 +160,10 @@ int fsize(FILE * fp)
 void print_help(void)
 {
 	/* show help */
-	printf("Disassemble: %s <input binary file> %c%c <output text file>\n", 
-			exenm, DASH, OUTF);
+	printf("Disassemble: %s <input binary file> %c%c <output text file> [%c%c <symbol map>]\n", 
+			exenm, DASH, OUTF, DASH, SYMF);
 	printf("<input binary file> should be the name of a file compiled for the jcpu\n");
+	printf("<symbol map> is the one jcpasm wrote for it; its labels are shown\n");
 	printf("Version:     %s %c%c\n", exenm, DASH, VERS);
 	printf("Help:        %s %c%c\n", exenm, DASH, HELP);
 	return;
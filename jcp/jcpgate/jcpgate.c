@@ -0,0 +1,344 @@
+/* jcpgate.c -- runs the gate level jcpu against jcpu.c */
+/* ver. 1.0 */
+
+/* Loads up to 64 programs in the machines of the gate level model,
+ * runs them in lockstep with a jcpu each, and reports every machine
+ * where the two don't agree. Machines without a program can get a random
+ * one, which makes for a quick check of the whole instruction set. */
+
+/* Author: Vladimir Dinev */
+#include "../os_def.h"
+#include <stdio.h>
+#include <stdlib.h>
+#include <string.h>
+#include <stdbool.h>
+#include <time.h>
+#include "../gates.h"
+#include "../mach_code.h"
+#include "../disasm.h"
+
+#define DASH		'-'		// command line arguments begin with -
+#define VERS		'v'		// print version info
+#define HELP		'h'		// print help
+#define RAND		'r'		// random programs for the empty machines
+#define STEPS		'n'		// instructions to run
+#define GATE_STEPS	10000	// default instructions to run
+#define print_use()	printf("Use:  %s <file name>... [%c%c <seed>] [%c%c <steps>]\n", \
+						exenm, DASH, RAND, DASH, STEPS)
+#define help_opt()	printf("Help: %s %c%c\n", exenm, DASH, HELP)
+
+enum {SAME, DIFF, DEVS, EMPTY};
+/* how a machine ended up; agreed, did not, used a device, had no program */
+
+char exenm[] = "jcpgate";	// executable name
+char ver[] = "v1.0";		// executable version
+
+FILE * efopen(const char * fname);
+int fsize(FILE * fp);
+int read_code(const char * fname, byte * code);
+unsigned long num_arg(int argc, char * argv[], int * argn);
+void rand_code(unsigned long long * seed, byte * code);
+bool uses_dev(const jcpu * cpu);
+bool compare(const gcpu * gc, int lane, const jcpu * cpu, byte last, unsigned long steps,
+			bool full);
+double now(void);
+void print_help(void);
+
+int main(int argc, char * argv[])
+{
+	/* load the programs
+	 * step both models and compare every machine after every instruction
+	 * print the summary */
+	static gcpu gc;
+	static jcpu cpus[GATE_LANES];
+	static byte rams[GATE_LANES][RAM_S];
+	static byte code[RAM_S];
+	int state[GATE_LANES];
+	int i, lanes = 0, csize, running, count[EMPTY + 1] = {0};
+	bool rnd = false;
+	unsigned long n, steps = GATE_STEPS;
+	unsigned long long seed = 0;
+	double gate_secs = 0, t;
+	byte last;
+	bool store;
+	
+	gcpu_init(&gc);
+	for (i = 0; i < GATE_LANES; ++i)
+	{
+		jcpu_init(&cpus[i], rams[i], 0);
+		state[i] = EMPTY;
+	}
+	
+	for (i = 1; i < argc; ++i)
+	{
+		switch ((DASH == argv[i][0]) ? argv[i][1] : '\0')
+		{
+			case '\0':
+				if (GATE_LANES == lanes)
+				{
+					fprintf(stderr, "Err: no more than %d programs\n", GATE_LANES);
+					return -1;
+				}
+				
+				if ((csize = read_code(argv[i], code)) < 0)
+					return -1;
+				
+				gcpu_load(&gc, lanes, code, csize);
+				jcpu_load(&cpus[lanes], code, csize);
+				state[lanes++] = SAME;
+				break;
+			case HELP:
+				print_help();
+				return -1;
+			case VERS:
+				printf("%s %s\n", exenm, ver);
+				return -1;
+			case RAND:
+				seed = num_arg(argc, argv, &i);
+				rnd = true;
+				break;
+			case STEPS:
+				steps = num_arg(argc, argv, &i);
+				break;
+			default:
+				fprintf(stderr, "Err: unrecognized argument \"%s\"\n", argv[i]);
+				print_use();
+				help_opt();
+				return -1;
+		}
+	}
+	
+	if (rnd)
+	{
+		for (i = lanes; i < GATE_LANES; ++i)
+		{
+			rand_code(&seed, code);
+			gcpu_load(&gc, i, code, RAM_S);
+			jcpu_load(&cpus[i], code, RAM_S);
+			state[i] = SAME;
+		}
+	}
+	else if (0 == lanes)
+	{
+		print_use();
+		help_opt();
+		return -1;
+	}
+	
+	double start = now();
+	for (n = 1, running = 1; n <= steps && running > 0; ++n)
+	{
+		t = now();
+		gcpu_step(&gc);
+		gate_secs += now() - t;
+		
+		for (i = running = 0; i < GATE_LANES; ++i)
+		{
+			if (state[i] != SAME)
+				continue;
+			
+			// the gate level machines have no devices
+			if (uses_dev(&cpus[i]))
+			{
+				state[i] = DEVS;
+				continue;
+			}
+			
+			// only a store changes the ram
+			last = cpus[i].regs[IAR];
+			store = (STORE == cpus[i].ram[last] >> 4);
+			jcpu_step(&cpus[i]);
+			
+			if (!compare(&gc, i, &cpus[i], last, n, store))
+				state[i] = DIFF;
+			else if (!jcpu_halted(&cpus[i]))
+				++running;
+		}
+	}
+	double secs = now() - start;
+	
+	for (i = 0; i < GATE_LANES; ++i)
+	{
+		if (SAME == state[i] && !compare(&gc, i, &cpus[i], cpus[i].regs[IAR], n - 1, true))
+			state[i] = DIFF;
+		++count[state[i]];
+	}
+	
+	printf("%lu instructions: %d machines agree, %d differ, %d use devices\n",
+			gc.icount, count[SAME], count[DIFF], count[DEVS]);
+	printf("%.3f s, %.3f s of it in the gates; %.2f million gate level instructions per second\n",
+			secs, gate_secs, (gate_secs > 0) ? gc.icount * (double)GATE_LANES / gate_secs / 1e6 : 0.0);
+	
+	return (count[DIFF] > 0) ? 1 : 0;
+}
+
+bool uses_dev(const jcpu * cpu)
+{
+	/* see if the next instruction reads or writes a device */
+	byte instr = cpu->ram[cpu->regs[IAR]];
+	
+	return (IO == instr >> 4 && !(instr & IO_ADDR) && cpu->io_sel != PORT_NONE);
+}
+
+bool compare(const gcpu * gc, int lane, const jcpu * cpu, byte last, unsigned long steps,
+			bool full)
+{
+	/* print both machines if they differ
+	 * the ram is compared only when full is true, or the registers differ
+	 * return true if they don't */
+	byte regs[NUM_REGS], ram[RAM_S], instr[2];
+	int i;
+	
+	gcpu_get(gc, lane, regs, NULL);
+	if (memcmp(regs, cpu->regs, NUM_REGS) == 0 && !full)
+		return true;
+	
+	gcpu_get(gc, lane, regs, ram);
+	if (memcmp(regs, cpu->regs, NUM_REGS) == 0 && memcmp(ram, cpu->ram, RAM_S) == 0)
+		return true;
+	
+	// disassemble only the instruction, it may not line up with the rest
+	instr[0] = cpu->ram[last];
+	instr[1] = cpu->ram[(byte)(last + 1)];
+	printf("machine %d differs after %lu instructions, at %02X: %s\n", lane, steps, last,
+			strchr(disasm_dis(instr, 2, NO_PREF)[0], '>') + 1);
+	printf("      MAR IAR IR  C A E Z  R0 R1 R2 R3\n");
+	printf("gate   %02X  %02X %02X  %d %d %d %d  %02X %02X %02X %02X\n",
+			regs[MAR], regs[IAR], regs[IR], regs[CF], regs[AF], regs[EF], regs[ZF],
+			regs[R0], regs[R1], regs[R2], regs[R3]);
+	printf("jcpu   %02X  %02X %02X  %d %d %d %d  %02X %02X %02X %02X\n",
+			cpu->regs[MAR], cpu->regs[IAR], cpu->regs[IR], cpu->regs[CF], cpu->regs[AF],
+			cpu->regs[EF], cpu->regs[ZF], cpu->regs[R0], cpu->regs[R1], cpu->regs[R2],
+			cpu->regs[R3]);
+	
+	for (i = 0; i < RAM_S; ++i)
+	{
+		if (ram[i] != cpu->ram[i])
+			printf("ram %02X: gate %02X, jcpu %02X\n", i, ram[i], cpu->ram[i]);
+	}
+	
+	return false;
+}
+
+void rand_code(unsigned long long * seed, byte * code)
+{
+	/* fill code with random bytes; xorshift, so the
+	 * same seed gives the same programs everywhere */
+	unsigned long long x = *seed + 0x9E3779B97F4A7C15ULL;
+	int i;
+	
+	for (i = 0; i < RAM_S; ++i)
+	{
+		x ^= x << 13;
+		x ^= x >> 7;
+		x ^= x << 17;
+		code[i] = x >> 24;
+	}
+	
+	*seed = x;
+	return;
+}
+
+int read_code(const char * fname, byte * code)
+{
+	/* read a binary in code
+	 * return its size or -1 */
+	FILE * fp = efopen(fname);
+	int size = fsize(fp);
+	
+	if (size > RAM_S)
+		size = RAM_S;
+	
+	if (size <= 0 || fread(code, size, 1, fp) != 1)
+	{
+		fprintf(stderr, "Err: \"%s\" is either empty or a reading error has occured\n",
+				fname);
+		size = -1;
+	}
+	
+	fclose(fp);
+	return size;
+}
+
+FILE * efopen(const char * fname)
+{
+	/* open a file or die with an error */
+	FILE * fp;
+	
+	if ( (fp = fopen(fname, "rb")) == NULL)
+	{
+		fprintf(stderr, "Err: could not open file \"%s\"\n", fname);
+		exit(EXIT_FAILURE);
+	}
+	
+	return fp;
+}
+
+int fsize(FILE * fp)
+{
+	/* get file size for opened file */
+	int size;
+	
+	if (fseek(fp, 0L, SEEK_END) != 0)
+		return -1;
+	
+	size = ftell(fp);
+	rewind(fp);
+	
+	return size;
+}
+
+unsigned long num_arg(int argc, char * argv[], int * argn)
+{
+	/* read the number after the option at *argn
+	 * die if there isn't one */
+	unsigned long num;
+	char * end;
+	
+	if (*argn + 1 >= argc)
+	{
+		fprintf(stderr, "Err: \"%s\" should be followed by a number\n", argv[*argn]);
+		exit(EXIT_FAILURE);
+	}
+	
+	++*argn;
+	num = strtoul(argv[*argn], &end, 0);
+	if (*end != '\0' || DASH == argv[*argn][0])
+	{
+		fprintf(stderr, "Err: \"%s\" is not a number\n", argv[*argn]);
+		exit(EXIT_FAILURE);
+	}
+	
+	return num;
+}
+
+double now(void)
+{
+	/* wall clock seconds for timing the run */
+#ifdef WINDOWS
+	return GetTickCount() / 1000.0;
+#else
+	struct timespec ts;
+	
+	clock_gettime(CLOCK_MONOTONIC, &ts);
+	return ts.tv_sec + ts.tv_nsec / 1e9;
+#endif
+}
+
+void print_help(void)
+{
+	/* show help */
+	printf("Run:     %s <file name>... [%c%c <seed>] [%c%c <steps>]\n",
+			exenm, DASH, RAND, DASH, STEPS);
+	printf("Version: %s %c%c\n", exenm, DASH, VERS);
+	printf("Help:    %s %c%c\n", exenm, DASH, HELP);
+	printf("\nLoads up to %d programs in the machines of the gate level jcpu and\n",
+			GATE_LANES);
+	printf("runs each one in lockstep with a jcpu for <steps> instructions (default\n");
+	printf("%d), or until all halt. A machine that differs from its jcpu is printed\n",
+			GATE_STEPS);
+	printf("and dropped. So is one that reads or writes a device, since the gate\n");
+	printf("level machines have none. %c%c fills the machines left without a\n", DASH, RAND);
+	printf("program with random ones made from <seed>; the file names can be left out.\n");
+	return;
+}
@@ -0,0 +1,316 @@
+/* jcplock.c -- runs programs on two engines in lockstep */
+/* ver. 1.0 */
+
+/* Runs every program given on two execution engines side by side and
+ * compares them as it goes, after every instruction or every few with the
+ * ram digest. The first time the two don't agree, both states are printed
+ * with the instruction they went apart on, and nothing more is run. */
+
+/* Author: Vladimir Dinev */
+#include "../os_def.h"
+#include <stdio.h>
+#include <stdlib.h>
+#include <string.h>
+#include <stdbool.h>
+#include <time.h>
+#include "../lockstep.h"
+#include "../disasm.h"
+
+#define DASH		'-'		// command line arguments begin with -
+#define VERS		'v'		// print version info
+#define HELP		'h'		// print help
+#define ENG_A		'a'		// the first engine
+#define ENG_B		'b'		// the second engine
+#define EVERY		'e'		// instructions between compares
+#define STEPS		'n'		// instructions to run
+#define LOCK_STEPS	1000000	// default instructions to run
+#define print_use()	printf("Use:  %s <file name>... [%c%c <engine>] [%c%c <engine>] " \
+						"[%c%c <every>] [%c%c <steps>]\n", \
+						exenm, DASH, ENG_A, DASH, ENG_B, DASH, EVERY, DASH, STEPS)
+#define help_opt()	printf("Help: %s %c%c\n", exenm, DASH, HELP)
+
+char exenm[] = "jcplock";	// executable name
+char ver[] = "v1.0";		// executable version
+
+FILE * efopen(const char * fname);
+int fsize(FILE * fp);
+int read_code(const char * fname, byte * code);
+unsigned long num_arg(int argc, char * argv[], int * argn);
+const lock_eng * eng_arg(int argc, char * argv[], int * argn);
+void print_diff(const lockstep * ls, const char * fname);
+void print_row(const char * name, const jcpu * cpu);
+double now(void);
+void print_help(void);
+
+int main(int argc, char * argv[])
+{
+	/* read the options, then run the programs one after
+	 * the other until one doesn't agree
+	 * print the summary */
+	static lockstep ls;
+	static byte code[RAM_S];
+	const lock_eng * a = lock_find("step"), * b = lock_find("ticks");
+	unsigned long steps = LOCK_STEPS, every = 1, total = 0;
+	int i, csize, res, nfiles = 0, halted = 0;
+	double start;
+	
+	for (i = 1; i < argc; ++i)
+	{
+		switch ((DASH == argv[i][0]) ? argv[i][1] : '\0')
+		{
+			case '\0':
+				++nfiles;
+				break;
+			case HELP:
+				print_help();
+				return -1;
+			case VERS:
+				printf("%s %s\n", exenm, ver);
+				return -1;
+			case ENG_A:
+				a = eng_arg(argc, argv, &i);
+				break;
+			case ENG_B:
+				b = eng_arg(argc, argv, &i);
+				break;
+			case EVERY:
+				every = num_arg(argc, argv, &i);
+				break;
+			case STEPS:
+				steps = num_arg(argc, argv, &i);
+				break;
+			default:
+				fprintf(stderr, "Err: unrecognized argument \"%s\"\n", argv[i]);
+				print_use();
+				help_opt();
+				return -1;
+		}
+	}
+	
+	if (0 == nfiles)
+	{
+		print_use();
+		help_opt();
+		return -1;
+	}
+	
+	lock_init(&ls, a, b, every);
+	start = now();
+	for (i = 1; i < argc; ++i)
+	{
+		// all options left are followed by a value
+		if (DASH == argv[i][0] && argv[i][1] != '\0')
+		{
+			++i;
+			continue;
+		}
+		
+		if ((csize = read_code(argv[i], code)) < 0)
+			return -1;
+		
+		lock_load(&ls, code, csize);
+		res = lock_run(&ls, steps);
+		total += ls.cpus[0].icount;
+		
+		if (LOCK_DIFF == res)
+		{
+			print_diff(&ls, argv[i]);
+			return 1;
+		}
+		
+		halted += (LOCK_HALT == res);
+	}
+	
+	printf("%s and %s agree on %d programs, %d of them halted; %lu instructions in %.3f s\n",
+			a->name, b->name, nfiles, halted, total, now() - start);
+	return 0;
+}
+
+const lock_eng * eng_arg(int argc, char * argv[], int * argn)
+{
+	/* read the engine after the option at *argn
+	 * die if there isn't one */
+	const lock_eng * eng;
+	
+	if (*argn + 1 >= argc)
+	{
+		fprintf(stderr, "Err: \"%s\" should be followed by an engine\n", argv[*argn]);
+		exit(EXIT_FAILURE);
+	}
+	
+	++*argn;
+	if ((eng = lock_find(argv[*argn])) == NULL)
+	{
+		fprintf(stderr, "Err: there is no engine \"%s\"\n", argv[*argn]);
+		exit(EXIT_FAILURE);
+	}
+	
+	return eng;
+}
+
+void print_diff(const lockstep * ls, const char * fname)
+{
+	/* the instruction on each side, since the ram may differ
+	 * then both states, and the ram where it differs */
+	const jcpu * x = &ls->cpus[0], * y = &ls->cpus[1];
+	byte instr[2];
+	int i, k;
+	
+	printf("%s: %s and %s differ after %lu instructions\n",
+			fname, ls->eng[0]->name, ls->eng[1]->name, x->icount);
+	for (k = 0; k < 2; ++k)
+	{
+		// disassemble only the instruction, it may not line up with the rest
+		instr[0] = ls->cpus[k].ram[ls->last];
+		instr[1] = ls->cpus[k].ram[(byte)(ls->last + 1)];
+		printf("%-8s at %02X: %s\n", ls->eng[k]->name, ls->last,
+				strchr(disasm_dis(instr, 2, NO_PREF)[0], '>') + 1);
+	}
+	
+	printf("         MAR IAR IR  C A E Z  R0 R1 R2 R3  SEL IVEC IIAR IFL ISEL IRQ PEND TAS WAIT\n");
+	print_row(ls->eng[0]->name, x);
+	print_row(ls->eng[1]->name, y);
+	
+	if (x->icount != y->icount || x->tmr_period != y->tmr_period || x->dirty != y->dirty)
+	{
+		printf("%-8s icount %lu, timer period %lu, dirty %04X\n",
+				ls->eng[0]->name, x->icount, x->tmr_period, x->dirty);
+		printf("%-8s icount %lu, timer period %lu, dirty %04X\n",
+				ls->eng[1]->name, y->icount, y->tmr_period, y->dirty);
+	}
+	
+	for (i = 0; i < RAM_S; ++i)
+	{
+		if (x->ram[i] != y->ram[i])
+			printf("ram %02X: %s %02X, %s %02X\n", i, ls->eng[0]->name, x->ram[i],
+					ls->eng[1]->name, y->ram[i]);
+	}
+	
+	if (x->digest != y->digest && memcmp(x->ram, y->ram, RAM_S) == 0)
+		printf("the ram is the same but the digests are not\n");
+	
+	return;
+}
+
+void print_row(const char * name, const jcpu * cpu)
+{
+	/* the registers and the built-in devices of cpu */
+	printf("%-8s  %02X  %02X %02X  %d %d %d %d  %02X %02X %02X %02X   %02X   %02X   %02X  %02X   %02X"
+			"   %d    %d  %02X    %d\n",
+			name, cpu->regs[MAR], cpu->regs[IAR], cpu->regs[IR], cpu->regs[CF],
+			cpu->regs[AF], cpu->regs[EF], cpu->regs[ZF], cpu->regs[R0], cpu->regs[R1],
+			cpu->regs[R2], cpu->regs[R3], cpu->io_sel, cpu->ivec, cpu->iiar, cpu->iflags,
+			cpu->isel, cpu->in_irq, cpu->irq_pend, cpu->tas_addr, cpu->wait);
+	return;
+}
+
+int read_code(const char * fname, byte * code)
+{
+	/* read a binary in code
+	 * return its size or -1 */
+	FILE * fp = efopen(fname);
+	int size = fsize(fp);
+	
+	if (size > RAM_S)
+		size = RAM_S;
+	
+	if (size <= 0 || fread(code, size, 1, fp) != 1)
+	{
+		fprintf(stderr, "Err: \"%s\" is either empty or a reading error has occured\n",
+				fname);
+		size = -1;
+	}
+	
+	fclose(fp);
+	return size;
+}
+
+FILE * efopen(const char * fname)
+{
+	/* open a file or die with an error */
+	FILE * fp;
+	
+	if ( (fp = fopen(fname, "rb")) == NULL)
+	{
+		fprintf(stderr, "Err: could not open file \"%s\"\n", fname);
+		exit(EXIT_FAILURE);
+	}
+	
+	return fp;
+}
+
+int fsize(FILE * fp)
+{
+	/* get file size for opened file */
+	int size;
+	
+	if (fseek(fp, 0L, SEEK_END) != 0)
+		return -1;
+	
+	size = ftell(fp);
+	rewind(fp);
+	
+	return size;
+}
+
+unsigned long num_arg(int argc, char * argv[], int * argn)
+{
+	/* read the number after the option at *argn
+	 * die if there isn't one */
+	unsigned long num;
+	char * end;
+	
+	if (*argn + 1 >= argc)
+	{
+		fprintf(stderr, "Err: \"%s\" should be followed by a number\n", argv[*argn]);
+		exit(EXIT_FAILURE);
+	}
+	
+	++*argn;
+	num = strtoul(argv[*argn], &end, 0);
+	if (*end != '\0' || DASH == argv[*argn][0])
+	{
+		fprintf(stderr, "Err: \"%s\" is not a number\n", argv[*argn]);
+		exit(EXIT_FAILURE);
+	}
+	
+	return num;
+}
+
+double now(void)
+{
+	/* wall clock seconds for timing the run */
+#ifdef WINDOWS
+	return GetTickCount() / 1000.0;
+#else
+	struct timespec ts;
+	
+	clock_gettime(CLOCK_MONOTONIC, &ts);
+	return ts.tv_sec + ts.tv_nsec / 1e9;
+#endif
+}
+
+void print_help(void)
+{
+	/* show help */
+	const lock_eng * eng;
+	
+	printf("Run:     %s <file name>... [%c%c <engine>] [%c%c <engine>] [%c%c <every>] "
+			"[%c%c <steps>]\n", exenm, DASH, ENG_A, DASH, ENG_B, DASH, EVERY, DASH, STEPS);
+	printf("Version: %s %c%c\n", exenm, DASH, VERS);
+	printf("Help:    %s %c%c\n", exenm, DASH, HELP);
+	printf("\nRuns each program on engine %c%c and engine %c%c side by side for <steps>\n",
+			DASH, ENG_A, DASH, ENG_B);
+	printf("instructions (default %d), or until it halts. The whole state of both is\n",
+			LOCK_STEPS);
+	printf("compared after every instruction, or with %c%c after every <every> with the\n",
+			DASH, EVERY);
+	printf("ram compared by its digest, which is much faster. Where they differ, both\n");
+	printf("go back and run again one instruction at a time. The first program on which\n");
+	printf("the engines don't agree is printed with both states and nothing more is run.\n");
+	printf("The engines are:");
+	for (eng = lock_engs; eng->name != NULL; ++eng)
+		printf(" %s", eng->name);
+	printf("; %s and %s by default.\n", lock_engs[0].name, lock_engs[1].name);
+	return;
+}
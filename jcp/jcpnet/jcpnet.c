@@ -0,0 +1,476 @@
+/* jcpnet.c -- runs a network of jcpu nodes */
+/* ver. 1.01 */
+
+/* Reads a topology file describing nodes and the channels between
+ * them, runs the network on all host cores, and prints how every node
+ * ended up along with the throughput. Can record the input every node
+ * gets from its channels, and play it back to the nodes without them. */
+
+/* Author: Vladimir Dinev */
+#include "../os_def.h"
+#include <stdio.h>
+#include <stdlib.h>
+#include <string.h>
+#include <ctype.h>
+#include <time.h>
+#ifndef WINDOWS
+#include <unistd.h>
+#endif
+#include "../net.h"
+
+#define MAX_CODE	256		// a node's program is no more than 256 bytes
+#define LINE_SZ		512		// the longest line in the topology file
+#define DASH		'-'		// command line arguments begin with -
+#define VERS		'v'		// print version info
+#define HELP		'h'		// print help
+#define THRDS		't'		// number of threads
+#define STEPS		'n'		// maximum instructions per node
+#define SUMM		's'		// print only the summary
+#define RECORD		'r'		// record the input of the nodes in a file
+#define PLAY		'p'		// play the input of the nodes back from a file
+#define COMMENT		'#'		// comments in the topology start with #
+#define NET_STEPS	1000000	// default maximum instructions per node
+#define print_use()	printf("Use:  %s <topology file> [%c%c <threads>] [%c%c <steps>] [%c%c] " \
+						"[%c%c <recording> | %c%c <recording>]\n", \
+						exenm, DASH, THRDS, DASH, STEPS, DASH, SUMM, DASH, RECORD, DASH, PLAY)
+#define help_opt()	printf("Help: %s %c%c\n", exenm, DASH, HELP)
+
+char exenm[] = "jcpnet";	// executable name
+char ver[] = "v1.01";		// executable version
+
+FILE * efopen(const char * fname, const char * mode);
+int fsize(FILE * fp);
+int read_code(const char * fname, byte * code);
+int read_topology(const char * fname, net * nw, int * nnodes);
+replay_log * load_logs(const char * fname, int nnodes);
+int save_logs(const char * fname, const net * nw, replay_log * logs, int nnodes);
+unsigned long num_arg(int argc, char * argv[], int * argn);
+int host_cores(void);
+double now(void);
+void print_help(void);
+
+int main(int argc, char * argv[])
+{
+	/* parse command line
+	 * build the network
+	 * run it and print the result */
+	char * fin = NULL, * frec = NULL, * fplay = NULL;
+	replay_log * logs = NULL;
+	int i, nnodes, nthreads = host_cores();
+	int summary = 0;
+	unsigned long steps = NET_STEPS;
+	
+	for (i = 1; i < argc; ++i)
+	{
+		if (DASH != argv[i][0] && NULL == fin)
+		{
+			fin = argv[i];
+			continue;
+		}
+		
+		switch ((DASH == argv[i][0]) ? argv[i][1] : '\0')
+		{
+			case HELP:
+				print_help();
+				return -1;
+			case VERS:
+				printf("%s %s\n", exenm, ver);
+				return -1;
+			case THRDS:
+				nthreads = num_arg(argc, argv, &i);
+				break;
+			case STEPS:
+				steps = num_arg(argc, argv, &i);
+				break;
+			case SUMM:
+				summary = 1;
+				break;
+			case RECORD:
+			case PLAY:
+				if (i + 1 >= argc)
+				{
+					fprintf(stderr, "Err: %c%c needs a file name\n", DASH, argv[i][1]);
+					return -1;
+				}
+				
+				if (RECORD == argv[i][1])
+					frec = argv[++i];
+				else
+					fplay = argv[++i];
+				break;
+			default:
+				fprintf(stderr, "Err: unrecognized argument \"%s\"\n", argv[i]);
+				print_use();
+				help_opt();
+				return -1;
+		}
+	}
+	
+	if (NULL == fin || (frec != NULL && fplay != NULL))
+	{
+		print_use();
+		help_opt();
+		return -1;
+	}
+	
+	// first pass counts the nodes, second one builds the network
+	if (read_topology(fin, NULL, &nnodes) != 0)
+		return -1;
+	
+	net * nw = net_new(nnodes);
+	if (NULL == nw)
+	{
+		fprintf(stderr, "Err: could not make a network of %d nodes\n", nnodes);
+		return -1;
+	}
+	
+	if (read_topology(fin, nw, &nnodes) != 0)
+	{
+		net_free(nw);
+		return -1;
+	}
+	
+	if (fplay != NULL)
+		logs = load_logs(fplay, nnodes);
+	else if (frec != NULL && (logs = calloc(nnodes, sizeof(*logs))) == NULL)
+		fprintf(stderr, "Err: out of memory\n");
+	
+	if ((fplay != NULL || frec != NULL) && NULL == logs)
+	{
+		net_free(nw);
+		return -1;
+	}
+	
+	if (frec != NULL)
+		net_record(nw, logs);
+	
+	double start = now();
+	if (fplay != NULL)
+		net_play(nw, logs, nthreads);
+	else if (net_run(nw, nthreads, steps) != 0)
+	{
+		fprintf(stderr, "Err: could not start the threads\n");
+		replay_free(logs, (logs != NULL) ? nnodes : 0);
+		net_free(nw);
+		return -1;
+	}
+	double secs = now() - start;
+	
+	static const char * state_str[] = {"halted", "blocked", "stopped"};
+	int count[3] = {0};
+	unsigned long total = 0;
+	const jcpu * cpu;
+	
+	if (!summary)
+		printf("node IAR IR  C A E Z  R0 R1 R2 R3  instructions state\n");
+	
+	for (i = 0; i < nnodes; ++i)
+	{
+		cpu = net_cpu(nw, i);
+		total += cpu->icount;
+		++count[net_state(nw, i)];
+		
+		if (!summary)
+		{
+			printf("%4d  %02X %02X  %d %d %d %d  %02X %02X %02X %02X  %12lu %s\n", i,
+				cpu->regs[IAR], cpu->regs[IR],
+				cpu->regs[CF], cpu->regs[AF], cpu->regs[EF], cpu->regs[ZF],
+				cpu->regs[R0], cpu->regs[R1], cpu->regs[R2], cpu->regs[R3],
+				cpu->icount, state_str[net_state(nw, i)]);
+		}
+	}
+	
+	printf("%d nodes: %d halted, %d blocked, %d stopped\n", nnodes,
+			count[NET_HALTED], count[NET_BLOCKED], count[NET_STOPPED]);
+	printf("%lu instructions in %.3f s on %d threads, %.2f MIPS\n", total, secs,
+			nthreads, (secs > 0) ? total / secs / 1e6 : 0.0);
+	
+	int res = (count[NET_HALTED] == nnodes) ? 0 : 1;
+	
+	for (i = 0; fplay != NULL && i < nnodes; ++i)
+	{
+		if (logs[i].failed)
+		{
+			fprintf(stderr, "Err: node %d went another way than recorded at instruction %lu\n",
+					i, net_cpu(nw, i)->icount);
+			res = -1;
+		}
+	}
+	
+	if (frec != NULL && save_logs(frec, nw, logs, nnodes) != 0)
+		res = -1;
+	
+	replay_free(logs, (logs != NULL) ? nnodes : 0);
+	net_free(nw);
+	return res;
+}
+
+replay_log * load_logs(const char * fname, int nnodes)
+{
+	/* read the recording of a network of nnodes nodes */
+	FILE * fp = efopen(fname, "rb");
+	int nlogs = 0;
+	replay_log * logs = replay_read(fp, &nlogs);
+	
+	fclose(fp);
+	if (NULL == logs || nlogs != nnodes)
+	{
+		fprintf(stderr, "Err: \"%s\" is not a version %d recording of %d nodes\n", fname,
+				REPLAY_VER, nnodes);
+		replay_free(logs, (logs != NULL) ? nlogs : 0);
+		return NULL;
+	}
+	
+	return logs;
+}
+
+int save_logs(const char * fname, const net * nw, replay_log * logs, int nnodes)
+{
+	/* write the recording with where every node ended up */
+	FILE * fp;
+	int i, res = 0;
+	
+	for (i = 0; i < nnodes; ++i)
+	{
+		if (logs[i].failed)
+		{
+			fprintf(stderr, "Err: out of memory recording node %d\n", i);
+			return -1;
+		}
+		
+		logs[i].end = net_cpu(nw, i)->icount;
+		logs[i].state = net_state(nw, i);
+	}
+	
+	if ((fp = fopen(fname, "wb")) == NULL)
+	{
+		fprintf(stderr, "Err: could not open file \"%s\"\n", fname);
+		return -1;
+	}
+	
+	if (replay_write(fp, logs, nnodes) != 0)
+		res = -1;
+	if (fclose(fp) != 0)
+		res = -1;
+	
+	if (res != 0)
+		fprintf(stderr, "Err: could not write \"%s\"\n", fname);
+	
+	return res;
+}
+
+int read_topology(const char * fname, net * nw, int * nnodes)
+{
+	/* go through the topology file
+	 * if nw is NULL, only count the nodes */
+	static byte code[MAX_CODE];
+	char line[LINE_SZ], cmd[LINE_SZ], arg[LINE_SZ];
+	int lineno, count, from, to, last, csize, i, n;
+	unsigned int out_port, in_port, cap;
+	char * ch;
+	FILE * fp = efopen(fname, "r");
+	
+	*nnodes = 0;
+	for (lineno = 1; fgets(line, LINE_SZ, fp) != NULL; ++lineno)
+	{
+		if ((ch = strchr(line, COMMENT)) != NULL)
+			*ch = '\0';
+		
+		if (sscanf(line, "%s", cmd) != 1)
+			continue;
+		
+		cap = NET_CHAN_CAP;
+		if (strcmp(cmd, "node") == 0)
+		{
+			if (sscanf(line, "%*s %d %s", &count, arg) != 2 || count < 1)
+				goto synerr;
+			
+			if (nw != NULL)
+			{
+				if ((csize = read_code(arg, code)) < 0)
+					goto err;
+				
+				for (i = *nnodes; i < *nnodes + count; ++i)
+					net_load(nw, i, code, csize);
+			}
+			
+			*nnodes += count;
+		}
+		else if (strcmp(cmd, "chan") == 0)
+		{
+			n = sscanf(line, "%*s %d %u %d %u %u", &from, &out_port, &to, &in_port, &cap);
+			if (n < 4 || out_port > 0xFF || in_port > 0xFF)
+				goto synerr;
+			
+			if (nw != NULL && net_chan(nw, from, out_port, to, in_port, cap) != 0)
+				goto chanerr;
+		}
+		else if (strcmp(cmd, "pipe") == 0)
+		{
+			// node i's out_port to node i+1's in_port, first <= i < last
+			n = sscanf(line, "%*s %d %d %u %u %u", &from, &last, &out_port, &in_port, &cap);
+			if (n < 4 || out_port > 0xFF || in_port > 0xFF || last <= from)
+				goto synerr;
+			
+			for (i = from; nw != NULL && i < last; ++i)
+			{
+				if (net_chan(nw, i, out_port, i + 1, in_port, cap) != 0)
+					goto chanerr;
+			}
+		}
+		else
+			goto synerr;
+	}
+	
+	fclose(fp);
+	if (0 == *nnodes)
+	{
+		fprintf(stderr, "Err: \"%s\" has no nodes\n", fname);
+		return -1;
+	}
+	
+	return 0;
+
+synerr:
+	fprintf(stderr, "Err: line %d: bad topology line < %s >\n", lineno, cmd);
+	goto err;
+chanerr:
+	fprintf(stderr, "Err: line %d: bad node or port, or the port is already connected\n",
+			lineno);
+err:
+	fclose(fp);
+	return -1;
+}
+
+int read_code(const char * fname, byte * code)
+{
+	/* read a binary in code
+	 * return its size or -1 */
+	FILE * fp = efopen(fname, "rb");
+	int size = fsize(fp);
+	
+	if (size > MAX_CODE)
+		size = MAX_CODE;
+	
+	if (size <= 0 || fread(code, size, 1, fp) != 1)
+	{
+		fprintf(stderr, "Err: \"%s\" is either empty or a reading error has occured\n",
+				fname);
+		size = -1;
+	}
+	
+	fclose(fp);
+	return size;
+}
+
+FILE * efopen(const char * fname, const char * mode)
+{
+	/* open a file or die with an error */
+	FILE * fp;
+	
+	if ( (fp = fopen(fname, mode)) == NULL)
+	{
+		fprintf(stderr, "Err: could not open file \"%s\"\n", fname);
+		exit(EXIT_FAILURE);
+	}
+	
+	return fp;
+}
+
+int fsize(FILE * fp)
+{
+	/* get file size for opened file */
+	int size;
+	
+	if (fseek(fp, 0L, SEEK_END) != 0)
+		return -1;
+	
+	size = ftell(fp);
+	rewind(fp);
+	
+	return size;
+}
+
+unsigned long num_arg(int argc, char * argv[], int * argn)
+{
+	/* read the number after the option at *argn
+	 * die if there isn't one */
+	unsigned long num;
+	char * end;
+	
+	if (*argn + 1 >= argc)
+	{
+		fprintf(stderr, "Err: \"%s\" should be followed by a number\n", argv[*argn]);
+		exit(EXIT_FAILURE);
+	}
+	
+	++*argn;
+	num = strtoul(argv[*argn], &end, 0);
+	if (*end != '\0' || DASH == argv[*argn][0])
+	{
+		fprintf(stderr, "Err: \"%s\" is not a number\n", argv[*argn]);
+		exit(EXIT_FAILURE);
+	}
+	
+	return num;
+}
+
+int host_cores(void)
+{
+	/* how many cores the host has */
+#ifdef WINDOWS
+	SYSTEM_INFO si;
+	
+	GetSystemInfo(&si);
+	return si.dwNumberOfProcessors;
+#else
+	long n = sysconf(_SC_NPROCESSORS_ONLN);
+	
+	return (n > 0) ? n : 1;
+#endif
+}
+
+double now(void)
+{
+	/* wall clock seconds for timing the run */
+#ifdef WINDOWS
+	return GetTickCount() / 1000.0;
+#else
+	struct timespec ts;
+	
+	clock_gettime(CLOCK_MONOTONIC, &ts);
+	return ts.tv_sec + ts.tv_nsec / 1e9;
+#endif
+}
+
+void print_help(void)
+{
+	/* show help */
+	printf("Run:     %s <topology file> [%c%c <threads>] [%c%c <steps>] [%c%c]\n",
+			exenm, DASH, THRDS, DASH, STEPS, DASH, SUMM);
+	printf("Record:  %s <topology file> %c%c <recording> [options]\n", exenm, DASH, RECORD);
+	printf("Play:    %s <topology file> %c%c <recording> [options]\n", exenm, DASH, PLAY);
+	printf("Version: %s %c%c\n", exenm, DASH, VERS);
+	printf("Help:    %s %c%c\n", exenm, DASH, HELP);
+	printf("\nRuns every node until it halts, waits forever on a channel, or\n");
+	printf("executes <steps> instructions (default %d). <threads> defaults to the\n",
+			NET_STEPS);
+	printf("number of host cores. %c%c prints only the summary.\n", DASH, SUMM);
+	printf("\n%c%c writes every byte the nodes read from their channels to <recording>,\n",
+			DASH, RECORD);
+	printf("with the instruction it was read at and how many times the node had to\n");
+	printf("wait for it. %c%c runs every node on its own with those bytes instead of\n",
+			DASH, PLAY);
+	printf("the channels, as far as it got when recorded, and prints the same. Nodes\n");
+	printf("which go another way are errors.\n");
+	printf("\nTopology file lines:\n");
+	printf("node <count> <binary>                         - add count nodes running binary\n");
+	printf("chan <from> <out port> <to> <in port> [size]  - connect two nodes\n");
+	printf("pipe <first> <last> <out port> <in port> [size]\n");
+	printf("    - connect every node from first to last to the next one\n");
+	printf("Nodes are numbered from 0 in order. Ports start from %d. Channels hold\n",
+			PORT_LOCAL);
+	printf("%d bytes unless size says otherwise. Comments start with '%c'.\n",
+			NET_CHAN_CAP, COMMENT);
+	return;
+}
@@ -0,0 +1,710 @@
+/* jcprun.c -- runs a jcpu program on many inputs */
+/* ver. 1.03 */
+
+/* Reads a binary and a file of input patches, one run per line, runs
+ * the binary once for every line on all host cores, and prints the final
+ * state of every run in the order of the lines, along with the throughput.
+ * Can also try every value of one or two input bytes, without a patch file.
+ * Runs done before can be taken from a cache file instead. */
+
+/* Author: Vladimir Dinev */
+#include "../os_def.h"
+#include <stdio.h>
+#include <stdlib.h>
+#include <string.h>
+#include <ctype.h>
+#include <time.h>
+#ifndef WINDOWS
+#include <unistd.h>
+#endif
+#include "../batch.h"
+#include "../explore.h"
+#include "../cache.h"
+
+#define MAX_CODE	256		// a program is no more than 256 bytes
+#define LINE_SZ		1024	// the longest line in the patch file
+#define MAX_OUTS	16		// the most ram bytes to print per run
+#define DASH		'-'		// command line arguments begin with -
+#define VERS		'v'		// print version info
+#define HELP		'h'		// print help
+#define THRDS		't'		// number of threads
+#define STEPS		'n'		// maximum instructions per run
+#define SUMM		's'		// print only the summary
+#define OUTS		'o'		// a ram byte to print for every run
+#define EXPL		'e'		// an input byte to try every value of
+#define JSON		'j'		// print JSON instead of a table
+#define HEX			'x'		// print all of the ram of every run
+#define CACHE		'c'		// the cache file
+#define CSIZE		'm'		// the size of a new cache file in megabytes
+#define COMMENT		'#'		// comments in the patch file start with #
+#define RUN_STEPS	1000000	// default maximum instructions per run
+#define print_use()	printf("Use:  %s <binary> <patch file> [%c%c <threads>] [%c%c <steps>] " \
+						"[%c%c <address>]... [%c%c] [%c%c] [%c%c]\n" \
+						"      [%c%c <cache file> [%c%c <megabytes>]]\n" \
+						"      %s <binary> %c%c <input> [%c%c <input>] [options]\n", \
+						exenm, DASH, THRDS, DASH, STEPS, DASH, OUTS, DASH, SUMM, DASH, JSON, \
+						DASH, HEX, DASH, CACHE, DASH, CSIZE, exenm, DASH, EXPL, DASH, EXPL)
+#define help_opt()	printf("Help: %s %c%c\n", exenm, DASH, HELP)
+
+char exenm[] = "jcprun";	// executable name
+char ver[] = "v1.03";		// executable version
+
+// what to print for every run and the totals
+typedef struct report_ {
+	int summary;				// print only the totals
+	int json;					// print JSON
+	int hex;					// print all of the ram
+	byte outs[MAX_OUTS];		// the ram bytes to print
+	int nouts;					// how many
+	long count[BATCH_STOPPED + 1];	// runs by how they ended up
+	unsigned long total;		// instructions of all runs
+	unsigned long run;			// instructions of the runs not taken from the cache
+	long cached;				// runs taken from the cache
+	long printed;				// runs printed, to put a ',' between the JSON ones
+} report;
+
+FILE * efopen(const char * fname, const char * mode);
+int fsize(FILE * fp);
+int read_code(const char * fname, byte * code);
+long read_patches(const char * fname, batch_poke ** pokes, long ** first);
+int parse_poke(const char * tok, batch_poke * pk);
+int parse_where(const char * str, char ** end);
+int explore(const byte * code, int csize, const unsigned short * where, int nwhere,
+		int nthreads, unsigned long steps, report * rep);
+void print_run(void * ctx, long run, const batch_res * res);
+void print_head(const report * rep, const char * first, const char * key);
+void print_state(const report * rep, const batch_res * res, unsigned long icount);
+void print_json(const report * rep, const batch_res * res, unsigned long icount);
+void print_hex(const batch_res * res);
+unsigned long num_arg(int argc, char * argv[], int * argn);
+int host_cores(void);
+double now(void);
+void print_help(void);
+
+int main(int argc, char * argv[])
+{
+	/* parse command line
+	 * read the binary and the patches
+	 * run them and print the results */
+	static byte code[MAX_CODE];
+	static report rep;
+	static cache ch;
+	char * fbin = NULL, * fpatch = NULL, * fcache = NULL;
+	int i, csize, nthreads = host_cores();
+	unsigned long steps = RUN_STEPS, addr, cache_mb = CACHE_DEF_SIZE >> 20;
+	batch_poke * pokes;
+	long * first, nruns;
+	unsigned short where[EXPL_MAX_INS];
+	int nwhere = 0, w;
+	char * end;
+	
+	for (i = 1; i < argc; ++i)
+	{
+		if (DASH != argv[i][0] && (NULL == fbin || NULL == fpatch))
+		{
+			if (NULL == fbin)
+				fbin = argv[i];
+			else
+				fpatch = argv[i];
+			continue;
+		}
+		
+		switch ((DASH == argv[i][0]) ? argv[i][1] : '\0')
+		{
+			case HELP:
+				print_help();
+				return -1;
+			case VERS:
+				printf("%s %s\n", exenm, ver);
+				return -1;
+			case THRDS:
+				nthreads = num_arg(argc, argv, &i);
+				break;
+			case STEPS:
+				steps = num_arg(argc, argv, &i);
+				break;
+			case SUMM:
+				rep.summary = 1;
+				break;
+			case JSON:
+				rep.json = 1;
+				break;
+			case HEX:
+				rep.hex = 1;
+				break;
+			case CACHE:
+				if (++i >= argc)
+				{
+					fprintf(stderr, "Err: %c%c needs a file name\n", DASH, CACHE);
+					return -1;
+				}
+				fcache = argv[i];
+				break;
+			case CSIZE:
+				cache_mb = num_arg(argc, argv, &i);
+				break;
+			case OUTS:
+				if ((addr = num_arg(argc, argv, &i)) >= RAM_S || MAX_OUTS == rep.nouts)
+				{
+					fprintf(stderr, "Err: up to %d addresses below %d can be printed\n",
+							MAX_OUTS, RAM_S);
+					return -1;
+				}
+				rep.outs[rep.nouts++] = addr;
+				break;
+			case EXPL:
+				if (++i >= argc || (w = parse_where(argv[i], &end)) < 0 || *end != '\0' ||
+					EXPL_MAX_INS == nwhere)
+				{
+					fprintf(stderr, "Err: %c%c takes an address or r0 to r3, up to %d times\n",
+							DASH, EXPL, EXPL_MAX_INS);
+					return -1;
+				}
+				where[nwhere++] = w;
+				break;
+			default:
+				fprintf(stderr, "Err: unrecognized argument \"%s\"\n", argv[i]);
+				print_use();
+				help_opt();
+				return -1;
+		}
+	}
+	
+	if (NULL == fbin || (NULL == fpatch) == (0 == nwhere))
+	{
+		print_use();
+		help_opt();
+		return -1;
+	}
+	
+	if (nthreads < 1)
+		nthreads = 1;
+	if (nthreads > BATCH_MAX_THRDS)
+		nthreads = BATCH_MAX_THRDS;
+	
+	if (nwhere > 0)
+	{
+		if (fcache != NULL)
+		{
+			fprintf(stderr, "Err: %c%c works only with a patch file\n", DASH, CACHE);
+			return -1;
+		}
+		
+		if ((csize = read_code(fbin, code)) < 0)
+			return -1;
+		return explore(code, csize, where, nwhere, nthreads, steps, &rep);
+	}
+	
+	if ((csize = read_code(fbin, code)) < 0 ||
+		(nruns = read_patches(fpatch, &pokes, &first)) < 0)
+		return -1;
+	
+	if (fcache != NULL && cache_open(&ch, fcache, cache_mb << 20, code, csize, steps) != 0)
+	{
+		fprintf(stderr, "Err: could not open or make the cache file \"%s\"\n", fcache);
+		free(pokes);
+		free(first);
+		return -1;
+	}
+	
+	if (rep.json)
+		printf("{\n");
+	if (!rep.summary)
+		print_head(&rep, "run ", "runs");
+	
+	double start = now();
+	i = batch_run(code, csize, pokes, first, nruns, nthreads, steps,
+			(fcache != NULL) ? &ch : NULL, print_run, &rep);
+	double secs = now() - start;
+	
+	if (fcache != NULL)
+		cache_close(&ch);
+	
+	if (i != 0)
+	{
+		fprintf(stderr, "Err: out of memory\n");
+		free(pokes);
+		free(first);
+		return -1;
+	}
+	
+	// the timing differs from run to run, so it stays out of the JSON
+	if (rep.json)
+	{
+		printf("%s\"summary\": {\"runs\": %ld, \"halted\": %ld, \"stopped\": %ld, "
+				"\"icount\": %lu}\n}\n", rep.summary ? "" : "\n],\n", nruns,
+				rep.count[BATCH_HALTED], rep.count[BATCH_STOPPED], rep.total);
+	}
+	else
+	{
+		printf("%ld runs: %ld halted, %ld stopped\n", nruns,
+				rep.count[BATCH_HALTED], rep.count[BATCH_STOPPED]);
+	}
+	
+	if (fcache != NULL)
+	{
+		fprintf(rep.json ? stderr : stdout, "%ld runs taken from the cache, %ld run\n",
+				rep.cached, nruns - rep.cached);
+	}
+	
+	fprintf(rep.json ? stderr : stdout, "%lu instructions in %.3f s on %d threads, "
+			"%.2f MIPS\n", rep.run, secs, nthreads, (secs > 0) ? rep.run / secs / 1e6 : 0.0);
+	fprintf(rep.json ? stderr : stdout, "%.0f runs per second, %.3f us per run\n",
+			(secs > 0) ? nruns / secs : 0.0, (nruns > 0) ? secs * 1e6 / nruns : 0.0);
+	
+	free(pokes);
+	free(first);
+	return (rep.count[BATCH_HALTED] == nruns) ? 0 : 1;
+}
+
+void print_run(void * ctx, long run, const batch_res * res)
+{
+	/* count a run and print it */
+	report * rep = ctx;
+	
+	++rep->count[res->state];
+	rep->total += res->icount;
+	if (res->cached)
+		++rep->cached;
+	else
+		rep->run += res->icount;
+	if (rep->summary)
+		return;
+	
+	if (rep->json)
+		printf("%s{\"run\": %ld, ", (rep->printed++ > 0) ? ",\n" : "", run);
+	else
+		printf("%3ld  ", run);
+	print_state(rep, res, res->icount);
+	return;
+}
+
+int explore(const byte * code, int csize, const unsigned short * where, int nwhere,
+		int nthreads, unsigned long steps, report * rep)
+{
+	/* run code on every value of the inputs
+	 * print what every input value does, or only the distinct outcomes */
+	expl_res res;
+	long i, n;
+	int digits = 2 * nwhere;
+	char head[16];
+	
+	double start = now();
+	if (expl_run(code, csize, where, nwhere, nthreads, steps, &res) != 0)
+	{
+		fprintf(stderr, "Err: out of memory\n");
+		return -1;
+	}
+	double secs = now() - start;
+	
+	if (rep->json)
+		printf("{\n");
+	
+	if (!rep->summary)
+	{
+		sprintf(head, "%-*s out ", digits, "in");
+		print_head(rep, head, "inputs");
+		for (i = 0; i < res.ninputs; ++i)
+		{
+			if (rep->json)
+				printf("%s{\"in\": %ld, \"out\": %ld, ", (i > 0) ? ",\n" : "", i, res.outcome[i]);
+			else
+				printf("%0*lX %4ld  ", digits, i, res.outcome[i]);
+			print_state(rep, &res.outs[res.outcome[i]], res.icount[i]);
+		}
+	}
+	else
+	{
+		// every outcome with the first input value which ends up in it
+		sprintf(head, " out inputs %-*s", digits, "in");
+		print_head(rep, head, "outcomes");
+		for (n = i = 0; n < res.nouts; ++i)
+		{
+			if (res.outcome[i] != n)
+				continue;
+			
+			if (rep->json)
+				printf("%s{\"out\": %ld, \"inputs\": %ld, \"in\": %ld, ", (n > 0) ? ",\n" : "",
+						n, res.count[n], i);
+			else
+				printf("%4ld %6ld %0*lX  ", n, res.count[n], digits, i);
+			print_state(rep, &res.outs[n], res.icount[i]);
+			++n;
+		}
+	}
+	
+	for (n = 0; n < res.nouts; ++n)
+		rep->count[res.outs[n].state] += res.count[n];
+	
+	if (rep->json)
+	{
+		printf("\n],\n\"summary\": {\"inputs\": %ld, \"halted\": %ld, \"stopped\": %ld, "
+				"\"outcomes\": %ld, \"run\": %lu, \"icount\": %lu, \"merged\": %ld}\n}\n",
+				res.ninputs, rep->count[BATCH_HALTED], rep->count[BATCH_STOPPED], res.nouts,
+				res.run, res.total, res.merged);
+	}
+	else
+	{
+		printf("%ld inputs: %ld halted, %ld stopped, %ld distinct outcomes\n", res.ninputs,
+				rep->count[BATCH_HALTED], rep->count[BATCH_STOPPED], res.nouts);
+		printf("%lu instructions run for %lu, %ld machines merged on the way\n", res.run,
+				res.total, res.merged);
+	}
+	
+	fprintf(rep->json ? stderr : stdout, "%.3f s on %d threads, %.2f MIPS, %.2f MIPS "
+			"counting the merged ones\n", secs, nthreads,
+			(secs > 0) ? res.run / secs / 1e6 : 0.0, (secs > 0) ? res.total / secs / 1e6 : 0.0);
+	
+	i = rep->count[BATCH_HALTED];
+	n = res.ninputs;
+	expl_free(&res);
+	return (i == n) ? 0 : 1;
+}
+
+void print_head(const report * rep, const char * first, const char * key)
+{
+	/* the column names of the table, or the start of the JSON array
+	 * first names the columns before the state, key the array */
+	if (rep->json)
+		printf("\"%s\": [\n", key);
+	else
+	{
+		printf("%s IAR IR  C A E Z  R0 R1 R2 R3  instructions state%s\n", first,
+				(rep->nouts > 0) ? "    ram" : "");
+	}
+	
+	return;
+}
+
+void print_state(const report * rep, const batch_res * res, unsigned long icount)
+{
+	/* print the registers, icount, how it ended, and the ram bytes asked for
+	 * the whole ram goes after them if asked for */
+	static const char * state_str[] = {"halted", "stopped"};
+	int i;
+	
+	if (rep->json)
+	{
+		print_json(rep, res, icount);
+		return;
+	}
+	
+	printf("%02X %02X  %d %d %d %d  %02X %02X %02X %02X  %12lu %s",
+			res->regs[IAR], res->regs[IR],
+			res->regs[CF], res->regs[AF], res->regs[EF], res->regs[ZF],
+			res->regs[R0], res->regs[R1], res->regs[R2], res->regs[R3],
+			icount, state_str[res->state]);
+	
+	for (i = 0; i < rep->nouts; ++i)
+	{
+		// "halted" is a letter shorter than "stopped"
+		printf("%s %02X=%02X", (0 == i && BATCH_HALTED == res->state) ? " " : "",
+				rep->outs[i], res->ram[rep->outs[i]]);
+	}
+	
+	putchar('\n');
+	if (rep->hex)
+		print_hex(res);
+	return;
+}
+
+void print_json(const report * rep, const batch_res * res, unsigned long icount)
+{
+	/* the rest of the object of a run; the caller opens it
+	 * with the keys that say which run it is */
+	static const char * state_str[] = {"halted", "stopped"};
+	int i;
+	
+	printf("\"state\": \"%s\", \"icount\": %lu, "
+			"\"regs\": {\"MAR\": %d, \"IAR\": %d, \"IR\": %d, "
+			"\"R0\": %d, \"R1\": %d, \"R2\": %d, \"R3\": %d}, "
+			"\"flags\": {\"C\": %d, \"A\": %d, \"E\": %d, \"Z\": %d}, "
+			"\"digest\": \"%016llx\"",
+			state_str[res->state], icount,
+			res->regs[MAR], res->regs[IAR], res->regs[IR],
+			res->regs[R0], res->regs[R1], res->regs[R2], res->regs[R3],
+			res->regs[CF], res->regs[AF], res->regs[EF], res->regs[ZF],
+			(unsigned long long)res->digest);
+	
+	if (rep->nouts > 0)
+	{
+		printf(", \"bytes\": {");
+		for (i = 0; i < rep->nouts; ++i)
+			printf("%s\"%d\": %d", (i > 0) ? ", " : "", rep->outs[i], res->ram[rep->outs[i]]);
+		putchar('}');
+	}
+	
+	if (rep->hex)
+	{
+		printf(", \"ram\": \"");
+		for (i = 0; i < RAM_S; ++i)
+			printf("%02X", res->ram[i]);
+		putchar('"');
+	}
+	
+	printf("}");
+	return;
+}
+
+void print_hex(const batch_res * res)
+{
+	/* a hex dump of the ram, 16 bytes a line, and its digest */
+	int i;
+	
+	for (i = 0; i < RAM_S; ++i)
+		printf("%s%02X%s", (i % RAM_LINE_S) ? " " : "    ", res->ram[i],
+				(RAM_LINE_S - 1 == i % RAM_LINE_S) ? "\n" : "");
+	printf("    digest %016llx\n", (unsigned long long)res->digest);
+	return;
+}
+
+long read_patches(const char * fname, batch_poke ** pokes, long ** first)
+{
+	/* read a run from every line which isn't empty
+	 * return the number of runs or -1 */
+	char line[LINE_SZ];
+	char * ch, * tok;
+	long nruns = 0, npokes = 0, rcap = 64, pcap = 256;
+	int lineno;
+	void * p;
+	FILE * fp = efopen(fname, "r");
+	
+	*pokes = malloc(pcap * sizeof(**pokes));
+	*first = malloc(rcap * sizeof(**first));
+	if (NULL == *pokes || NULL == *first)
+		goto memerr;
+	
+	(*first)[0] = 0;
+	for (lineno = 1; fgets(line, LINE_SZ, fp) != NULL; ++lineno)
+	{
+		if ((ch = strchr(line, COMMENT)) != NULL)
+			*ch = '\0';
+		
+		if ((tok = strtok(line, " \t\r\n")) == NULL)
+			continue;
+		
+		for (; tok != NULL; tok = strtok(NULL, " \t\r\n"))
+		{
+			if (npokes == pcap)
+			{
+				if ((p = realloc(*pokes, (pcap *= 2) * sizeof(**pokes))) == NULL)
+					goto memerr;
+				*pokes = p;
+			}
+			
+			if (parse_poke(tok, &(*pokes)[npokes++]) != 0)
+			{
+				fprintf(stderr, "Err: line %d: bad patch < %s >\n", lineno, tok);
+				goto err;
+			}
+		}
+		
+		if (nruns + 2 > rcap)
+		{
+			if ((p = realloc(*first, (rcap *= 2) * sizeof(**first))) == NULL)
+				goto memerr;
+			*first = p;
+		}
+		(*first)[++nruns] = npokes;
+	}
+	
+	fclose(fp);
+	if (0 == nruns)
+	{
+		fprintf(stderr, "Err: \"%s\" has no patches\n", fname);
+		free(*pokes);
+		free(*first);
+		return -1;
+	}
+	
+	return nruns;
+
+memerr:
+	fprintf(stderr, "Err: out of memory\n");
+err:
+	fclose(fp);
+	free(*pokes);
+	free(*first);
+	return -1;
+}
+
+int parse_poke(const char * tok, batch_poke * pk)
+{
+	/* read <address>=<value> or r<n>=<value>
+	 * return 0 on success, -1 otherwise */
+	unsigned long val;
+	char * end;
+	int where;
+	
+	if ((where = parse_where(tok, &end)) < 0 || *end != '=')
+		return -1;
+	
+	tok = end + 1;
+	val = strtoul(tok, &end, 0);
+	if (end == tok || *end != '\0' || val > 0xFF)
+		return -1;
+	
+	pk->where = where;
+	pk->val = val;
+	return 0;
+}
+
+int parse_where(const char * str, char ** end)
+{
+	/* read an address or r<n> at the start of str; *end is set past it
+	 * return it like batch_poke.where, -1 if it's neither */
+	unsigned long addr;
+	
+	if ('r' == tolower(str[0]) && str[1] >= '0' && str[1] <= '3')
+	{
+		*end = (char *)str + 2;
+		return BATCH_REG(R0 + str[1] - '0');
+	}
+	
+	addr = strtoul(str, end, 0);
+	if (*end == str || addr >= RAM_S)
+		return -1;
+	
+	return addr;
+}
+
+int read_code(const char * fname, byte * code)
+{
+	/* read a binary in code
+	 * return its size or -1 */
+	FILE * fp = efopen(fname, "rb");
+	int size = fsize(fp);
+	
+	if (size > MAX_CODE)
+		size = MAX_CODE;
+	
+	if (size <= 0 || fread(code, size, 1, fp) != 1)
+	{
+		fprintf(stderr, "Err: \"%s\" is either empty or a reading error has occured\n",
+				fname);
+		size = -1;
+	}
+	
+	fclose(fp);
+	return size;
+}
+
+FILE * efopen(const char * fname, const char * mode)
+{
+	/* open a file or die with an error */
+	FILE * fp;
+	
+	if ( (fp = fopen(fname, mode)) == NULL)
+	{
+		fprintf(stderr, "Err: could not open file \"%s\"\n", fname);
+		exit(EXIT_FAILURE);
+	}
+	
+	return fp;
+}
+
+int fsize(FILE * fp)
+{
+	/* get file size for opened file */
+	int size;
+	
+	if (fseek(fp, 0L, SEEK_END) != 0)
+		return -1;
+	
+	size = ftell(fp);
+	rewind(fp);
+	
+	return size;
+}
+
+unsigned long num_arg(int argc, char * argv[], int * argn)
+{
+	/* read the number after the option at *argn
+	 * die if there isn't one */
+	unsigned long num;
+	char * end;
+	
+	if (*argn + 1 >= argc)
+	{
+		fprintf(stderr, "Err: \"%s\" should be followed by a number\n", argv[*argn]);
+		exit(EXIT_FAILURE);
+	}
+	
+	++*argn;
+	num = strtoul(argv[*argn], &end, 0);
+	if (*end != '\0' || DASH == argv[*argn][0])
+	{
+		fprintf(stderr, "Err: \"%s\" is not a number\n", argv[*argn]);
+		exit(EXIT_FAILURE);
+	}
+	
+	return num;
+}
+
+int host_cores(void)
+{
+	/* how many cores the host has */
+#ifdef WINDOWS
+	SYSTEM_INFO si;
+	
+	GetSystemInfo(&si);
+	return si.dwNumberOfProcessors;
+#else
+	long n = sysconf(_SC_NPROCESSORS_ONLN);
+	
+	return (n > 0) ? n : 1;
+#endif
+}
+
+double now(void)
+{
+	/* wall clock seconds for timing the run */
+#ifdef WINDOWS
+	return GetTickCount() / 1000.0;
+#else
+	struct timespec ts;
+	
+	clock_gettime(CLOCK_MONOTONIC, &ts);
+	return ts.tv_sec + ts.tv_nsec / 1e9;
+#endif
+}
+
+void print_help(void)
+{
+	/* show help */
+	printf("Run:     %s <binary> <patch file> [%c%c <threads>] [%c%c <steps>] "
+			"[%c%c <address>]... [%c%c]\n         [%c%c] [%c%c] [%c%c <cache file> [%c%c <megabytes>]]\n",
+			exenm, DASH, THRDS, DASH, STEPS, DASH, OUTS, DASH, SUMM, DASH, JSON, DASH, HEX,
+			DASH, CACHE, DASH, CSIZE);
+	printf("Explore: %s <binary> %c%c <input> [%c%c <input>] [options]\n",
+			exenm, DASH, EXPL, DASH, EXPL);
+	printf("Version: %s %c%c\n", exenm, DASH, VERS);
+	printf("Help:    %s %c%c\n", exenm, DASH, HELP);
+	printf("\nRuns <binary> once for every line of <patch file>, until it halts or\n");
+	printf("executes <steps> instructions (default %d). The results come out in\n",
+			RUN_STEPS);
+	printf("the order of the lines. <threads> defaults to the number of host cores.\n");
+	printf("%c%c prints the ram byte at <address> for every run; up to %d of them.\n",
+			DASH, OUTS, MAX_OUTS);
+	printf("%c%c prints only the summary.\n", DASH, SUMM);
+	printf("%c%c prints JSON instead of the table; the timing goes to stderr.\n", DASH, JSON);
+	printf("%c%c prints all of the ram of every run, and its digest.\n", DASH, HEX);
+	printf("%c%c takes the runs done before from <cache file>, and keeps the new ones\n",
+			DASH, CACHE);
+	printf("there. A new cache file is <megabytes> big (default %ld); the runs used\n",
+			CACHE_DEF_SIZE >> 20);
+	printf("the longest time ago make room for the new ones.\n");
+	printf("\nEvery line of the patch file is a run. It's a list of patches applied\n");
+	printf("to the loaded program before it starts:\n");
+	printf("<address>=<value>  - put value in the ram at address\n");
+	printf("r<n>=<value>       - put value in register r0 to r3\n");
+	printf("Numbers are decimal, or hex with 0x. Empty lines are skipped. Comments\n");
+	printf("start with '%c'.\n", COMMENT);
+	printf("\n%c%c runs <binary> for every value of an <input>, an address or r0 to r3,\n",
+			DASH, EXPL);
+	printf("instead of reading a patch file. Twice makes it every pair of values; the\n");
+	printf("first <input> is the high byte of the \"in\" column. Input values which\n");
+	printf("come to the same state are run as one from there on. \"out\" numbers the\n");
+	printf("distinct outcomes; with %c%c only those are printed.\n", DASH, SUMM);
+	return;
+}
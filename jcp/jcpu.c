@@ -1,299 +1,891 @@
 /* jcpu.c -- emulator for the John Clark Scott's computer from "But How Do It Know?" */
-/* ver.1.02 */
+/* ver.1.10 */
 
 /* This is an emulator of the computer from the book "But How Do It Know?"
- * by John Clark Scott. Internally airthmetic and logic is done with the C 
- * operators rather than by simulating the whole system and the flags are represented 
- * as separate registers. Externally, it behaves as you would expect from the book. */
+ * by John Clark Scott. Internally airthmetic and logic is done with the C
+ * operators rather than by simulating the whole system and the flags are represented
+ * as separate registers. Externally, it behaves as you would expect from the book.
+ * On top of that the cpu has a timer and an interrupt controller, which programs
+ * talk to through the book's IN/OUT instructions.
+ * All state belongs to a jcpu core object, so any number of cores can run at
+ * the same time. Cores may share their ram; ram is accessed with relaxed atomics,
+ * which cost nothing over plain loads and stores on the usual hosts. 
+ * Ports above the built-in ones go to a device attached by the host. When that
+ * device has to wait, the IN/OUT instruction is undone and the core says so.
+ * Next to the fast jcpu_step() there is jcpu_tick(), which goes through the
+ * book's stepper one clock cycle at a time, moving everything over the bus. It
+ * is slower, but it shows what happens inside an instruction and counts the
+ * cycles. Both decode the instructions with the same table.
+ * Every store marks its 16 byte line of the ram as dirty, so a reset only
+ * has to copy back the lines a program has touched. It also updates the
+ * digest of the ram: the old byte's hash goes out and the new one's comes in. */
 
 /* Author: Vladimir Dinev */
+#include <limits.h>
+#include <stddef.h>
+#include <string.h>
+#include <stdbool.h>
 #include "jcpu.h"
 #include "mach_code.h"
 
 #define RA			0x0C	// & 0x0C for reg a
 #define RB			0x03	// & 0x03 for reg b
 #define BYTE_MAX	0xFF	// max byte value
-#define get_ra_ir() (GREG_OFF + ((regs[IR] & RA) >> 2))	// get the index of reg a from IR
-#define get_rb_ir() (GREG_OFF + (regs[IR] & RB))		// get the index of reg b from IR
-#define get_instr()	(regs[IR] >> 4)						// get instruction nibble
-#define set_zf()	(regs[ZF] = (regs[rb] == 0))		// set the zero flag
-
-byte ram[RAM_S] = {0x00};		// the ram
-byte regs[NUM_REGS] = {0x00};	// the registers
-fpvv_t * func_arr; 				// pointer to a function pointer
-
-static void load(void);
-static void store(void);
-static void data(void);
-static void jmpr(void);
-static void jmp(void);
-static void jcond(void);
-static void clearf(void);
-static void dummy(void);
-static void add(void);
-static void shr(void);
-static void shl(void);
-static void not(void);
-static void and(void);
-static void or(void);
-static void xor(void);
-static void cmp(void);
-
-void jcpu_load(const byte * code, int csize)
-{
-	/* initialize the function array
-	 * load the code in ram */
-
-	// an array of void function pointers
-	static fpvv_t fa[INSTR_COUNT] = {	
-		load, store,
-		data,
-		jmpr, jmp, jcond,
-		clearf,
-		dummy,
-		add, shr, shl, not, and, or, xor, cmp
-	};
-		  
-	func_arr = fa;
-	
+#define get_ra_ir() (jcpu_dec_tab[cpu->regs[IR]].ra)		// get the index of reg a from IR
+#define get_rb_ir() (jcpu_dec_tab[cpu->regs[IR]].rb)		// get the index of reg b from IR
+#define get_instr()	(jcpu_dec_tab[cpu->regs[IR]].op)		// get instruction nibble
+#define set_zf()	(cpu->regs[ZF] = (cpu->regs[rb] == 0))		// set the zero flag
+#define get_flags()	((cpu->regs[CF] << 3) | (cpu->regs[AF] << 2) | \
+					(cpu->regs[EF] << 1) | cpu->regs[ZF])
+#define rd_ram(a)	__atomic_load_n(&cpu->ram[(a)], __ATOMIC_RELAXED)		// read shared ram
+#define mark(a)		(cpu->dirty |= 1 << line_of(a))							// mark a dirty line
+#define rehash(a,o,v)	(cpu->digest ^= zob((a), (o)) ^ zob((a), (v)))					// a digest store
+#define wr_ram(a,v)	(mark(a), rehash((a), rd_ram(a), (v)),								\
+					__atomic_store_n(&cpu->ram[(a)], (v), __ATOMIC_RELAXED))	// write shared ram
+#define TMR_OFF		ULONG_MAX	// countdown of a stopped timer
+#define TAS_SET		0x01		// test-and-set stores this
+#define FETCH_STEPS	3			// stepper steps of every fetch
+
+// stepper steps after the fetch; the stepper is reset after the last one
+#define EXEC_STEPS(i)	(	((i) >> 4) == JMPR || ((i) >> 4) == CLF ? 1 :				\
+							((i) >> 4) == IO ? (((i) & IO_OUT) ? 1 : 2) :				\
+							((i) >> 4) == LOAD || ((i) >> 4) == STORE ||				\
+							((i) >> 4) == JMP || ((i) >> 4) == CMP ? 2 : 3	)
+
+// decode a single instruction byte i; 4, 16, 64, and 256 of them in a row
+#define DEC(i)		{(i) >> 4, GREG_OFF + (((i) & RA) >> 2), GREG_OFF + ((i) & RB),	\
+					FETCH_STEPS + EXEC_STEPS(i)}
+#define DEC4(i)		DEC(i), DEC((i) + 1), DEC((i) + 2), DEC((i) + 3)
+#define DEC16(i)	DEC4(i), DEC4((i) + 4), DEC4((i) + 8), DEC4((i) + 12)
+#define DEC64(i)	DEC16(i), DEC16((i) + 16), DEC16((i) + 32), DEC16((i) + 48)
+
+const jcpu_dec jcpu_dec_tab[RAM_S] = {DEC64(0), DEC64(64), DEC64(128), DEC64(192)};
+
+static void power_on(jcpu * cpu);
+static uint64_t zob(byte addr, byte val);
+static void irq(jcpu * cpu);
+static void set_flags(jcpu * cpu, byte f);
+static int dev_in(jcpu * cpu, byte * val);
+static int dev_out(jcpu * cpu, byte val);
+static void exec_step(jcpu * cpu, const jcpu_dec * dec);
+static void alu(jcpu * cpu, const jcpu_dec * dec);
+
+static void load(jcpu * cpu);
+static void store(jcpu * cpu);
+static void data(jcpu * cpu);
+static void jmpr(jcpu * cpu);
+static void jmp(jcpu * cpu);
+static void jcond(jcpu * cpu);
+static void clearf(jcpu * cpu);
+static void io(jcpu * cpu);
+static void add(jcpu * cpu);
+static void shr(jcpu * cpu);
+static void shl(jcpu * cpu);
+static void not(jcpu * cpu);
+static void and(jcpu * cpu);
+static void or(jcpu * cpu);
+static void xor(jcpu * cpu);
+static void cmp(jcpu * cpu);
+
+// an array of core function pointers
+static const fpcv_t func_arr[INSTR_COUNT] = {
+	load, store,
+	data,
+	jmpr, jmp, jcond,
+	clearf,
+	io,
+	add, shr, shl, not, and, or, xor, cmp
+};
+
+void jcpu_init(jcpu * cpu, byte * ram, int core)
+{
+	/* zero out the registers
+	 * power on the timer and the interrupt controller */
+	memset(cpu, 0, sizeof(*cpu));
+	cpu->ram = ram;
+	cpu->core = core;
+	cpu->digest = jcpu_digest(ram);
+	cpu->snap_digest = jcpu_digest(cpu->snap);
+	power_on(cpu);
+	return;
+}
+
+void jcpu_load(jcpu * cpu, const byte * code, int csize)
+{
+	/* load the code in ram
+	 * keep a copy for reset */
 	int i;
 	
-	// zero out the RAM
+	if (csize > RAM_S)
+		csize = RAM_S;
+	
+	memset(cpu->snap, 0, RAM_S);
+	if (csize > 0)
+		memcpy(cpu->snap, code, csize);
+	
 	for (i = 0; i < RAM_S; ++i)
-		ram[i] = 0;
+		wr_ram(i, cpu->snap[i]);
 	
-	// load the code
-	for (i = 0; i <= BYTE_MAX && i < csize; ++i)
-		ram[i] = code[i];
+	cpu->dirty = 0;
+	cpu->icount = 0;
+	cpu->digest = cpu->snap_digest = jcpu_digest(cpu->snap);
+	return;
+}
+
+void jcpu_reset(jcpu * cpu)
+{
+	/* copy back only the dirty lines
+	 * clear everything up to the ram pointer */
+	unsigned int dirty = cpu->dirty;
+	int line;
+	
+	for (line = 0; dirty != 0; ++line, dirty >>= 1)
+	{
+		if (dirty & 1)
+			memcpy(cpu->ram + line * RAM_LINE_S, cpu->snap + line * RAM_LINE_S, RAM_LINE_S);
+	}
 	
+	memset(cpu, 0, offsetof(jcpu, ram));
+	cpu->dirty = 0;
+	cpu->digest = cpu->snap_digest;
+	power_on(cpu);
 	return;
 }
 
-void jcpu_step(void)
+void jcpu_step(jcpu * cpu)
 {
 	/* CPU cycle */
 	/* 1. move IAR to MAR
-	 * 2. set IR to the value at the MAR address 
-	 * 3. add one to IAR 
-	 * 4, 5, 6 execute instruction */		
-	regs[MAR] = regs[IAR];
-	regs[IR] = ram[regs[MAR]];
-	++regs[IAR];
-	func_arr[get_instr()]();
+	 * 2. set IR to the value at the MAR address
+	 * 3. add one to IAR
+	 * 4, 5, 6 execute instruction
+	 * the timer is a single countdown; it only
+	 * costs more when it runs out */
+	if (0 == --cpu->tmr_left)
+		irq(cpu);
+	
+	cpu->regs[MAR] = cpu->regs[IAR];
+	cpu->regs[IR] = rd_ram(cpu->regs[MAR]);
+	++cpu->regs[IAR];
+	func_arr[get_instr()](cpu);
+	++cpu->icount;
+	return;
+}
+
+bool jcpu_tick(jcpu * cpu)
+{
+	/* one clock cycle
+	 * 1. enable IAR, set MAR; bus 1 adds one to it in ACC
+	 * 2. enable RAM, set IR
+	 * 3. enable ACC, set IAR
+	 * 4, 5, 6 execute instruction
+	 * the timer counts down every cycle, but it can
+	 * only interrupt before a fetch */
+	cpu->stepper = true;
+	
+	switch (cpu->step)
+	{
+		case 1:
+			if (cpu->tmr_left <= 1)
+			{
+				irq(cpu);
+				if (cpu->tmr_left != TMR_OFF)
+					++cpu->tmr_left;
+			}
+			
+			cpu->bus = cpu->regs[IAR];
+			cpu->regs[MAR] = cpu->bus;
+			cpu->acc = cpu->bus + 1;
+			break;
+		case 2:
+			cpu->bus = rd_ram(cpu->regs[MAR]);
+			cpu->regs[IR] = cpu->bus;
+			break;
+		case 3:
+			cpu->bus = cpu->acc;
+			cpu->regs[IAR] = cpu->bus;
+			break;
+		default:
+			exec_step(cpu, &jcpu_dec_tab[cpu->regs[IR]]);
+			break;
+	}
+	
+	if (cpu->tmr_left > 1 && cpu->tmr_left != TMR_OFF)
+		--cpu->tmr_left;
+	++cpu->cycles;
+	
+	if (cpu->step < FETCH_STEPS || cpu->step < jcpu_dec_tab[cpu->regs[IR]].steps)
+	{
+		++cpu->step;
+		return false;
+	}
+	
+	cpu->step = 1;
+	++cpu->icount;
+	return true;
+}
+
+void jcpu_step_ticks(jcpu * cpu)
+{
+	/* tick until the instruction is done */
+	while (!jcpu_tick(cpu))
+		continue;
+	return;
+}
+
+void jcpu_attach(jcpu * cpu, const jcpu_dev * dev)
+{
+	/* connect the outside device */
+	cpu->dev = *dev;
+	return;
+}
+
+bool jcpu_halted(const jcpu * cpu)
+{
+	/* see if the next instruction is JMP to itself */
+	byte iar = cpu->regs[IAR];
+	
+	return ((JMP << 4) == rd_ram(iar) &&
+			rd_ram((byte)(iar + 1)) == iar);
+}
+
+void jcpu_save(const jcpu * cpu, jcpu_ckpt * ck)
+{
+	/* copy field by field; the checkpoint
+	 * layout doesn't change with jcpu's */
+	memset(ck, 0, sizeof(*ck));
+	memcpy(ck->magic, JCPU_CKPT_MAGIC, sizeof(ck->magic));
+	ck->version = JCPU_CKPT_VER;
+	ck->size = sizeof(*ck);
+	ck->icount = cpu->icount;
+	ck->cycles = cpu->cycles;
+	ck->tmr_left = (TMR_OFF == cpu->tmr_left) ? UINT64_MAX : cpu->tmr_left;
+	ck->tmr_period = cpu->tmr_period;
+	ck->dirty = cpu->dirty;
+	memcpy(ck->regs, cpu->regs, NUM_REGS);
+	ck->io_sel = cpu->io_sel;
+	ck->ivec = cpu->ivec;
+	ck->iiar = cpu->iiar;
+	ck->iflags = cpu->iflags;
+	ck->isel = cpu->isel;
+	ck->in_irq = cpu->in_irq;
+	ck->irq_pend = cpu->irq_pend;
+	ck->tas_addr = cpu->tas_addr;
+	ck->wait = cpu->wait;
+	ck->step = cpu->step;
+	ck->bus = cpu->bus;
+	ck->tmp = cpu->tmp;
+	ck->acc = cpu->acc;
+	ck->core = cpu->core;
+	ck->stepper = cpu->stepper;
+	memcpy(ck->ram, cpu->ram, RAM_S);
+	memcpy(ck->snap, cpu->snap, RAM_S);
+	return;
+}
+
+int jcpu_restore(jcpu * cpu, const jcpu_ckpt * ck)
+{
+	/* check the header
+	 * copy everything back */
+	if (memcmp(ck->magic, JCPU_CKPT_MAGIC, sizeof(ck->magic)) != 0 ||
+		ck->version != JCPU_CKPT_VER || ck->size != sizeof(*ck))
+		return -1;
+	
+	cpu->icount = ck->icount;
+	cpu->cycles = ck->cycles;
+	cpu->tmr_left = (UINT64_MAX == ck->tmr_left) ? TMR_OFF : ck->tmr_left;
+	cpu->tmr_period = ck->tmr_period;
+	cpu->dirty = ck->dirty;
+	memcpy(cpu->regs, ck->regs, NUM_REGS);
+	cpu->io_sel = ck->io_sel;
+	cpu->ivec = ck->ivec;
+	cpu->iiar = ck->iiar;
+	cpu->iflags = ck->iflags;
+	cpu->isel = ck->isel;
+	cpu->in_irq = ck->in_irq;
+	cpu->irq_pend = ck->irq_pend;
+	cpu->tas_addr = ck->tas_addr;
+	cpu->wait = ck->wait;
+	cpu->step = ck->step;
+	cpu->bus = ck->bus;
+	cpu->tmp = ck->tmp;
+	cpu->acc = ck->acc;
+	cpu->core = ck->core;
+	cpu->stepper = ck->stepper;
+	memcpy(cpu->ram, ck->ram, RAM_S);
+	memcpy(cpu->snap, ck->snap, RAM_S);
+	cpu->digest = jcpu_digest(cpu->ram);
+	cpu->snap_digest = jcpu_digest(cpu->snap);
+	return 0;
+}
+
+void jcpu_poke(jcpu * cpu, byte addr, byte val)
+{
+	/* a store from the host */
+	wr_ram(addr, val);
+	return;
+}
+
+uint64_t jcpu_digest(const byte * ram)
+{
+	/* the digest of the whole ram */
+	uint64_t d = 0;
+	int i;
+	
+	for (i = 0; i < RAM_S; ++i)
+		d ^= zob(i, __atomic_load_n(&ram[i], __ATOMIC_RELAXED));
+	
+	return d;
+}
+
+void jcpu_timer(jcpu * cpu, unsigned long period, byte vector)
+{
+	/* program the timer from the host
+	 * + 1 because the countdown happens before the next step */
+	cpu->ivec = vector;
+	cpu->tmr_period = period;
+	cpu->tmr_left = (period > 0 && period < TMR_OFF) ? period + 1 : TMR_OFF;
+	return;
+}
+
+static void power_on(jcpu * cpu)
+{
+	/* what isn't 0 after power on */
+	cpu->tmr_left = TMR_OFF;
+	cpu->step = 1;
 	return;
 }
 
-static void load(void)
+static uint64_t zob(byte addr, byte val)
+{
+	/* the hash of val at addr for the digest; splitmix64 of
+	 * the two, + 1 so a 0 at address 0 counts too */
+	uint64_t z = ((((uint64_t)addr << 8) | val) + 1) * 0x9E3779B97F4A7C15ULL;
+	
+	z = (z ^ (z >> 30)) * 0xBF58476D1CE4E5B9ULL;
+	z = (z ^ (z >> 27)) * 0x94D049BB133111EBULL;
+	return z ^ (z >> 31);
+}
+
+static void irq(jcpu * cpu)
+{
+	/* the timer ran out
+	 * reload it and jump to the interrupt vector, or remember
+	 * the interrupt if another one is being served */
+	if (0 == cpu->tmr_period)
+	{
+		cpu->tmr_left = TMR_OFF;
+		return;
+	}
+	
+	cpu->tmr_left = cpu->tmr_period;
+	
+	if (cpu->in_irq)
+	{
+		cpu->irq_pend = true;
+		return;
+	}
+	
+	cpu->iiar = cpu->regs[IAR];
+	cpu->iflags = get_flags();
+	cpu->isel = cpu->io_sel;
+	set_flags(cpu, 0);
+	cpu->in_irq = true;
+	cpu->regs[IAR] = cpu->ivec;
+	return;
+}
+
+static void set_flags(jcpu * cpu, byte f)
+{
+	/* unpack CAEZ from the right nibble of f */
+	cpu->regs[CF] = (f >> 3) & 1;
+	cpu->regs[AF] = (f >> 2) & 1;
+	cpu->regs[EF] = (f >> 1) & 1;
+	cpu->regs[ZF] = f & 1;
+	return;
+}
+
+static int dev_in(jcpu * cpu, byte * val)
+{
+	/* read from the selected device
+	 * unknown devices read as 0 */
+	switch (cpu->io_sel)
+	{
+		case PORT_NONE:
+			break;
+		case PORT_TIMER:
+			*val = (TMR_OFF == cpu->tmr_left || cpu->tmr_left > BYTE_MAX) ?
+					0 : cpu->tmr_left - 1;
+			return IO_DONE;
+		case PORT_IVEC:
+			*val = cpu->ivec;
+			return IO_DONE;
+		case PORT_IIAR:
+			*val = cpu->iiar;
+			return IO_DONE;
+		case PORT_IFLAGS:
+			*val = cpu->iflags;
+			return IO_DONE;
+		case PORT_CORE:
+			*val = cpu->core;
+			return IO_DONE;
+		case PORT_TASA:
+			*val = cpu->tas_addr;
+			return IO_DONE;
+		case PORT_TAS:
+			// the old value; 0 means the lock was taken by this core
+			mark(cpu->tas_addr);
+			*val = __atomic_exchange_n(&cpu->ram[cpu->tas_addr], TAS_SET, __ATOMIC_ACQ_REL);
+			rehash(cpu->tas_addr, *val, TAS_SET);
+			return IO_DONE;
+		default:
+			if (cpu->dev.in != NULL)
+				return cpu->dev.in(cpu->dev.ctx, cpu->io_sel, val);
+			break;
+	}
+	
+	*val = 0;
+	return IO_DONE;
+}
+
+static int dev_out(jcpu * cpu, byte val)
+{
+	/* write to the selected device
+	 * writes to unknown devices are lost */
+	switch (cpu->io_sel)
+	{
+		case PORT_NONE:
+			break;
+		case PORT_TIMER:
+			jcpu_timer(cpu, val, cpu->ivec);
+			break;
+		case PORT_IVEC:
+			cpu->ivec = val;
+			break;
+		case PORT_IIAR:
+			cpu->iiar = val;
+			break;
+		case PORT_IFLAGS:
+			cpu->iflags = val & 0x0F;
+			break;
+		case PORT_TASA:
+			cpu->tas_addr = val;
+			break;
+		case PORT_TAS:
+			// release; everything stored before is seen by the next owner
+			mark(cpu->tas_addr);
+			rehash(cpu->tas_addr, rd_ram(cpu->tas_addr), val);
+			__atomic_store_n(&cpu->ram[cpu->tas_addr], val, __ATOMIC_RELEASE);
+			break;
+		case PORT_CORE:
+			break;
+		default:
+			if (cpu->dev.out != NULL)
+				return cpu->dev.out(cpu->dev.ctx, cpu->io_sel, val);
+			break;
+	}
+	
+	return IO_DONE;
+}
+
+static void exec_step(jcpu * cpu, const jcpu_dec * dec)
+{
+	/* steps 4, 5, and 6 of the stepper
+	 * what is enabled on the bus, then what is set from it */
+	byte * regs = cpu->regs;
+	
+	switch (dec->op << 4 | cpu->step)
+	{
+		case LOAD << 4 | 4: case STORE << 4 | 4:	// enable RA, set MAR
+			cpu->bus = regs[dec->ra];
+			regs[MAR] = cpu->bus;
+			break;
+		case LOAD << 4 | 5:							// enable RAM, set RB
+			cpu->bus = rd_ram(regs[MAR]);
+			regs[dec->rb] = cpu->bus;
+			break;
+		case STORE << 4 | 5:						// enable RB, set RAM
+			cpu->bus = regs[dec->rb];
+			wr_ram(regs[MAR], cpu->bus);
+			break;
+		case DATA << 4 | 4: case JCOND << 4 | 4:	// enable IAR, set MAR; bus 1, set ACC
+			cpu->bus = regs[IAR];
+			regs[MAR] = cpu->bus;
+			cpu->acc = cpu->bus + 1;
+			break;
+		case DATA << 4 | 5:							// enable RAM, set RB
+			cpu->bus = rd_ram(regs[MAR]);
+			regs[dec->rb] = cpu->bus;
+			break;
+		case DATA << 4 | 6: case JCOND << 4 | 5:	// enable ACC, set IAR
+			cpu->bus = cpu->acc;
+			regs[IAR] = cpu->bus;
+			break;
+		case JCOND << 4 | 6:						// if a flag is on, enable RAM, set IAR
+			if (regs[IR] & get_flags())
+			{
+				cpu->bus = rd_ram(regs[MAR]);
+				regs[IAR] = cpu->bus;
+			}
+			break;
+		case JMPR << 4 | 4:							// enable RB, set IAR
+			cpu->bus = regs[dec->rb];
+			regs[IAR] = cpu->bus;
+			break;
+		case JMP << 4 | 4:							// enable IAR, set MAR
+			cpu->bus = regs[IAR];
+			regs[MAR] = cpu->bus;
+			break;
+		case JMP << 4 | 5:							// enable RAM, set IAR
+			cpu->bus = rd_ram(regs[MAR]);
+			regs[IAR] = cpu->bus;
+			break;
+		case CLF << 4 | 4:							// bus 1, set flags; or return
+			clearf(cpu);
+			break;
+		case IO << 4 | 4:							// OUT: enable RB, set I/O
+			if (regs[IR] & IO_OUT)
+			{
+				cpu->bus = regs[dec->rb];
+				io(cpu);
+			}
+			break;
+		case IO << 4 | 5:							// IN: enable I/O, set RB
+			io(cpu);
+			cpu->bus = regs[dec->rb];
+			break;
+		default:
+			alu(cpu, dec);
+			break;
+	}
+	
+	return;
+}
+
+static void alu(jcpu * cpu, const jcpu_dec * dec)
+{
+	/* the alu instructions
+	 * 4. enable RB, set TMP
+	 * 5. enable RA, set ACC and the flags
+	 * 6. enable ACC, set RB; not for CMP
+	 * the result and the flags are the same as the
+	 * fast instructions below give */
+	byte * regs = cpu->regs;
+	unsigned int a, b;
+	
+	switch (cpu->step)
+	{
+		case 4:
+			cpu->bus = regs[dec->rb];
+			cpu->tmp = cpu->bus;
+			return;
+		case 6:
+			cpu->bus = cpu->acc;
+			regs[dec->rb] = cpu->bus;
+			return;
+		default:
+			break;
+	}
+	
+	cpu->bus = regs[dec->ra];
+	a = cpu->bus;
+	b = cpu->tmp;
+	
+	switch (dec->op)
+	{
+		case ADD:
+			a += b + regs[CF];
+			cpu->acc = a;
+			regs[CF] = a > BYTE_MAX;
+			break;
+		case SHR:
+			cpu->acc = (a >> 1) | (regs[CF] << 7);
+			regs[CF] = a & 0x01;
+			break;
+		case SHL:
+			cpu->acc = (a << 1) | regs[CF];
+			regs[CF] = (a << 1) > BYTE_MAX;
+			break;
+		case NOT:
+			cpu->acc = ~a;
+			break;
+		case AND:
+			cpu->acc = a & b;
+			break;
+		case OR:
+			cpu->acc = a | b;
+			break;
+		case XOR:
+			cpu->acc = a ^ b;
+			break;
+		default:
+			regs[AF] = a > b;
+			regs[EF] = a == b;
+			return;
+	}
+	
+	regs[ZF] = (0 == cpu->acc);
+	return;
+}
+
+static void load(jcpu * cpu)
 {
 	/* LD RA, RB - loads RB from RAM address in RA
-	 * 4. place RA in MAR 
+	 * 4. place RA in MAR
 	 * 5. place value at address in MAR in RB */
-	regs[MAR] = regs[get_ra_ir()];
-	regs[get_rb_ir()] = ram[regs[MAR]];
+	cpu->regs[MAR] = cpu->regs[get_ra_ir()];
+	cpu->regs[get_rb_ir()] = rd_ram(cpu->regs[MAR]);
 	return;
 }
 
-static void store(void)
+static void store(jcpu * cpu)
 {
-	/* ST RA, RB - stores RB to RAM address in RA 
+	/* ST RA, RB - stores RB to RAM address in RA
 	 * 4. place RA in MAR
 	 * 5. place RB at address in MAR */
-	 regs[MAR] = regs[get_ra_ir()];
-	 ram[regs[MAR]] = regs[get_rb_ir()];
+	 cpu->regs[MAR] = cpu->regs[get_ra_ir()];
+	 wr_ram(cpu->regs[MAR], cpu->regs[get_rb_ir()]);
 	 return;
 }
 
-static void data(void)
+static void data(jcpu * cpu)
 {
 	/* DATA RB - loads next byte as data in RB
 	 * 4. send IAR to MAR
 	 * 5. set the register to the value at MAR
 	 * 6. add one to IAR */
-	regs[MAR] = regs[IAR];
-	regs[get_rb_ir()] = ram[regs[MAR]];
-	++regs[IAR];
+	cpu->regs[MAR] = cpu->regs[IAR];
+	cpu->regs[get_rb_ir()] = rd_ram(cpu->regs[MAR]);
+	++cpu->regs[IAR];
 	return;
 }
 
-static void jmpr(void)
+static void jmpr(jcpu * cpu)
 {
 	/* JMPR RB - jumps to address in RB
 	 * 4. set IAR to RB */
-	regs[IAR] = regs[get_rb_ir()];
+	cpu->regs[IAR] = cpu->regs[get_rb_ir()];
 	return;
 }
 
-static void jmp(void)
+static void jmp(jcpu * cpu)
 {
 	/* JMP addr - jumps to the address in the next byte
 	 * 4. send IAR to MAR
 	 * 5. move value at address in MAR to IAR */
-	regs[MAR] = regs[IAR];
-	regs[IAR] = ram[regs[MAR]];
+	cpu->regs[MAR] = cpu->regs[IAR];
+	cpu->regs[IAR] = rd_ram(cpu->regs[MAR]);
 	return;
 }
 
-static void jcond(void)
+static void jcond(jcpu * cpu)
 {
 	/* J<flag(s)> addr - jumps to the address in the next byte when
 	 * any of the requested flag bits is set
 	 * 4. move IAR to MAR
 	 * 5. add one to IAR
 	 * 6. move the address from RAM to IAR if any of the requested flags is set */
-	 byte flags = 0;
-	 
-	 regs[MAR] = regs[IAR];
-	 ++regs[IAR];
-	 
-	 flags |= (regs[CF] << 3) | (regs[AF] << 2) | (regs[EF] << 1) | regs[ZF];
-	 
-	 if (regs[IR] & flags)
-		regs[IAR] = ram[regs[MAR]];
-	 
+	 cpu->regs[MAR] = cpu->regs[IAR];
+	 ++cpu->regs[IAR];
+	
+	 if (cpu->regs[IR] & get_flags())
+		cpu->regs[IAR] = rd_ram(cpu->regs[MAR]);
+	
 	return;
 }
 
-static void clearf(void)
+static void clearf(jcpu * cpu)
 {
-	/* clear the flags */
-	*((int *)&regs[CF]) = 0;
+	/* CLF - clear the flags
+	 * IRET - return from interrupt
+	 * 4. restore IAR, the flags, and the selected device
+	 * or go straight back to the vector if the timer ran out meanwhile */
+	if (IRET_INSTR != cpu->regs[IR])
+	{
+		*((int *)&cpu->regs[CF]) = 0;
+		return;
+	}
+	
+	if (!cpu->in_irq)
+		return;
+	
+	if (cpu->irq_pend)
+	{
+		cpu->irq_pend = false;
+		cpu->regs[IAR] = cpu->ivec;
+		return;
+	}
+	
+	cpu->regs[IAR] = cpu->iiar;
+	set_flags(cpu, cpu->iflags);
+	cpu->io_sel = cpu->isel;
+	cpu->in_irq = false;
 	return;
 }
 
-static void dummy(void)
+static void io(jcpu * cpu)
 {
-	/* for array padding */
+	/* IN/OUT DATA/ADDR RB - moves RB to or from the I/O bus
+	 * 4. OUT ADDR: select the device at the address in RB
+	 *    OUT DATA: send RB to the selected device
+	 *    IN DATA: read the selected device in RB
+	 *    IN ADDR: read the address of the selected device in RB 
+	 * if the device has to wait, go back to this instruction */
+	int rb = get_rb_ir();
+	int res = IO_DONE;
+	
+	switch (cpu->regs[IR] & (IO_OUT | IO_ADDR))
+	{
+		case IO_OUT | IO_ADDR:
+			cpu->io_sel = cpu->regs[rb];
+			break;
+		case IO_OUT:
+			res = dev_out(cpu, cpu->regs[rb]);
+			break;
+		case IO_ADDR:
+			cpu->regs[rb] = cpu->io_sel;
+			break;
+		default:
+			res = dev_in(cpu, &cpu->regs[rb]);
+			break;
+	}
+	
+	if (IO_WAIT == res)
+	{
+		--cpu->regs[IAR];
+		--cpu->icount;
+		cpu->wait = true;
+	}
+	
 	return;
 }
 
-static void add(void)
+static void add(jcpu * cpu)
 {
 	/* ADD RA, RB - adds the value in RA to the value in RB in RB
 	 * modifies: CF, ZF
 	 * step 0: get RA and RB
-	 * step 1: add RA and RB in tmp
-	 * step 2: add in the carry flag to tmp
-	 * step 3: set the carry flag 
-	 * step 4: move tmp to RB 
-	 * step 5: set ZF */
+	 * step 1: add RA, RB, and the carry flag in tmp
+	 * step 2: set the carry flag
+	 * step 3: move tmp to RB
+	 * step 4: set ZF */
 	int ra = get_ra_ir();
 	int rb = get_rb_ir();
-	byte tmp = regs[ra] + regs[rb];
+	unsigned int tmp = cpu->regs[ra] + cpu->regs[rb] + cpu->regs[CF];
 	
-	tmp += regs[CF];
-	regs[CF] = (regs[ra] + regs[rb]) > BYTE_MAX;
-	regs[rb] = tmp;
+	cpu->regs[CF] = tmp > BYTE_MAX;
+	cpu->regs[rb] = tmp;
 	set_zf();
 	return;
 }
 
-static void shr(void)
+static void shr(jcpu * cpu)
 {
 	/* SHR RA, RB - shifts RA one to the right into RB
 	 * modifies: CF, ZF
 	 * step 0: get RA and RB
 	 * step 1: SHR RA in RB and | with CF << 7
-	 * step 2: set CF  
+	 * step 2: set CF
 	 * step 3: set ZF */
 	int ra = get_ra_ir();
 	int rb = get_rb_ir();
-	unsigned int tmp = regs[ra];
+	unsigned int tmp = cpu->regs[ra];
 	
-	regs[rb] = (tmp >> 1) | (regs[CF] << 7);
-	regs[CF] = ((tmp & 0x01) > 0);
+	cpu->regs[rb] = (tmp >> 1) | (cpu->regs[CF] << 7);
+	cpu->regs[CF] = ((tmp & 0x01) > 0);
 	set_zf();
 	return;
 }
 
-static void shl(void)
+static void shl(jcpu * cpu)
 {
 	/* SHL RA, RB - shifts RA one to the left into RB
 	 * modifies: CF, ZF
 	 * step 0: get RA and RB
 	 * step 1: SHL RA in RB and | with CF
-	 * step 2: set CF  
+	 * step 2: set CF
 	 * step 3: set ZF */
 	int ra = get_ra_ir();
 	int rb = get_rb_ir();
-	unsigned int tmp = regs[ra];
-
-	regs[rb] = (tmp << 1) | regs[CF];
-	regs[CF] = ( (tmp << 1) > BYTE_MAX );
+	unsigned int tmp = cpu->regs[ra];
+	
+	cpu->regs[rb] = (tmp << 1) | cpu->regs[CF];
+	cpu->regs[CF] = ( (tmp << 1) > BYTE_MAX );
 	set_zf();
 	return;
 }
 
-static void not(void)
+static void not(jcpu * cpu)
 {
 	/* NOT RA, RB - sets RB to the reverse bits value of RA
 	 * modifies: ZF
-	 * step 0: get RA and RB 
+	 * step 0: get RA and RB
 	 * step 1: NOT RA in RB
 	 * step 2: set ZF */
 	int ra = get_ra_ir();
 	int rb = get_rb_ir();
 	
-	regs[rb] = ~regs[ra];
+	cpu->regs[rb] = ~cpu->regs[ra];
 	set_zf();
 	return;
 }
 
-static void and(void)
+static void and(jcpu * cpu)
 {
 	/* AND RA, RB - & RA and RB in RB
 	 * modifies: ZF
-	 * step 0: get RA and RB 
+	 * step 0: get RA and RB
 	 * step 1: and RA in RB
 	 * step 2: set ZF */
 	int ra = get_ra_ir();
 	int rb = get_rb_ir();
 	
-	regs[rb] &= regs[ra];
+	cpu->regs[rb] &= cpu->regs[ra];
 	set_zf();
 	return;
 }
 
-static void or(void)
+static void or(jcpu * cpu)
 {
 	/* OR RA, RB - | RA and RB in RB
 	 * modifies: ZF
-	 * step 0: get RA and RB 
+	 * step 0: get RA and RB
 	 * step 1: or RA in RB
 	 * step 2: set ZF */
 	int ra = get_ra_ir();
 	int rb = get_rb_ir();
 	
-	regs[rb] |= regs[ra];
+	cpu->regs[rb] |= cpu->regs[ra];
 	set_zf();
 	return;
 }
 
-static void xor(void)
+static void xor(jcpu * cpu)
 {
 	/* XOR RA, RB - ^ RA and RB in RB
 	 * modifies: ZF
-	 * step 0: get RA and RB 
+	 * step 0: get RA and RB
 	 * step 1: xor RA in RB
 	 * step 2: set ZF */
 	int ra = get_ra_ir();
 	int rb = get_rb_ir();
 	
-	regs[rb] ^= regs[ra];
+	cpu->regs[rb] ^= cpu->regs[ra];
 	set_zf();
 	return;
 }
 
-static void cmp(void)
+static void cmp(jcpu * cpu)
 {
 	/* CMP RA, RB - compares RA and RB
 	 * modifies: AF, EF
-	 * step 0: get RA and RB 
+	 * step 0: get RA and RB
 	 * step 1: compare RA and RB
 	 * step 2: set AF and EF */
 	int ra = get_ra_ir();
 	int rb = get_rb_ir();
 	
-	regs[AF] = regs[ra] > regs[rb];
-	regs[EF] = regs[ra] == regs[rb];
-	return; 
+	cpu->regs[AF] = cpu->regs[ra] > cpu->regs[rb];
+	cpu->regs[EF] = cpu->regs[ra] == cpu->regs[rb];
+	return;
 }
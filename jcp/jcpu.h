@@ -1,27 +1,194 @@
 /* jcpu.h -- public interface for jcpu.c */
-/* ver. 1.02 */
+/* ver. 1.10 */
 #ifndef JCPU_H
 #define JCPU_H
 
-/* fpvv_t = function pointer void void type
- * a function pointer to a void function */
-typedef void (*fpvv_t)(void);
+#include <stdbool.h>
+#include <stdint.h>
+
 typedef unsigned char byte;
 
 #define RAM_S 		256	// size of ram
 #define GREG_OFF	7	// offset to r0 in the registers array
+#define RAM_LINE_S	16	// bytes in a ram line; see jcpu.dirty
+#define line_of(a)	((a) >> 4)	// the ram line of address a
 enum {MAR, IAR, IR, CF, AF, EF, ZF, R0, R1, R2, R3, NUM_REGS};
 
-extern byte ram[RAM_S];
-extern byte regs[NUM_REGS];
+/* I/O ports of the devices built into the cpu; OUT ADDR selects one,
+ * then OUT DATA/IN DATA write to/read from it */
+enum {	PORT_NONE,
+		PORT_TIMER,		// period in instructions; 0 stops the timer
+		PORT_IVEC,		// the interrupt vector address
+		PORT_IIAR,		// the IAR saved on interrupt
+		PORT_IFLAGS,	// the flags saved on interrupt as CAEZ in the right nibble
+		PORT_CORE,		// IN DATA reads the number of the core
+		PORT_TASA,		// OUT DATA sets the ram address for PORT_TAS
+		PORT_TAS,		// IN DATA test-and-sets, OUT DATA releases the PORT_TASA address
+		PORT_LOCAL};	// first port not handled by the cpu
+
+enum {IO_DONE, IO_WAIT};
+/* what a device returns; IO_WAIT when it can't take or give a byte yet */
+
+// a device outside the cpu; gets every port from PORT_LOCAL up
+typedef struct jcpu_dev_ {
+	int (*in)(void * ctx, byte port, byte * val);	// IN DATA
+	int (*out)(void * ctx, byte port, byte val);	// OUT DATA
+	void * ctx;										// passed back to in() and out()
+} jcpu_dev;
+
+// what an instruction byte means; see jcpu_dec_tab
+typedef struct jcpu_dec_ {
+	byte op;		// the instruction nibble
+	byte ra;		// index of reg a in the registers array
+	byte rb;		// index of reg b in the registers array
+	byte steps;		// stepper steps it takes, fetch included
+} jcpu_dec;
+
+extern const jcpu_dec jcpu_dec_tab[RAM_S];
+/* the decoded instructions by value of IR; used by both jcpu_step() and jcpu_tick() */
+
+// a single core; all of its state lives here
+typedef struct jcpu_ {
+	byte regs[NUM_REGS];		// the registers
+	unsigned long icount;		// instructions executed since load
+	unsigned long tmr_left;		// steps until the timer runs out
+	unsigned long tmr_period;	// timer reload value; 0 when stopped
+	byte io_sel;				// the device selected on the I/O bus
+	byte ivec;					// the interrupt vector
+	byte iiar, iflags, isel;	// IAR, flags, and io_sel saved on interrupt
+	bool in_irq;				// an interrupt is being served
+	bool irq_pend;				// the timer ran out while serving one
+	byte tas_addr;				// the address latched for test-and-set
+	bool wait;					// the last IN/OUT has to wait for its device
+	byte step;					// the stepper step to do next, 1 to 6
+	byte bus, tmp, acc;			// the bus and the alu registers; stepper only
+	unsigned long cycles;		// clock cycles; counted by the stepper only
+	uint64_t digest;			// jcpu_digest() of the ram, kept up to date by the stores
+	/* everything from here on is kept by jcpu_reset() */
+	byte * ram;					// the ram; private or shared between cores
+	byte core;					// the number of the core
+	jcpu_dev dev;				// the device outside the cpu, if any
+	bool stepper;				// the host runs this core with jcpu_tick()
+	unsigned short dirty;		// a bit for every ram line stored to since load
+	byte snap[RAM_S];			// the ram as it was loaded
+	uint64_t snap_digest;		// jcpu_digest() of snap
+} jcpu;
+
+#define JCPU_CKPT_MAGIC	"JCPUCKPT"	// the first 8 bytes of a checkpoint
+#define JCPU_CKPT_VER	1			// the checkpoint layout version
+
+/* a checkpoint of a core and its ram; fixed size fields and no padding,
+ * so it goes to and from a file in one piece, in the byte order of the host */
+typedef struct jcpu_ckpt_ {
+	char magic[8];				// JCPU_CKPT_MAGIC, no '\0'
+	uint32_t version;			// JCPU_CKPT_VER
+	uint32_t size;				// sizeof(jcpu_ckpt)
+	uint64_t icount, cycles;	// the counters
+	uint64_t tmr_left;			// UINT64_MAX when the timer is stopped
+	uint64_t tmr_period;
+	uint16_t dirty;
+	byte regs[NUM_REGS];
+	byte io_sel, ivec, iiar, iflags, isel, in_irq, irq_pend, tas_addr, wait;
+	byte step, bus, tmp, acc;
+	byte core, stepper;
+	byte pad[4];				// to 8 bytes
+	byte ram[RAM_S];
+	byte snap[RAM_S];
+} jcpu_ckpt;
+
+/* fpcv_t = function pointer cpu void type
+ * a function pointer to a void function of a core */
+typedef void (*fpcv_t)(jcpu * cpu);
+
+void jcpu_init(jcpu * cpu, byte * ram, int core);
+/* returns: Nothing.
+ *
+ * description: Powers on cpu as core number core, attached to ram.
+ * Cores which share ram see each other's stores. */
+
+void jcpu_load(jcpu * cpu, const byte * code, int csize);
+/* returns: Nothing.
+ *
+ * description: Loads the code array in the jcpu ram. The ram is
+ * zeroed out first. What ends up in the ram is kept for jcpu_reset(). */
+
+void jcpu_reset(jcpu * cpu);
+/* returns: Nothing.
+ *
+ * description: Puts cpu back the way it was right after jcpu_load(),
+ * keeping its core number, device, and stepper setting. Only the ram
+ * lines marked in cpu->dirty are copied back. The dirty map only knows
+ * about the stores of cpu itself; don't reset with shared ram while
+ * other cores run. */
 
-void jcpu_load(const byte * code, int csize);
+void jcpu_step(jcpu * cpu);
 /* returns: Nothing.
+ *
+ * description: Executes a single cpu instruction. If the timer has run
+ * out, the interrupt is taken before that. */
+
+bool jcpu_tick(jcpu * cpu);
+/* returns: True if the tick finished an instruction, false otherwise.
  * 
- * description: Loads the code array in the jcpu ram. */
+ * description: Runs one clock cycle of the book's stepper. First whatever
+ * the step enables goes on the bus, then the registers the step sets read it.
+ * Fetching takes steps 1 to 3 and the instruction takes as many more as it
+ * needs; the stepper is reset after its last one. The timer counts cycles
+ * here and interrupts at the next instruction. Sets cpu->stepper. Don't call
+ * jcpu_step() in the middle of an instruction. */
 
-void jcpu_step(void);
+void jcpu_step_ticks(jcpu * cpu);
 /* returns: Nothing.
  * 
- * description: Executes a single cpu instruction. */
+ * description: Executes a single cpu instruction with jcpu_tick(). Ends in the
+ * same state as jcpu_step() but also counts cycles. */
+
+void jcpu_attach(jcpu * cpu, const jcpu_dev * dev);
+/* returns: Nothing.
+ * 
+ * description: Connects dev to the ports of cpu from PORT_LOCAL up.
+ * When dev returns IO_WAIT, the IN/OUT instruction is undone and
+ * cpu->wait is set. The next jcpu_step() tries it again. */
+
+bool jcpu_halted(const jcpu * cpu);
+/* returns: True if cpu is stuck on a jump to itself, false otherwise.
+ *
+ * description: The programs for the jcpu mark their end with a jump
+ * to the same place. This is how the runners know they're done. */
+
+void jcpu_save(const jcpu * cpu, jcpu_ckpt * ck);
+/* returns: Nothing.
+ *
+ * description: Fills ck with the state of cpu, its built-in devices, and
+ * its ram. The device attached by the host is not part of it. */
+
+int jcpu_restore(jcpu * cpu, const jcpu_ckpt * ck);
+/* returns: 0 on success, -1 if ck is not a checkpoint of this version.
+ *
+ * description: Puts the state from ck in cpu, which should already be
+ * initialized with a ram. Keeps the ram pointer and the device. A reset
+ * afterwards goes back to the program as it was first loaded. */
+
+void jcpu_poke(jcpu * cpu, byte addr, byte val);
+/* returns: Nothing.
+ *
+ * description: Stores val at addr the way the program would, so the dirty
+ * map and the digest know about it. For the host to put the inputs of a run
+ * in the ram after jcpu_load() or jcpu_reset(). */
+
+uint64_t jcpu_digest(const byte * ram);
+/* returns: A 64 bit digest of the RAM_S bytes of ram.
+ *
+ * description: The XOR of a hash of every address together with its byte,
+ * so a store changes it by two hashes. cpu->digest is this for cpu->ram
+ * and every store of cpu keeps it so, which makes reading it mid-run free.
+ * Like the dirty map, it doesn't know about the stores of other cores. */
+
+void jcpu_timer(jcpu * cpu, unsigned long period, byte vector);
+/* returns: Nothing.
+ *
+ * description: Programs the timer to raise an interrupt every period
+ * instructions, jumping to vector. A period of 0 stops the timer.
+ * The same as writing PORT_IVEC and PORT_TIMER from a program, but
+ * period is not limited to a byte. */
 #endif
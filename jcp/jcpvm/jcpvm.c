@@ -1,7 +1,20 @@
 /* jcpvm.c -- a virtual machine for the jcpu */
-/* ver. 1.021 */
+/* ver. 1.15 */
 
-/* Implements the user interface. */
+/* Implements the user interface. Can also run the program on
+ * several cores sharing the ram, without the interface. The interface can
+ * let the program run on its own, showing the latest state of the machine
+ * a fixed number of times a second however fast it runs. The core runs on
+ * a thread of its own, see emu.c; the interface only sends it commands and
+ * shows what it publishes, so neither waits for the other. With -x the
+ * interface commands come from a script instead, checked by assertions,
+ * and nothing but what the script prints goes out. With -m the
+ * disassembly shows the labels of a symbol map jcpasm wrote. The last
+ * instructions executed are in a pane which scrolls back while paused.
+ * How fast a run goes is worked out every frame from the counters the
+ * thread publishes once a slice, so measuring it costs the run nothing.
+ * A program rebuilt while the vm runs is loaded again with one command,
+ * which can also go back to where the old one was. */
 
 /* Author: Vladimir Dinev */
 #include "../os_def.h"
@@ -10,8 +23,19 @@
 #include <stdlib.h>
 #include <string.h>
 #include <stdbool.h>
+#include <time.h>
+#include <signal.h>
+#ifdef WINDOWS
+#include <conio.h>
+#else
+#include <sys/select.h>
+#include <unistd.h>
+#endif
 #include "../display.h"
 #include "../jcpu.h"
+#include "../smp.h"
+#include "../emu.h"
+#include "../disasm.h"
 
 #define MAX_CODE 		256		// maximum code for ram
 #define IN_BUFF_SZ		128		// input buffer size
@@ -20,29 +44,85 @@
 #define QUIT			'q'		// quit the emulation
 #define JUMP			'j'		// jump n instructions in the future
 #define RESET			'r'		// reset the emulation
+#define TICK			't'		// run a single clock cycle
+#define ANIMATE			'a'		// run on its own until halted or enter is pressed
+#define ANIM_FPS		25		// frames a second while running on its own
+#define BREAK			'b'		// set or clear a breakpoint
+#define RELOAD			'l'		// load the program again from its file
+#define KEEP			'k'		// reload keeping the registers and the data
+#define HIST_OLDER		'<'		// scroll the history back
+#define HIST_NEWER		'>'		// scroll the history forward
+#define PRINT			'p'		// print the registers or the ram; scripts only
+#define EXPECT			'e'		// assert a register or ram value; scripts only
+#define COMMENT			'#'		// a script line to skip
+#define SCRIPT			'x'		// run a command script without the interface
+#define HALTED			"halted"	// what EXPECT checks for a halt
+#define INTR_MASK		0xFFF	// a script looks at ^C every 4096 instructions
 #define HELP			'h'		// print help
 #define VERS			'v'		// print version info
+#define CORES			'c'		// run on this many cores without the interface
+#define QUANT			'q'		// cores take turns this many instructions at a time
+#define STEPS			'n'		// maximum instructions per core
+#define STEPPER			's'		// run through the stepper, counting cycles
+#define SYMBOLS			'm'		// show the labels of a symbol map
+#define SMP_STEPS		1000000	// default maximum instructions per core
 #define DASH			'-'		// cmd line argument prefix
-#define press_enter()	printf("Press enter to continue"), getchar()
-#define prompt()		printf("%*s\rcmd: ", FRAME_ROWS, " ")
+#define SAVE_ST			"--save-state"	// write a checkpoint on exit
+#define LOAD_ST			"--load-state"	// start from a checkpoint
+#define PRESS_ENTER		"Press enter to continue"
+#define PROMPT			"cmd: "	// asks for an interactive command
+#define press_enter()	printf(PRESS_ENTER), getchar()
 #define reset_cur_pos()	disp_move_cursor_xy(0, 0)
 
-#ifdef WINDOWS
-#define mv_cur_bottom()	disp_move_cursor_xy(FRAME_ROWS, 0)
-#else
-#define mv_cur_bottom()	disp_move_cursor_xy(FRAME_ROWS+1, 0)
-#endif
-
-#define reset_cpu()		memset(regs, 0, NUM_REGS), last_inst = -1
 #define print_ver()		printf("%s %s\n", exenm, ver)
 
 char exenm[] = "jcpvm";	// executable name
-char ver[] = "v1.021";	// executable version
-int last_inst = 0;		// the previous executed instruction address
+char ver[] = "v1.15";	// executable version
+byte ram[RAM_S];		// the ram of the machine
+jcpu cpu;				// the core shown on the screen
+emu em;					// the thread which runs it
+emu_view view;			// what the screen shows of it
+bool stepper = false;	// run through the stepper
+char * save_st = NULL;	// the checkpoint to write on exit
+char * load_st = NULL;	// the checkpoint to start from
+char * fname = NULL;	// the program file
+char * sym_map = NULL;	// the symbol map file
+char * syms[DIS_SYMS];	// the labels of the addresses, if there is a map
+volatile sig_atomic_t intr = 0;	// ^C was pressed during a run
+int hist_back = 0;		// how far the history pane is scrolled back
+unsigned long rate_done;	// the instructions run when the rate was last worked out
+double rate_at;			// and when
+unsigned long run_done;		// the instructions run when the run started
+double run_at;				// and when
+const char * reg_names[NUM_REGS] = {"MAR", "IAR", "IR", "C", "A", "E", "Z",
+	"R0", "R1", "R2", "R3"};	// the registers, as scripts call them
 
 FILE * efopen(const char * fname);
 int fsize(FILE * fp);
+int read_code(const char * fname, byte * code);
+unsigned long num_arg(int argc, char * argv[], int * argn);
+char * str_arg(int argc, char * argv[], int * argn);
+int load_state(jcpu * core);
+int save_state(const jcpu * core);
+int run_smp(const byte * code, int csize, int ncores, unsigned long steps,
+			int mode, unsigned long quantum);
+int run_script(const char * sname, unsigned long steps);
+int script_line(char * line, unsigned long steps, bool * brk);
+int script_expect(char * args);
+void script_print(char * args);
+int reg_num(const char * name);
+bool script_step(bool * brk);
+void do_cmd(int op, unsigned long arg);
+void scroll_hist(char * arg, int dir);
+void reload(char * how);
+void animate(int op, unsigned long arg);
+void on_intr(int sig);
+bool key_hit(void);
+void sleep_till(double when);
+double now(void);
+void print_cycles(const jcpu * cpu);
 void new_screen(void);
+void sample_rate(void);
 void print_help(bool interactive);
 
 int main(int argc, char * argv[])
@@ -52,51 +132,115 @@ int main(int argc, char * argv[])
 	static byte incode[MAX_CODE] = {0};
 	static char cmdbuff[IN_BUFF_SZ] = {NUL};
 	
-	if (argc > 1 && DASH == argv[1][0])
+	char * script = NULL;
+	int i, f_sz = 0, ncores = 0, mode = SMP_THREADS;
+	unsigned long steps = SMP_STEPS, quantum = 0;
+	
+	for (i = 1; i < argc; ++i)
 	{
-		if (HELP == argv[1][1])
-			print_help(false);
-		else if(VERS == argv[1][1])
-			print_ver();
-		else
+		if (DASH != argv[i][0] && NULL == fname)
 		{
-			fprintf(stderr, "Err: unrecognized argument \"%s\"\n", argv[1]);
-			printf("Use: %s <file name> or %s %c%c for help\n", 
-				exenm, exenm, DASH, HELP);
+			fname = argv[i];
+			continue;
 		}
 		
-		return -1;
+		switch ((DASH == argv[i][0]) ? argv[i][1] : NUL)
+		{
+			case HELP:
+				print_help(false);
+				return -1;
+			case VERS:
+				print_ver();
+				return -1;
+			case CORES:
+				ncores = num_arg(argc, argv, &i);
+				if (ncores < 1 || ncores > SMP_MAX_CORES)
+				{
+					fprintf(stderr, "Err: the number of cores should be 1 to %d\n", 
+							SMP_MAX_CORES);
+					return -1;
+				}
+				break;
+			case QUANT:
+				quantum = num_arg(argc, argv, &i);
+				mode = SMP_RROBIN;
+				break;
+			case STEPS:
+				steps = num_arg(argc, argv, &i);
+				break;
+			case STEPPER:
+				stepper = true;
+				break;
+			case SCRIPT:
+				script = str_arg(argc, argv, &i);
+				break;
+			case SYMBOLS:
+				sym_map = str_arg(argc, argv, &i);
+				break;
+			case DASH:
+				if (strcmp(argv[i], SAVE_ST) == 0)
+				{
+					save_st = str_arg(argc, argv, &i);
+					break;
+				}
+				else if (strcmp(argv[i], LOAD_ST) == 0)
+				{
+					load_st = str_arg(argc, argv, &i);
+					break;
+				}
+				// fall through
+			default:
+				fprintf(stderr, "Err: unrecognized argument \"%s\"\n", argv[i]);
+				printf("Use: %s <file name> or %s %c%c for help\n", 
+					exenm, exenm, DASH, HELP);
+				return -1;
+		}
 	}
 	
-	if (argc != 2)
+	if (NULL == fname && NULL == load_st)
 	{
 		printf("Use: %s <file name> or %s %c%c for help\n", 
 				exenm, exenm, DASH, HELP);
 		return -1;
 	}
 	
-	FILE * infile = efopen(argv[1]);
-	int f_sz = fsize(infile);
-	size_t read_c = fread(incode, f_sz, 1, infile);
+	if (fname != NULL && (f_sz = read_code(fname, incode)) < 0)
+		return -1;
 	
-	fclose(infile);
+	if (ncores > 0)
+		return run_smp(incode, f_sz, ncores, steps, mode, quantum);
 	
-	if (read_c > 0)
-		jcpu_load(incode, f_sz);
-	else
+	jcpu_init(&cpu, ram, 0);
+	cpu.stepper = stepper;
+	if (NULL == load_st)
+		jcpu_load(&cpu, incode, f_sz);
+	else if (load_state(&cpu) != 0)
+		return -1;
+	
+	if (script != NULL)
+		return run_script(script, steps);
+	
+	if (sym_map != NULL && disasm_read_syms(sym_map, syms) < 0)
 	{
-		fprintf(stderr, 
-				"Err: \"%s\" is either empty or a reading error has occured\n", 
-				argv[1]);
+		fprintf(stderr, "Err: \"%s\" could not be read as a symbol map\n", sym_map);
 		return -1;
 	}
-		
-	disp_init_frame();
+	
+	// unbuffered, so key_hit() sees everything that wasn't read yet
+	setvbuf(stdin, NULL, _IONBF, 0);
+	disp_set_syms(syms);
+	disp_init_frame(&cpu);
 	disp_clear();
 	
+	if (emu_start(&em, &cpu, cpu.regs[IAR]) != 0)
+	{
+		fprintf(stderr, "Err: could not start the emulation thread\n");
+		return -1;
+	}
+	
 	char * ch;
-	last_inst = regs[IAR];
 	int j_steps = 0;
+	unsigned int addr;
 	
 	// main loop
 	while (true)
@@ -111,10 +255,8 @@ int main(int argc, char * argv[])
 		switch (*ch)
 		{
 			case DECIMAL:
-				reset_cur_pos();
-				disp_print(DEC_DSP, last_inst);
-				mv_cur_bottom();
-				press_enter();
+				disp_print(&view.cpu, DEC_DSP, view.last_inst, PRESS_ENTER);
+				getchar();
 				continue;
 				break;
 			case JUMP:
@@ -122,9 +264,35 @@ int main(int argc, char * argv[])
 				if (sscanf(ch, "%d", &j_steps) != 1)
 					j_steps = 0;
 				break;
+			case ANIMATE:
+				++ch;
+				animate(EMU_RUN, strtoul(ch, NULL, 0));
+				continue;
+				break;
+			case BREAK:
+				++ch;
+				if (sscanf(ch, "%x", &addr) == 1)
+					do_cmd(EMU_BREAK, addr);
+				continue;
+				break;
+			case RELOAD:
+				reload(ch + 1);
+				continue;
+				break;
+			case HIST_OLDER:
+				scroll_hist(ch + 1, 1);
+				continue;
+				break;
+			case HIST_NEWER:
+				scroll_hist(ch + 1, -1);
+				continue;
+				break;
+			case TICK:
+				do_cmd(EMU_TICK, 0);
+				continue;
+				break;
 			case RESET:
-				reset_cpu();
-				jcpu_load(incode, f_sz);
+				do_cmd(EMU_RESET, 0);
 				continue;
 				break;
 			case HELP:
@@ -133,27 +301,20 @@ int main(int argc, char * argv[])
 				continue;
 				break;
 			case QUIT:
+				emu_quit(&em);
+				print_cycles(&cpu);
+				if (save_st != NULL && save_state(&cpu) != 0)
+					return -1;
 				goto gohome;
 				break;
 			default:
 				break;
 		}
 		
-		if (j_steps > 0 && j_steps < MAX_CODE)
-		{
-			while (j_steps-- > 0)
-			{
-				last_inst = regs[IAR];
-				jcpu_step();
-			}
-		}
-		else
-		{
-			last_inst = regs[IAR];
-			jcpu_step();
-		}
+		do_cmd(EMU_STEP, (j_steps > 0 && j_steps < MAX_CODE) ? j_steps : 1);
+		j_steps = 0;
 	}
-	
+
 gohome:
 	return 0;
 }
@@ -173,6 +334,34 @@ FILE * efopen(const char * fname)
 	return fp;
 }
 
+int read_code(const char * fname, byte * code)
+{
+	/* read no more than MAX_CODE bytes of fname in code
+	 * return how many, -1 on failure */
+	FILE * infile;
+	int size;
+	
+	if ((infile = fopen(fname, "rb")) == NULL)
+	{
+		fprintf(stderr, "Err: could not open file \"%s\"\n", fname);
+		return -1;
+	}
+	
+	if ((size = fsize(infile)) > MAX_CODE)
+		size = MAX_CODE;
+	
+	if (size <= 0 || fread(code, size, 1, infile) != 1)
+	{
+		fprintf(stderr, 
+				"Err: \"%s\" is either empty or a reading error has occured\n", 
+				fname);
+		size = -1;
+	}
+	
+	fclose(infile);
+	return size;
+}
+
 int fsize(FILE * fp)
 {
 	/* return the file size for fp */
@@ -180,21 +369,564 @@ int fsize(FILE * fp)
 	
 	if (fseek(fp, 0L, SEEK_END) != 0)
 		return -1;
-		
+	
 	size = ftell(fp);
 	rewind(fp);
 	
 	return size;
 }
 
+unsigned long num_arg(int argc, char * argv[], int * argn)
+{
+	/* read the number after the option at *argn
+	 * die if there isn't one */
+	unsigned long num;
+	char * end;
+	
+	if (*argn + 1 >= argc)
+	{
+		fprintf(stderr, "Err: \"%s\" should be followed by a number\n", argv[*argn]);
+		exit(EXIT_FAILURE);
+	}
+	
+	++*argn;
+	num = strtoul(argv[*argn], &end, 0);
+	if (*end != NUL || DASH == argv[*argn][0])
+	{
+		fprintf(stderr, "Err: \"%s\" is not a number\n", argv[*argn]);
+		exit(EXIT_FAILURE);
+	}
+	
+	return num;
+}
+
+char * str_arg(int argc, char * argv[], int * argn)
+{
+	/* return the argument after the option at *argn
+	 * die if there isn't one */
+	if (*argn + 1 >= argc || DASH == argv[*argn + 1][0])
+	{
+		fprintf(stderr, "Err: \"%s\" should be followed by a file name\n", argv[*argn]);
+		exit(EXIT_FAILURE);
+	}
+	
+	return argv[++*argn];
+}
+
+int load_state(jcpu * core)
+{
+	/* read a checkpoint in core with a single read
+	 * -s still counts over the stepper setting in it */
+	static jcpu_ckpt ck;
+	FILE * fp = efopen(load_st);
+	size_t read_c = fread(&ck, sizeof(ck), 1, fp);
+	
+	fclose(fp);
+	
+	if (read_c != 1 || jcpu_restore(core, &ck) != 0)
+	{
+		fprintf(stderr, "Err: \"%s\" is not a version %d checkpoint\n", load_st, 
+				JCPU_CKPT_VER);
+		return -1;
+	}
+	
+	if (stepper)
+		core->stepper = true;
+	
+	return 0;
+}
+
+int save_state(const jcpu * core)
+{
+	/* write the checkpoint of core with a single write */
+	static jcpu_ckpt ck;
+	FILE * fp;
+	int res = 0;
+	
+	jcpu_save(core, &ck);
+	
+	if ((fp = fopen(save_st, "wb")) == NULL)
+	{
+		fprintf(stderr, "Err: could not open file \"%s\"\n", save_st);
+		return -1;
+	}
+	
+	if (fwrite(&ck, sizeof(ck), 1, fp) != 1)
+		res = -1;
+	if (fclose(fp) != 0)
+		res = -1;
+	
+	if (res != 0)
+		fprintf(stderr, "Err: could not write \"%s\"\n", save_st);
+	
+	return res;
+}
+
+int run_smp(const byte * code, int csize, int ncores, unsigned long steps,
+			int mode, unsigned long quantum)
+{
+	/* run code on ncores cores sharing the ram
+	 * print the state of every core and the ram */
+	static jcpu cores[SMP_MAX_CORES];
+	int i, j, halted;
+	
+	for (i = 0; i < ncores; ++i)
+	{
+		jcpu_init(&cores[i], ram, i);
+		cores[i].stepper = stepper;
+	}
+	
+	// a checkpoint holds core 0 and the ram
+	if (NULL == load_st)
+		jcpu_load(&cores[0], code, csize);
+	else if (load_state(&cores[0]) != 0)
+		return -1;
+	
+	if ((halted = smp_run(cores, ncores, steps, mode, quantum)) < 0)
+	{
+		fprintf(stderr, "Err: could not start the cores\n");
+		return -1;
+	}
+	
+	printf("core MAR IAR IR  C A E Z  R0 R1 R2 R3  instructions\n");
+	for (i = 0; i < ncores; ++i)
+	{
+		printf("%4d  %02X  %02X %02X  %d %d %d %d  %02X %02X %02X %02X  %lu%s\n", i, 
+			cores[i].regs[MAR], cores[i].regs[IAR], cores[i].regs[IR], 
+			cores[i].regs[CF], cores[i].regs[AF], cores[i].regs[EF], cores[i].regs[ZF], 
+			cores[i].regs[R0], cores[i].regs[R1], cores[i].regs[R2], cores[i].regs[R3], 
+			cores[i].icount, jcpu_halted(&cores[i]) ? "" : " (running)");
+	}
+	
+	for (i = 0; i < ncores; ++i)
+		print_cycles(&cores[i]);
+	
+	if (save_st != NULL && save_state(&cores[0]) != 0)
+		return -1;
+	
+	printf("\n    00 01 02 03 04 05 06 07 08 09 0A 0B 0C 0D 0E 0F\n");
+	for (i = 0; i < RAM_S; i += 16)
+	{
+		printf("%02X|", i);
+		for (j = 0; j < 16; ++j)
+			printf(" %02X", ram[i + j]);
+		putchar('\n');
+	}
+	
+	return (halted == ncores) ? 0 : 1;
+}
+
+int run_script(const char * sname, unsigned long steps)
+{
+	/* run the commands in the script sname on cpu, a line at a time
+	 * a run goes no more than steps instructions
+	 * return 0 if all went well, 1 if an assertion failed, -1 on errors */
+	static char line[IN_BUFF_SZ];
+	static bool brk[RAM_S];
+	FILE * fp;
+	int res = 0, lnum = 0;
+	
+	if ((fp = fopen(sname, "r")) == NULL)
+	{
+		fprintf(stderr, "Err: could not open file \"%s\"\n", sname);
+		return -1;
+	}
+	
+	// the failures on stderr come after what was printed before them
+	setvbuf(stdout, NULL, _IOLBF, 0);
+	signal(SIGINT, on_intr);
+	
+	while (0 == res && fgets(line, IN_BUFF_SZ, fp) != NULL)
+	{
+		++lnum;
+		if ((res = script_line(line, steps, brk)) > 1)
+			break;
+		if (intr)
+		{
+			fprintf(stderr, "Err: interrupted after %lu instructions\n", cpu.icount);
+			res = -1;
+		}
+		if (res != 0)
+			fprintf(stderr, "Err: \"%s\" line %d: %s", sname, lnum, line);
+	}
+	
+	fclose(fp);
+	
+	if (save_st != NULL && save_state(&cpu) != 0)
+		return -1;
+	
+	return (res > 1) ? 0 : res;
+}
+
+int script_line(char * line, unsigned long steps, bool * brk)
+{
+	/* do the command on line
+	 * return 0 if all went well, 1 if an assertion failed,
+	 * 2 on quit, -1 if there is no such command */
+	unsigned long n;
+	unsigned int addr;
+	char * ch = line;
+	
+	while (isspace(*ch))
+		++ch;
+	
+	switch (*ch)
+	{
+		case NUL:
+		case COMMENT:
+			return 0;
+		case JUMP:
+			n = strtoul(ch + 1, NULL, 0);
+			if (0 == n)
+				n = 1;
+			while (n-- > 0 && !(0 == (n & INTR_MASK) && intr) && !script_step(brk))
+				continue;
+			return 0;
+		case ANIMATE:
+			for (n = 0; n < steps && !jcpu_halted(&cpu); ++n)
+			{
+				if ((0 == (n & INTR_MASK) && intr) || script_step(brk))
+					break;
+			}
+			return 0;
+		case TICK:
+			jcpu_tick(&cpu);
+			return 0;
+		case RESET:
+			jcpu_reset(&cpu);
+			return 0;
+		case BREAK:
+			if (sscanf(ch + 1, "%x", &addr) != 1 || addr >= RAM_S)
+				return -1;
+			brk[addr] = !brk[addr];
+			return 0;
+		case PRINT:
+			script_print(ch + 1);
+			return 0;
+		case EXPECT:
+			return script_expect(ch + 1);
+		case QUIT:
+			return 2;
+		default:
+			return -1;
+	}
+}
+
+int script_expect(char * args)
+{
+	/* check that a register, a ram byte, or the halt is what args say
+	 * return 0 if it is, 1 if it isn't, -1 if args make no sense */
+	char what[IN_BUFF_SZ];
+	unsigned int want, addr;
+	int reg, got;
+	
+	if (sscanf(args, "%s", what) != 1)
+		return -1;
+	
+	if (strcmp(what, HALTED) == 0)
+	{
+		if (jcpu_halted(&cpu))
+			return 0;
+		fprintf(stderr, "Err: expected a halt, IAR is %02X after %lu instructions\n", 
+				cpu.regs[IAR], cpu.icount);
+		return 1;
+	}
+	
+	if (sscanf(args, "%*s %x", &want) != 1)
+		return -1;
+	
+	if ((reg = reg_num(what)) >= 0)
+		got = cpu.regs[reg];
+	else if (sscanf(what, "%x", &addr) == 1 && addr < RAM_S)
+		got = ram[addr];
+	else
+		return -1;
+	
+	if (got == (want & 0xFF))
+		return 0;
+	
+	fprintf(stderr, "Err: expected %s to be %02X, it is %02X after %lu instructions\n", 
+			what, want & 0xFF, got, cpu.icount);
+	return 1;
+}
+
+void script_print(char * args)
+{
+	/* print the registers and the counters, or count
+	 * ram bytes from an address */
+	unsigned int addr, count = 1;
+	int i;
+	
+	if (sscanf(args, "%x %u", &addr, &count) < 1)
+	{
+		for (i = 0; i < NUM_REGS; ++i)
+			printf((i < CF || i > ZF) ? "%s %02X " : "%s %d ", reg_names[i], cpu.regs[i]);
+		printf("instructions %lu", cpu.icount);
+		if (cpu.stepper)
+			printf(" cycles %lu", cpu.cycles);
+		printf("%s\n", jcpu_halted(&cpu) ? " halted" : "");
+		return;
+	}
+	
+	for (i = 0; i < (int)count && addr + i < RAM_S; ++i)
+	{
+		if (0 == i % 16)
+			printf((i > 0) ? "\n%02X|" : "%02X|", addr + i);
+		printf(" %02X", ram[addr + i]);
+	}
+	putchar('\n');
+	return;
+}
+
+int reg_num(const char * name)
+{
+	/* the number of the register called name, any case
+	 * -1 if there is no such register */
+	int i, j;
+	
+	for (i = 0; i < NUM_REGS; ++i)
+	{
+		for (j = 0; name[j] != NUL && toupper(name[j]) == reg_names[i][j]; ++j)
+			continue;
+		if (NUL == name[j] && NUL == reg_names[i][j])
+			return i;
+	}
+	
+	return -1;
+}
+
+bool script_step(bool * brk)
+{
+	/* execute an instruction the selected way
+	 * return true if it got to a breakpoint */
+	if (cpu.stepper)
+		jcpu_step_ticks(&cpu);
+	else
+		jcpu_step(&cpu);
+	
+	return brk[cpu.regs[IAR]];
+}
+
+void do_cmd(int op, unsigned long arg)
+{
+	/* have the thread do a command and wait for it
+	 * the history goes back to the newest when the core moves */
+	emu_wait(&em, emu_send(&em, op, arg));
+	if (op != EMU_BREAK)
+		hist_back = 0;
+	return;
+}
+
+void scroll_hist(char * arg, int dir)
+{
+	/* move the history pane by the instructions in arg, a page
+	 * if none, keeping it full
+	 * Note: view is global for this file */
+	unsigned long has = (view.hcount < EMU_HIST - 1) ? view.hcount : EMU_HIST - 1;
+	int most = (has > DISP_HIST) ? has - DISP_HIST : 0;
+	int n;
+	
+	if (sscanf(arg, "%d", &n) != 1)
+		n = DISP_HIST;
+	
+	hist_back += dir * n;
+	if (hist_back > most)
+		hist_back = most;
+	if (hist_back < 0)
+		hist_back = 0;
+	return;
+}
+
+void reload(char * how)
+{
+	/* read the program and the symbol map again and load the program,
+	 * keeping the registers and the data with KEEP, or from the start;
+	 * with JUMP run it back to where the old one was, stopping at a
+	 * breakpoint, or when enter or ^C is pressed
+	 * Note: view is global for this file */
+	static byte code[MAX_CODE];
+	unsigned long was = view.cpu.icount;
+	int i, size;
+	
+	while (isspace((unsigned char)*how))
+		++how;
+	
+	if (NULL == fname)
+	{
+		fprintf(stderr, "Err: there is no program file to load again\n");
+		size = -1;
+	}
+	else if ((size = read_code(fname, code)) >= 0 && sym_map != NULL)
+	{
+		for (i = 0; i < DIS_SYMS; ++i)
+		{
+			free(syms[i]);
+			syms[i] = NULL;
+		}
+		
+		if (disasm_read_syms(sym_map, syms) < 0)
+			fprintf(stderr, "Err: \"%s\" could not be read as a symbol map\n", sym_map);
+	}
+	
+	if (size < 0)
+	{
+		press_enter();
+		disp_clear();
+		return;
+	}
+	
+	emu_wait(&em, emu_load(&em, code, size, KEEP == *how));
+	hist_back = 0;
+	
+	// the labels may have moved, so all of it is disassembled again
+	emu_look(&em, &view);
+	disp_init_frame(&view.cpu);
+	
+	if (JUMP == *how && was > 0)
+		animate(EMU_UNTIL, was);
+	return;
+}
+
+void animate(int op, unsigned long arg)
+{
+	/* let the thread run the cpu with op, EMU_RUN or EMU_UNTIL, and arg,
+	 * until it halts, gets to a breakpoint, or enter or ^C is pressed;
+	 * show its latest state ANIM_FPS times a second
+	 * the thread never looks for keys, this does between frames */
+	static char line[IN_BUFF_SZ];
+	double frame = 1.0 / ANIM_FPS, next = now();
+	
+	intr = 0;
+	signal(SIGINT, on_intr);
+	// a short run may be over before the first look
+	emu_look(&em, &view);
+	rate_done = run_done = view.done;
+	rate_at = run_at = now();
+	do_cmd(op, arg);
+	while (true)
+	{
+		new_screen();
+		if (!view.running)
+			break;
+		
+		if (intr)
+		{
+			do_cmd(EMU_PAUSE, 0);
+			break;
+		}
+		
+		if (key_hit())
+		{
+			fgets(line, IN_BUFF_SZ, stdin);
+			do_cmd(EMU_PAUSE, 0);
+			break;
+		}
+		
+		// a slow terminal doesn't make it rush to catch up
+		next += frame;
+		if (next < now())
+			next = now();
+		sleep_till(next);
+	}
+	
+	// ^C quits again at the prompt
+	signal(SIGINT, SIG_DFL);
+	return;
+}
+
+void on_intr(int sig)
+{
+	/* ^C during a run stops it instead of the vm */
+	intr = 1;
+	return;
+}
+
+bool key_hit(void)
+{
+	/* true if there is input waiting */
+#ifdef WINDOWS
+	return _kbhit() != 0;
+#else
+	struct timeval tv = {0, 0};
+	fd_set fds;
+	
+	FD_ZERO(&fds);
+	FD_SET(STDIN_FILENO, &fds);
+	return select(STDIN_FILENO + 1, &fds, NULL, NULL, &tv) > 0;
+#endif
+}
+
+void sleep_till(double when)
+{
+	/* sleep until the now() time when */
+	double secs = when - now();
+	
+	if (secs <= 0)
+		return;
+#ifdef WINDOWS
+	Sleep(secs * 1000);
+#else
+	struct timespec ts;
+	
+	ts.tv_sec = secs;
+	ts.tv_nsec = (secs - ts.tv_sec) * 1e9;
+	nanosleep(&ts, NULL);
+#endif
+	return;
+}
+
+double now(void)
+{
+	/* wall clock seconds for pacing the run */
+#ifdef WINDOWS
+	return GetTickCount() / 1000.0;
+#else
+	struct timespec ts;
+	
+	clock_gettime(CLOCK_MONOTONIC, &ts);
+	return ts.tv_sec + ts.tv_nsec / 1e9;
+#endif
+}
+
+void print_cycles(const jcpu * cpu)
+{
+	/* the cycles report for cpu; only the stepper counts them */
+	if (!cpu->stepper)
+		return;
+	
+	printf("core %d: %lu cycles, %lu instructions, %.2f cycles per instruction\n", 
+			cpu->core, cpu->cycles, cpu->icount, 
+			(cpu->icount > 0) ? (double)cpu->cycles / cpu->icount : 0.0);
+	return;
+}
+
 void new_screen(void)
 {
-	/* print a new fram
-	 * Note: last_inst is global for this file */
-	reset_cur_pos();
-	disp_print(HEX_DSP, last_inst);
-	mv_cur_bottom();
-	prompt();
+	/* print a new frame from the latest state the thread published
+	 * Note: view is global for this file */
+	emu_look(&em, &view);
+	sample_rate();
+	disp_hist(view.hist, view.hcount, hist_back);
+	disp_print(&view.cpu, HEX_DSP, view.last_inst, PROMPT);
+	return;
+}
+
+void sample_rate(void)
+{
+	/* while it runs, work out how fast it went since the last
+	 * sample; once it stops, how fast the whole run went
+	 * the last rate stays when it didn't run
+	 * Note: view is global for this file */
+	if (view.done == rate_done || view.at <= rate_at)
+		return;
+	
+	if (view.running)
+		disp_rate((view.done - rate_done) / (view.at - rate_at) / 1e6);
+	else
+		disp_rate((view.done - run_done) / (view.at - run_at) / 1e6);
+	
+	rate_done = view.done;
+	rate_at = view.at;
 	return;
 }
 
@@ -212,6 +944,43 @@ void print_help(bool interactive)
 		printf("<file name> should be the name of a file compiled for the jcpu\n");
 		printf("Version:      %s %c%c\n" ,exenm, DASH, VERS);
 		printf("Help:         %s %c%c\n", exenm, DASH, HELP);
+		printf("\nMulti-core: %s %c%c <cores> [%c%c <quantum>] [%c%c <steps>] <file name>\n", 
+				exenm, DASH, CORES, DASH, QUANT, DASH, STEPS);
+		printf("Runs the program on 1 to %d cores sharing the ram, each on a thread of\n", 
+				SMP_MAX_CORES);
+		printf("its own, until all halt or execute <steps> instructions (default %d).\n", 
+				SMP_STEPS);
+		printf("With %c%c the cores take turns <quantum> instructions at a time instead\n", 
+				DASH, QUANT);
+		printf("and the result is always the same. Prints the cores and the ram.\n");
+		printf("\nStepper:    %s %c%c ...\n", exenm, DASH, STEPPER);
+		printf("Runs every instruction through the stepper one clock cycle at a time,\n");
+		printf("like the book's cpu, and counts the cycles. The timer counts cycles too.\n");
+		printf("Prints the cycles each core took on exit.\n");
+		printf("\nCheckpoints: %s ... [%s <file>] [%s <file>]\n", exenm, SAVE_ST, LOAD_ST);
+		printf("%s writes the state of the machine to <file> on exit, %s starts\n", 
+				SAVE_ST, LOAD_ST);
+		printf("from it instead of from the program, which can then be left out.\n");
+		printf("With %c%c a checkpoint holds core 0 and the ram; the other cores start anew.\n",
+				DASH, CORES);
+		printf("Reset goes back to the program as it was first loaded.\n");
+		printf("\nScript:      %s ... %c%c <script>\n", exenm, DASH, SCRIPT);
+		printf("Runs the commands in <script>, one a line, without the interface, and\n");
+		printf("prints only what they ask for. %c [<n>], %c, %c, %c <hex address>, and %c\n",
+				JUMP, TICK, RESET, BREAK, QUIT);
+		printf("are as in the vm. %c runs until a halt or a breakpoint, no more than\n",
+				ANIMATE);
+		printf("<steps> instructions. %c prints the registers and the counters,\n", PRINT);
+		printf("%c <hex address> [<n>] n bytes of ram. %c <register or hex address>\n",
+				PRINT, EXPECT);
+		printf("<hex value> and %c %s are assertions; the first which fails stops\n",
+				EXPECT, HALTED);
+		printf("the script with exit status 1. Lines starting with %c are skipped.\n",
+				COMMENT);
+		printf("^C stops the script, saving the state if asked to.\n");
+		printf("\nSymbols:     %s ... %c%c <symbol map>\n", exenm, DASH, SYMBOLS);
+		printf("Shows the jump addresses and the DATA values which have a label in\n");
+		printf("<symbol map>, as written by jcpasm %c%c, by their label.\n", DASH, SYMBOLS);
 	}
 	
 	printf("\nInteractive options:\n");
@@ -219,6 +988,25 @@ void print_help(bool interactive)
 	printf("Jump n instructions ahead    - %c <n> + enter\n", JUMP);
 	printf("Note: jumping executes n instructions, it does not skip over\n");
 	printf("n instructions from the code\n");
+	printf("Single clock cycle           - %c + enter\n", TICK);
+	printf("Note: after a clock cycle, enter and %c go through the stepper\n", JUMP);
+	printf("Run on its own               - %c [<n>] + enter\n", ANIMATE);
+	printf("Note: runs n instructions a second, as fast as it can without n,\n");
+	printf("until the program halts, gets to a breakpoint, or enter or ^C is pressed.\n");
+	printf("The screen shows the latest state %d times a second, and how many\n", ANIM_FPS);
+	printf("millions of instructions a second it runs\n");
+	printf("Set or clear a breakpoint    - %c <hex address> + enter\n", BREAK);
+	printf("Note: %c and %c stop at a breakpoint\n", JUMP, ANIMATE);
+	printf("Scroll the history back      - %c [<n>] + enter\n", HIST_OLDER);
+	printf("Scroll the history forward   - %c [<n>] + enter\n", HIST_NEWER);
+	printf("Note: by n instructions, %d without n. The pane shows the last %d\n",
+			DISP_HIST, EMU_HIST - 1);
+	printf("instructions, the newest at the bottom, and the registers they changed\n");
+	printf("Load the program again       - %c [%c|%c] + enter\n", RELOAD, KEEP, JUMP);
+	printf("Note: reads the file again after it's rebuilt, and the symbol map.\n");
+	printf("With %c the registers and the ram past the code are kept, otherwise\n", KEEP);
+	printf("it starts over; with %c it then runs on its own to the instruction\n", JUMP);
+	printf("it was at, stopped as %c is\n", ANIMATE);
 	printf("Reset the cpu                - %c + enter\n", RESET);
 	printf("Print screen in decimal      - %c + enter\n", DECIMAL);
 	printf("Print help in vm             - %c + enter\n", HELP);
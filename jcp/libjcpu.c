@@ -0,0 +1,163 @@
+/* libjcpu.c -- the jcpu emulator as a library */
+/* ver. 1.0 */
+
+/* Wraps jcpu.c and disasm_instr() behind the handles of libjcpu.h. Every
+ * argument from outside is checked here, since the emulator itself trusts
+ * its callers. Nothing in here or below it writes to a global. */
+
+/* Author: Vladimir Dinev */
+#include <stdlib.h>
+#include "libjcpu.h"
+#include "jcpu.h"
+#include "disasm.h"
+
+// the public register numbers are the ones of jcpu.h
+typedef char check_regs[((int)JCP_NUM_REGS == NUM_REGS && (int)JCP_R0 == R0 && JCP_RAM_S == RAM_S) ?
+		1 : -1];
+
+struct jcp_machine_ {
+	jcpu cpu;
+	byte ram[RAM_S];
+};
+
+/* -------------------- PUBLIC INTERFACE START -------------------- */
+int jcp_api_version(void)
+{
+	/* the interface version */
+	return JCP_API_VER;
+}
+
+jcp_machine * jcp_new(void)
+{
+	/* a powered on machine with nothing loaded */
+	jcp_machine * m;
+	
+	if ((m = calloc(1, sizeof(*m))) == NULL)
+		return NULL;
+	
+	jcpu_init(&m->cpu, m->ram, 0);
+	return m;
+}
+
+void jcp_free(jcp_machine * m)
+{
+	/* free the machine */
+	free(m);
+	return;
+}
+
+int jcp_load(jcp_machine * m, const unsigned char * code, int size)
+{
+	/* load code if it fits and power on; jcpu_load()
+	 * alone keeps the registers of the last program */
+	if (size < 1 || size > RAM_S)
+		return -1;
+	
+	jcpu_load(&m->cpu, code, size);
+	jcpu_reset(&m->cpu);
+	return 0;
+}
+
+void jcp_reset(jcp_machine * m)
+{
+	/* back to the loaded program */
+	jcpu_reset(&m->cpu);
+	return;
+}
+
+void jcp_step(jcp_machine * m)
+{
+	/* one instruction */
+	jcpu_step(&m->cpu);
+	return;
+}
+
+unsigned long jcp_run(jcp_machine * m, unsigned long steps)
+{
+	/* run until halted or out of steps */
+	unsigned long n;
+	
+	for (n = 0; n < steps && !jcpu_halted(&m->cpu); ++n)
+		jcpu_step(&m->cpu);
+	
+	return n;
+}
+
+int jcp_halted(const jcp_machine * m)
+{
+	/* is it on a jump to itself */
+	return jcpu_halted(&m->cpu);
+}
+
+int jcp_get_reg(const jcp_machine * m, int reg)
+{
+	/* read a register */
+	if (reg < 0 || reg >= NUM_REGS)
+		return -1;
+	
+	return m->cpu.regs[reg];
+}
+
+int jcp_set_reg(jcp_machine * m, int reg, int val)
+{
+	/* write a register */
+	if (reg < 0 || reg >= NUM_REGS)
+		return -1;
+	
+	m->cpu.regs[reg] = val;
+	return 0;
+}
+
+int jcp_peek(const jcp_machine * m, int addr)
+{
+	/* read a ram byte */
+	if (addr < 0 || addr >= RAM_S)
+		return -1;
+	
+	return m->ram[addr];
+}
+
+int jcp_poke(jcp_machine * m, int addr, int val)
+{
+	/* write a ram byte as a store would */
+	if (addr < 0 || addr >= RAM_S)
+		return -1;
+	
+	jcpu_poke(&m->cpu, addr, val);
+	return 0;
+}
+
+void jcp_get_ram(const jcp_machine * m, unsigned char * ram)
+{
+	/* copy the whole ram */
+	int i;
+	
+	for (i = 0; i < RAM_S; ++i)
+		ram[i] = m->ram[i];
+	return;
+}
+
+unsigned long jcp_icount(const jcp_machine * m)
+{
+	/* instructions since load */
+	return m->cpu.icount;
+}
+
+uint64_t jcp_digest(const jcp_machine * m)
+{
+	/* the digest the stores keep */
+	return m->cpu.digest;
+}
+
+int jcp_disasm(const unsigned char * code, int size, int addr, char * out, int outsz)
+{
+	/* one instruction of code as text */
+	return disasm_instr(code, size, addr, NO_PREF, out, outsz);
+}
+
+int jcp_disasm_at(const jcp_machine * m, int addr, char * out, int outsz)
+{
+	/* one instruction of the ram as text */
+	return disasm_instr(m->ram, RAM_S, addr, NO_PREF, out, outsz);
+}
+/* -------------------- PUBLIC INTERFACE END -------------------- */
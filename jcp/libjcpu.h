@@ -0,0 +1,128 @@
+/* libjcpu.h -- the jcpu emulator as a library public interface */
+/* ver. 1.0 */
+#ifndef LIBJCPU_H
+#define LIBJCPU_H
+
+/* The only header a program using libjcpu.a or libjcpu.so needs. A machine
+ * is a handle whose insides the program doesn't see, so they can change
+ * without breaking it. Nothing is shared between machines, and the library
+ * keeps no state of its own; different machines can be used from different
+ * threads at once, the same machine from one at a time. Functions added in
+ * later versions keep the ones here as they are. */
+
+#include <stdint.h>
+
+#ifdef _WIN32
+	#ifdef JCP_BUILD
+		#define JCP_API	__declspec(dllexport)
+	#else
+		#define JCP_API
+	#endif
+#else
+	#define JCP_API	__attribute__((visibility("default")))
+#endif
+
+#define JCP_API_VER		1		// the version of this interface
+#define JCP_RAM_S		256		// bytes of ram
+#define JCP_DIS_S		32		// room for a disassembled instruction
+
+enum {JCP_MAR, JCP_IAR, JCP_IR, JCP_CF, JCP_AF, JCP_EF, JCP_ZF,
+		JCP_R0, JCP_R1, JCP_R2, JCP_R3, JCP_NUM_REGS};
+/* the registers, for jcp_get_reg() and jcp_set_reg() */
+
+typedef struct jcp_machine_ jcp_machine;
+/* a machine; one core and its ram */
+
+JCP_API int jcp_api_version(void);
+/* returns: JCP_API_VER of the library.
+ *
+ * description: For a program to check that the library it got is at least
+ * as new as the header it was built with. */
+
+JCP_API jcp_machine * jcp_new(void);
+/* returns: A new machine with zeroed ram, NULL if there is no memory.
+ *
+ * description: Makes a machine. Free it with jcp_free(). */
+
+JCP_API void jcp_free(jcp_machine * m);
+/* returns: Nothing.
+ *
+ * description: Frees m. NULL is fine. */
+
+JCP_API int jcp_load(jcp_machine * m, const unsigned char * code, int size);
+/* returns: 0 on success, -1 if size is not 1 to JCP_RAM_S.
+ *
+ * description: Zeroes the ram of m, puts code at its start, and powers m
+ * on, so nothing of what ran on m before is left. What ends up in the ram
+ * is kept for jcp_reset(). */
+
+JCP_API void jcp_reset(jcp_machine * m);
+/* returns: Nothing.
+ *
+ * description: Puts m back the way it was right after jcp_load(). Only the
+ * ram written since is copied back, so it's cheap. */
+
+JCP_API void jcp_step(jcp_machine * m);
+/* returns: Nothing.
+ *
+ * description: Executes one instruction. */
+
+JCP_API unsigned long jcp_run(jcp_machine * m, unsigned long steps);
+/* returns: How many instructions were executed.
+ *
+ * description: Executes instructions until m halts or steps of them are
+ * done. */
+
+JCP_API int jcp_halted(const jcp_machine * m);
+/* returns: 1 if m is stuck on a jump to itself, 0 otherwise.
+ *
+ * description: The programs for the jcpu mark their end this way. */
+
+JCP_API int jcp_get_reg(const jcp_machine * m, int reg);
+/* returns: The value of register reg, -1 if there is no such register.
+ *
+ * description: reg is one of JCP_MAR to JCP_R3. The flags are 0 or 1. */
+
+JCP_API int jcp_set_reg(jcp_machine * m, int reg, int val);
+/* returns: 0 on success, -1 if there is no such register.
+ *
+ * description: Sets register reg to the lowest byte of val. */
+
+JCP_API int jcp_peek(const jcp_machine * m, int addr);
+/* returns: The byte at addr, -1 if addr is not in the ram.
+ *
+ * description: Reads the ram of m. */
+
+JCP_API int jcp_poke(jcp_machine * m, int addr, int val);
+/* returns: 0 on success, -1 if addr is not in the ram.
+ *
+ * description: Writes the lowest byte of val at addr the way a store of
+ * the program would, so jcp_reset() and jcp_digest() know about it. */
+
+JCP_API void jcp_get_ram(const jcp_machine * m, unsigned char * ram);
+/* returns: Nothing.
+ *
+ * description: Copies the JCP_RAM_S bytes of the ram of m to ram. */
+
+JCP_API unsigned long jcp_icount(const jcp_machine * m);
+/* returns: The instructions executed since jcp_load() or jcp_reset(). */
+
+JCP_API uint64_t jcp_digest(const jcp_machine * m);
+/* returns: A 64 bit digest of the ram of m.
+ *
+ * description: Free to call; the machine keeps it up to date as it runs.
+ * Two machines with the same ram have the same digest. */
+
+JCP_API int jcp_disasm(const unsigned char * code, int size, int addr, char * out, int outsz);
+/* returns: The size of the instruction at addr, 1 or 2, or -1 if addr is
+ * not in code or outsz is 0.
+ *
+ * description: Puts the instruction at addr of the size bytes of code in
+ * out as text, the bytes first, then the mnemonic. JCP_DIS_S bytes of out
+ * are always enough. */
+
+JCP_API int jcp_disasm_at(const jcp_machine * m, int addr, char * out, int outsz);
+/* returns: As jcp_disasm().
+ *
+ * description: Disassembles the instruction at addr of the ram of m. */
+#endif
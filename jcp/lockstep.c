@@ -0,0 +1,145 @@
+/* lockstep.c -- runs two engines side by side */
+/* ver. 1.0 */
+
+/* Every engine has to end every instruction in the same state jcpu_step()
+ * does. This runs a program on two of them and compares. Comparing the ram
+ * after every instruction costs more than the instruction itself, but the
+ * digest each core keeps is free, so every few instructions the rest of
+ * the state and the digests are compared, with a checkpoint of both machines
+ * kept at each compare they agree on. When they don't agree, both go back to
+ * the checkpoint and run again with everything compared after every
+ * instruction, which finds the first one they went apart on. No device is
+ * attached, so the second time goes the same way as the first. */
+
+/* Author: Vladimir Dinev */
+#include <string.h>
+#include "lockstep.h"
+
+const lock_eng lock_engs[] = {
+	{"step", jcpu_step},
+	{"ticks", jcpu_step_ticks},
+	{NULL, NULL}
+};
+
+static int run_full(lockstep * ls, unsigned long steps);
+static unsigned long run_some(jcpu * cpu, fpcv_t step, unsigned long steps);
+
+/* -------------------- PUBLIC INTERFACE START -------------------- */
+const lock_eng * lock_find(const char * name)
+{
+	/* look the engine up by name */
+	const lock_eng * eng;
+	
+	for (eng = lock_engs; eng->name != NULL; ++eng)
+	{
+		if (strcmp(eng->name, name) == 0)
+			return eng;
+	}
+	
+	return NULL;
+}
+
+void lock_init(lockstep * ls, const lock_eng * a, const lock_eng * b, unsigned long every)
+{
+	/* power both machines on */
+	jcpu_init(&ls->cpus[0], ls->rams[0], 0);
+	jcpu_init(&ls->cpus[1], ls->rams[1], 0);
+	ls->eng[0] = a;
+	ls->eng[1] = b;
+	ls->every = (every > 0) ? every : 1;
+	ls->last = 0;
+	return;
+}
+
+void lock_load(lockstep * ls, const byte * code, int csize)
+{
+	/* load both and keep them as the last good compare */
+	jcpu_load(&ls->cpus[0], code, csize);
+	jcpu_load(&ls->cpus[1], code, csize);
+	jcpu_save(&ls->cpus[0], &ls->good[0]);
+	jcpu_save(&ls->cpus[1], &ls->good[1]);
+	ls->last = 0;
+	return;
+}
+
+int lock_run(lockstep * ls, unsigned long steps)
+{
+	/* run the first engine until it halts or the next compare, the
+	 * second as many instructions, and compare the cheap way
+	 * if they differ, go back and find where the full way */
+	unsigned long n, done;
+	
+	if (1 == ls->every)
+		return run_full(ls, steps);
+	
+	for (n = 0; n < steps; n += done)
+	{
+		done = run_some(&ls->cpus[0], ls->eng[0]->step,
+				(steps - n < ls->every) ? steps - n : ls->every);
+		run_some(&ls->cpus[1], ls->eng[1]->step, done);
+		
+		if (!lock_same(&ls->cpus[0], &ls->cpus[1], false))
+		{
+			jcpu_restore(&ls->cpus[0], &ls->good[0]);
+			jcpu_restore(&ls->cpus[1], &ls->good[1]);
+			return run_full(ls, done);
+		}
+		
+		jcpu_save(&ls->cpus[0], &ls->good[0]);
+		jcpu_save(&ls->cpus[1], &ls->good[1]);
+		
+		if (done < ls->every)
+			break;
+	}
+	
+	return jcpu_halted(&ls->cpus[0]) ? LOCK_HALT : LOCK_SAME;
+}
+
+bool lock_same(const jcpu * a, const jcpu * b, bool full)
+{
+	/* the registers, the built-in devices, the counter, and
+	 * the digest; the ram itself only if full */
+	if (memcmp(a->regs, b->regs, NUM_REGS) != 0 || a->digest != b->digest ||
+		a->icount != b->icount || a->wait != b->wait || a->dirty != b->dirty ||
+		a->tmr_period != b->tmr_period || a->io_sel != b->io_sel ||
+		a->ivec != b->ivec || a->iiar != b->iiar || a->iflags != b->iflags ||
+		a->isel != b->isel || a->in_irq != b->in_irq || a->irq_pend != b->irq_pend ||
+		a->tas_addr != b->tas_addr)
+		return false;
+	
+	return (!full || memcmp(a->ram, b->ram, RAM_S) == 0);
+}
+/* -------------------- PUBLIC INTERFACE END -------------------- */
+
+static int run_full(lockstep * ls, unsigned long steps)
+{
+	/* one instruction on each, then compare everything */
+	unsigned long n;
+	
+	for (n = 0; n < steps; ++n)
+	{
+		if (jcpu_halted(&ls->cpus[0]))
+			return LOCK_HALT;
+		
+		ls->last = ls->cpus[0].regs[IAR];
+		ls->eng[0]->step(&ls->cpus[0]);
+		ls->eng[1]->step(&ls->cpus[1]);
+		
+		if (!lock_same(&ls->cpus[0], &ls->cpus[1], true))
+			return LOCK_DIFF;
+	}
+	
+	return jcpu_halted(&ls->cpus[0]) ? LOCK_HALT : LOCK_SAME;
+}
+
+static unsigned long run_some(jcpu * cpu, fpcv_t step, unsigned long steps)
+{
+	/* run cpu for steps instructions or until it halts
+	 * return how many it ran */
+	unsigned long n;
+	
+	for (n = 0; n < steps && !jcpu_halted(cpu); ++n)
+		step(cpu);
+	
+	return n;
+}
@@ -0,0 +1,64 @@
+/* lockstep.h -- runs two engines side by side public interface */
+/* ver. 1.0 */
+#ifndef LOCKSTEP_H
+#define LOCKSTEP_H
+
+#include "jcpu.h"
+
+enum {LOCK_SAME, LOCK_HALT, LOCK_DIFF};
+/* how a run ended up; out of steps, halted, or the engines went apart */
+
+// a way to execute one instruction of a core
+typedef struct lock_eng_ {
+	const char * name;		// what it's called on the command line
+	fpcv_t step;			// executes an instruction
+} lock_eng;
+
+extern const lock_eng lock_engs[];
+/* all engines; the last one has a NULL name */
+
+// the same program on two engines
+typedef struct lockstep_ {
+	jcpu cpus[2];			// the machine on each engine
+	byte rams[2][RAM_S];	// and its ram
+	const lock_eng * eng[2];
+	unsigned long every;	// instructions between compares; 1 compares everything
+	byte last;				// the address of the instruction they went apart on
+	jcpu_ckpt good[2];		// both machines at the last compare they agreed on
+} lockstep;
+
+const lock_eng * lock_find(const char * name);
+/* returns: The engine called name, NULL if there is none.
+ *
+ * description: Looks name up in lock_engs. */
+
+void lock_init(lockstep * ls, const lock_eng * a, const lock_eng * b, unsigned long every);
+/* returns: Nothing.
+ *
+ * description: Sets ls up to run a and b side by side and compare them every
+ * every instructions. 1 compares the whole state after every instruction.
+ * More compares the ram by its digest only, which is far cheaper; when
+ * anything differs, both go back to the last compare and run again one
+ * instruction at a time to find where they went apart. */
+
+void lock_load(lockstep * ls, const byte * code, int csize);
+/* returns: Nothing.
+ *
+ * description: Loads code in both machines of ls. */
+
+int lock_run(lockstep * ls, unsigned long steps);
+/* returns: LOCK_SAME if both executed steps instructions more and agree,
+ * LOCK_HALT if they halted and agree, LOCK_DIFF if they don't.
+ *
+ * description: Runs both machines of ls. On LOCK_DIFF both are left right
+ * after the first instruction they don't agree on, and ls->last is its
+ * address. The time the engines count, the timer countdown and the cycles,
+ * isn't compared, as it is up to the engine. Neither is the stepper state
+ * between instructions. */
+
+bool lock_same(const jcpu * a, const jcpu * b, bool full);
+/* returns: True if a and b are in the same state, false otherwise.
+ *
+ * description: Compares a and b as lock_run() does; the whole state when full
+ * is true, else the ram only by its digest. */
+#endif
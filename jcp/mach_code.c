@@ -1,10 +1,11 @@
 /* mach_code.c -- maps the jcpu machine code to text mnemonics */
-/* ver. 1.0 */
+/* ver. 1.01 */
  
 /* Instructions are mapped by their left nibble. 
  * The condition for the conditional jump instruction JCOND is 
  * specified by it's right nibble and the rest of the name is
- * added to the lone "J" at run time. */
+ * added to the lone "J" at run time. The same goes for IO, which
+ * becomes IN/OUT DATA/ADDR depending on it's right nibble. */
  
  /* Author: Vladimir Dinev */
 #include "mach_code.h"
@@ -18,7 +19,7 @@ instr mcode[INSTR_COUNT] = {
 		{2, JMP, 	"JMP"},		// second byte is next byte in memory
 		{2, JCOND,	"J"},		// second byte is next byte in memory
 		{1, CLF, 	"CLF"},
-		{1, PAD, 	"PAD"},		// dummy instruction for array padding
+		{1, IO, 	"IO"},		// IN/OUT DATA/ADDR, decided by the right nibble
 		{1, ADD, 	"ADD"},
 		{1, SHR, 	"SHR"},
 		{1, SHL, 	"SHL"},
@@ -32,3 +33,8 @@ instr mcode[INSTR_COUNT] = {
 // register mnemonics
 char * gregs[GREGS] = {"R0", "R1", "R2", "R3"};
 char * flags[FLAGSN] = {"", "Z", "E", "", "A", "", "", "", "C"};
+
+// IN/OUT DATA/ADDR mnemonics; indexed by the IO_OUT and IO_ADDR bits
+char * iodir[2] = {"IN", "OUT"};
+char * iokind[2] = {"DATA", "ADDR"};
+char iret_name[] = "IRET";
@@ -1,17 +1,20 @@
 /* mach_code.h -- machine code values */
-/* ver. 1.0 */
+/* ver. 1.01 */
 #ifndef MACH_CODE_H
 #define MACH_CODE_H
 
 #define INSTR_STR 	8 	// max instruction size
 #define GREGS		4	// 4 general registers
 #define FLAGSN		9 	// 4 flags + 5 padding indices
+#define IRET_INSTR	0x61	// CLF with the lowest bit set returns from an interrupt
+#define IO_OUT		0x08	// & 0x08 of an IO instruction; set for OUT, clear for IN
+#define IO_ADDR		0x04	// & 0x04 of an IO instruction; set for ADDR, clear for DATA
 
 enum {	LOAD, STORE,
 		DATA,
 		JMPR, JMP, JCOND,
 		CLF,
-		PAD, // padding 
+		IO, // IN/OUT DATA/ADDR
 		ADD, SHR, SHL, NOT, AND, OR, XOR, CMP,
 		INSTR_COUNT};
 
@@ -25,4 +28,7 @@ typedef struct instr_ {
 extern instr mcode[INSTR_COUNT];
 extern char * gregs[GREGS];
 extern char * flags[FLAGSN];
+extern char * iodir[2];
+extern char * iokind[2];
+extern char iret_name[];
 #endif
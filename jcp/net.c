@@ -0,0 +1,627 @@
+/* net.c -- a network of jcpu nodes connected by channels */
+/* ver. 1.01 */
+
+/* Every node is a core with a ram of its own. Nodes talk through
+ * bounded FIFO channels which they see as I/O ports. The nodes are run
+ * in slices by a pool of threads. Every thread has a Chase-Lev deque of
+ * nodes ready to run; it takes from its own bottom and steals from the
+ * top of the others. A node which has to wait on a channel is parked on
+ * it instead of being queued again. The node on the other end wakes it up
+ * by queueing it on its own thread. */
+
+/* Author: Vladimir Dinev */
+#include "os_def.h"
+#include <stdlib.h>
+#include <string.h>
+#include <stdbool.h>
+#ifdef WINDOWS
+#define yield()		SwitchToThread()
+#else
+#include <pthread.h>
+#include <sched.h>
+#define yield()		sched_yield()
+#endif
+#include "net.h"
+
+#define SLICE		4096	// instructions a node runs before going back in the queue
+#define ld_acq(p)	__atomic_load_n((p), __ATOMIC_ACQUIRE)
+#define ld_rlx(p)	__atomic_load_n((p), __ATOMIC_RELAXED)
+#define st_rel(p,v)	__atomic_store_n((p), (v), __ATOMIC_RELEASE)
+#define st_rlx(p,v)	__atomic_store_n((p), (v), __ATOMIC_RELAXED)
+#define fence()		__atomic_thread_fence(__ATOMIC_SEQ_CST)
+
+struct node_;
+
+typedef struct chan_ {
+	byte * buff;			// the bytes in flight
+	unsigned long cap;		// how many bytes fit
+	unsigned long mask;		// buff is a power of two bytes long
+	unsigned long head;		// next byte to take; only the reader moves it
+	unsigned long tail;		// next byte to put; only the writer moves it
+	struct node_ * rd_wait;	// the reader parked on an empty channel
+	struct node_ * wr_wait;	// the writer parked on a full channel
+} chan;
+
+typedef struct node_ {
+	jcpu cpu;				// the core
+	byte ram[RAM_S];		// its private ram
+	chan * in[RAM_S];		// channels to read from by port
+	chan * out[RAM_S];		// channels to write to by port
+	chan * blk;				// the channel it has to wait for
+	bool blk_rd;			// waiting to read if true, to write if false
+	unsigned long left;		// instructions left
+	int state;				// NET_HALTED, NET_BLOCKED, or NET_STOPPED
+} node;
+
+typedef struct deque_ {
+	long top;				// thieves take from here
+	long bottom;			// the owner pushes and takes here
+	long mask;				// nodes is mask + 1 long
+	node ** nodes;			// the ring of queued nodes
+} deque;
+
+typedef struct worker_ {
+	deque dq;				// the nodes ready to run
+	net * nw;				// the network
+	unsigned int seed;		// for picking a victim to steal from
+	int id;					// the number of the worker
+} worker;
+
+struct net_ {
+	node * nodes;			// all nodes
+	int nnodes;				// how many
+	chan ** chans;			// all channels, for freeing
+	int nchans;				// how many
+	worker * wks;			// the thread pool
+	int nwks;				// how many threads
+	long ready;				// nodes queued or running; done when 0
+};
+
+static __thread worker * this_wk;	// the worker of the calling thread
+
+static long pow2(long n);
+static void dq_push(deque * dq, node * nd);
+static node * dq_take(deque * dq);
+static node * dq_steal(deque * dq);
+static void schedule(node * nd);
+static void wake(node ** slot);
+static bool park(node * nd);
+static void run_node(worker * wk, node * nd);
+static node * find_work(worker * wk);
+static int chan_in(void * ctx, byte port, byte * val);
+static int chan_out(void * ctx, byte port, byte val);
+static void play_node(node * nd, replay_log * log);
+
+/* -------------------- PUBLIC INTERFACE START -------------------- */
+net * net_new(int nnodes)
+{
+	/* make nnodes empty nodes */
+	net * nw;
+	jcpu_dev dev = {chan_in, chan_out, NULL};
+	int i;
+	
+	if (nnodes < 1 || (nw = calloc(1, sizeof(*nw))) == NULL)
+		return NULL;
+	
+	if ((nw->nodes = calloc(nnodes, sizeof(*nw->nodes))) == NULL)
+	{
+		free(nw);
+		return NULL;
+	}
+	
+	nw->nnodes = nnodes;
+	for (i = 0; i < nnodes; ++i)
+	{
+		jcpu_init(&nw->nodes[i].cpu, nw->nodes[i].ram, i);
+		dev.ctx = &nw->nodes[i];
+		jcpu_attach(&nw->nodes[i].cpu, &dev);
+		nw->nodes[i].state = NET_STOPPED;
+	}
+	
+	return nw;
+}
+
+void net_free(net * nw)
+{
+	/* free the channels, nodes, and workers */
+	int i;
+	
+	for (i = 0; i < nw->nchans; ++i)
+	{
+		free(nw->chans[i]->buff);
+		free(nw->chans[i]);
+	}
+	
+	free(nw->chans);
+	free(nw->nodes);
+	free(nw);
+	return;
+}
+
+void net_load(net * nw, int node, const byte * code, int csize)
+{
+	/* load code in the node's ram */
+	jcpu_load(&nw->nodes[node].cpu, code, csize);
+	return;
+}
+
+int net_chan(net * nw, int from, byte out_port, int to, byte in_port, int cap)
+{
+	/* connect out_port of from to in_port of to */
+	chan * ch, ** chans;
+	
+	if (from < 0 || from >= nw->nnodes || to < 0 || to >= nw->nnodes || cap < 1 ||
+		out_port < PORT_LOCAL || in_port < PORT_LOCAL ||
+		nw->nodes[from].out[out_port] != NULL || nw->nodes[to].in[in_port] != NULL)
+		return -1;
+	
+	if ((ch = calloc(1, sizeof(*ch))) == NULL)
+		return -1;
+	
+	ch->cap = cap;
+	ch->mask = pow2(cap) - 1;
+	if ((ch->buff = malloc(ch->mask + 1)) == NULL ||
+		(chans = realloc(nw->chans, (nw->nchans + 1) * sizeof(*chans))) == NULL)
+	{
+		free(ch->buff);
+		free(ch);
+		return -1;
+	}
+	
+	nw->chans = chans;
+	nw->chans[nw->nchans++] = ch;
+	nw->nodes[from].out[out_port] = ch;
+	nw->nodes[to].in[in_port] = ch;
+	return 0;
+}
+
+#ifdef WINDOWS
+static DWORD WINAPI work(LPVOID arg)
+#else
+static void * work(void * arg)
+#endif
+{
+	/* run nodes until none is ready or running */
+	worker * wk = arg;
+	node * nd;
+	
+	this_wk = wk;
+	while (ld_acq(&wk->nw->ready) > 0)
+	{
+		if ((nd = find_work(wk)) != NULL)
+			run_node(wk, nd);
+		else
+			yield();
+	}
+	
+	return 0;
+}
+
+int net_run(net * nw, int nthreads, unsigned long steps)
+{
+	/* deal the nodes to the workers
+	 * start the threads and wait for them */
+	int i, started, res = 0;
+	long cap = pow2(nw->nnodes);
+#ifdef WINDOWS
+	HANDLE thrd[NET_MAX_THRDS];
+#else
+	pthread_t thrd[NET_MAX_THRDS];
+#endif
+
+	if (nthreads < 1)
+		nthreads = 1;
+	if (nthreads > NET_MAX_THRDS)
+		nthreads = NET_MAX_THRDS;
+	
+	// every node is in one deque at most, so no deque ever grows
+	if ((nw->wks = calloc(nthreads, sizeof(*nw->wks))) == NULL)
+		return -1;
+	
+	for (i = 0; i < nthreads; ++i)
+	{
+		nw->wks[i].nw = nw;
+		nw->wks[i].id = i;
+		nw->wks[i].seed = i * 2654435761u + 1;
+		nw->wks[i].dq.mask = cap - 1;
+		if ((nw->wks[i].dq.nodes = malloc(cap * sizeof(node *))) == NULL)
+		{
+			nthreads = i;
+			res = -1;
+			goto cleanup;
+		}
+	}
+	nw->nwks = nthreads;
+	
+	nw->ready = nw->nnodes;
+	for (i = 0; i < nw->nnodes; ++i)
+	{
+		nw->nodes[i].left = steps;
+		nw->nodes[i].state = NET_STOPPED;
+		dq_push(&nw->wks[i % nthreads].dq, &nw->nodes[i]);
+	}
+	
+	for (started = 0; started < nthreads; ++started)
+	{
+#ifdef WINDOWS
+		if ((thrd[started] = CreateThread(NULL, 0, work, &nw->wks[started], 0, NULL)) == NULL)
+			break;
+#else
+		if (pthread_create(&thrd[started], NULL, work, &nw->wks[started]) != 0)
+			break;
+#endif
+	}
+	
+	// a thread which did not start leaves its nodes to the thieves
+	if (0 == started)
+		work(&nw->wks[0]);
+	
+	for (i = 0; i < started; ++i)
+	{
+#ifdef WINDOWS
+		WaitForSingleObject(thrd[i], INFINITE);
+		CloseHandle(thrd[i]);
+#else
+		pthread_join(thrd[i], NULL);
+#endif
+	}
+
+cleanup:
+	for (i = 0; i < nthreads; ++i)
+		free(nw->wks[i].dq.nodes);
+	free(nw->wks);
+	nw->wks = NULL;
+	return res;
+}
+
+void net_record(net * nw, replay_log * logs)
+{
+	/* put a recorder between every node and its channels */
+	int i;
+	
+	for (i = 0; i < nw->nnodes; ++i)
+		replay_record(&logs[i], &nw->nodes[i].cpu);
+	return;
+}
+
+// the nodes left to play back
+typedef struct player_ {
+	net * nw;
+	replay_log * logs;
+	long next;				// the next node to take
+} player;
+
+#ifdef WINDOWS
+static DWORD WINAPI play_work(LPVOID arg)
+#else
+static void * play_work(void * arg)
+#endif
+{
+	/* play nodes back until none is left */
+	player * pl = arg;
+	long i;
+	
+	while ((i = __atomic_fetch_add(&pl->next, 1, __ATOMIC_RELAXED)) < pl->nw->nnodes)
+		play_node(&pl->nw->nodes[i], &pl->logs[i]);
+	
+	return 0;
+}
+
+void net_play(net * nw, replay_log * logs, int nthreads)
+{
+	/* the nodes don't talk to each other, so every thread
+	 * takes the next node until none is left, the caller too */
+	player pl = {nw, logs, 0};
+	int i, started;
+#ifdef WINDOWS
+	HANDLE thrd[NET_MAX_THRDS];
+#else
+	pthread_t thrd[NET_MAX_THRDS];
+#endif
+
+	if (nthreads < 1)
+		nthreads = 1;
+	if (nthreads > NET_MAX_THRDS)
+		nthreads = NET_MAX_THRDS;
+	
+	for (started = 0; started < nthreads - 1; ++started)
+	{
+#ifdef WINDOWS
+		if ((thrd[started] = CreateThread(NULL, 0, play_work, &pl, 0, NULL)) == NULL)
+			break;
+#else
+		if (pthread_create(&thrd[started], NULL, play_work, &pl) != 0)
+			break;
+#endif
+	}
+	
+	play_work(&pl);
+	
+	for (i = 0; i < started; ++i)
+	{
+#ifdef WINDOWS
+		WaitForSingleObject(thrd[i], INFINITE);
+		CloseHandle(thrd[i]);
+#else
+		pthread_join(thrd[i], NULL);
+#endif
+	}
+	
+	return;
+}
+
+const jcpu * net_cpu(const net * nw, int node)
+{
+	/* the core of the node */
+	return &nw->nodes[node].cpu;
+}
+
+int net_state(const net * nw, int node)
+{
+	/* how the node ended up */
+	return nw->nodes[node].state;
+}
+/* -------------------- PUBLIC INTERFACE END -------------------- */
+
+static long pow2(long n)
+{
+	/* the smallest power of two >= n */
+	long p = 1;
+	
+	while (p < n)
+		p <<= 1;
+	
+	return p;
+}
+
+static void dq_push(deque * dq, node * nd)
+{
+	/* owner only; put nd at the bottom */
+	long b = ld_rlx(&dq->bottom);
+	
+	st_rlx(&dq->nodes[b & dq->mask], nd);
+	__atomic_thread_fence(__ATOMIC_RELEASE);
+	st_rlx(&dq->bottom, b + 1);
+	return;
+}
+
+static node * dq_take(deque * dq)
+{
+	/* owner only; take from the bottom
+	 * race the thieves for the last node */
+	long b = ld_rlx(&dq->bottom) - 1;
+	long t;
+	node * nd = NULL;
+	
+	st_rlx(&dq->bottom, b);
+	fence();
+	t = ld_rlx(&dq->top);
+	
+	if (t <= b)
+	{
+		nd = ld_rlx(&dq->nodes[b & dq->mask]);
+		if (t == b)
+		{
+			if (!__atomic_compare_exchange_n(&dq->top, &t, t + 1, false,
+					__ATOMIC_SEQ_CST, __ATOMIC_RELAXED))
+				nd = NULL;
+			st_rlx(&dq->bottom, b + 1);
+		}
+	}
+	else
+		st_rlx(&dq->bottom, b + 1);
+	
+	return nd;
+}
+
+static node * dq_steal(deque * dq)
+{
+	/* anyone; take from the top */
+	long t = ld_acq(&dq->top);
+	long b;
+	node * nd;
+	
+	fence();
+	b = ld_acq(&dq->bottom);
+	if (t >= b)
+		return NULL;
+	
+	nd = ld_rlx(&dq->nodes[t & dq->mask]);
+	if (!__atomic_compare_exchange_n(&dq->top, &t, t + 1, false,
+			__ATOMIC_SEQ_CST, __ATOMIC_RELAXED))
+		return NULL;
+	
+	return nd;
+}
+
+static node * find_work(worker * wk)
+{
+	/* own deque first, then steal from a random victim
+	 * and from everyone else in order */
+	node * nd;
+	int i, victim;
+	
+	if ((nd = dq_take(&wk->dq)) != NULL)
+		return nd;
+	
+	wk->seed ^= wk->seed << 13;
+	wk->seed ^= wk->seed >> 17;
+	wk->seed ^= wk->seed << 5;
+	victim = wk->seed % wk->nw->nwks;
+	
+	for (i = 0; i < wk->nw->nwks; ++i, victim = (victim + 1) % wk->nw->nwks)
+	{
+		if (victim != wk->id && (nd = dq_steal(&wk->nw->wks[victim].dq)) != NULL)
+			return nd;
+	}
+	
+	return NULL;
+}
+
+static void schedule(node * nd)
+{
+	/* make nd ready again on the calling worker */
+	__atomic_add_fetch(&this_wk->nw->ready, 1, __ATOMIC_SEQ_CST);
+	dq_push(&this_wk->dq, nd);
+	return;
+}
+
+static void wake(node ** slot)
+{
+	/* called after moving a channel's head or tail
+	 * schedule the node parked on the other end, if any */
+	node * nd;
+	
+	fence();
+	if (ld_rlx(slot) != NULL && (nd = __atomic_exchange_n(slot, NULL, __ATOMIC_SEQ_CST)) != NULL)
+		schedule(nd);
+	
+	return;
+}
+
+static bool park(node * nd)
+{
+	/* park nd on the channel it waits for
+	 * return false if the channel got ready meanwhile and nd can go on */
+	chan * ch = nd->blk;
+	node ** slot = nd->blk_rd ? &ch->rd_wait : &ch->wr_wait;
+	bool ready;
+	
+	nd->state = NET_BLOCKED;
+	__atomic_store_n(slot, nd, __ATOMIC_SEQ_CST);
+	fence();
+	
+	if (nd->blk_rd)
+		ready = (ld_acq(&ch->tail) != ch->head);
+	else
+		ready = (ch->tail - ld_acq(&ch->head) < ch->cap);
+	
+	if (!ready)
+		return true;
+	
+	// whoever takes nd off the slot runs it
+	if (__atomic_exchange_n(slot, NULL, __ATOMIC_SEQ_CST) != nd)
+		return true;
+	
+	nd->state = NET_STOPPED;
+	return false;
+}
+
+static void run_node(worker * wk, node * nd)
+{
+	/* run a slice of nd
+	 * queue it again, park it, or retire it */
+	unsigned long n = SLICE;
+	
+	nd->state = NET_STOPPED;
+	while (true)
+	{
+		if (0 == nd->left)
+			break;
+		
+		if (jcpu_halted(&nd->cpu))
+		{
+			nd->state = NET_HALTED;
+			break;
+		}
+		
+		if (0 == n--)
+		{
+			dq_push(&wk->dq, nd);
+			return;
+		}
+		
+		jcpu_step(&nd->cpu);
+		if (nd->cpu.wait)
+		{
+			nd->cpu.wait = false;
+			if (park(nd))
+				break;
+			continue;
+		}
+		--nd->left;
+	}
+	
+	// parked or done; nd may already be running elsewhere
+	__atomic_sub_fetch(&wk->nw->ready, 1, __ATOMIC_SEQ_CST);
+	return;
+}
+
+static int chan_in(void * ctx, byte port, byte * val)
+{
+	/* IN DATA from a channel; wait if it's empty */
+	node * nd = ctx;
+	chan * ch = nd->in[port];
+	
+	if (NULL == ch)
+	{
+		*val = 0;
+		return IO_DONE;
+	}
+	
+	if (ld_acq(&ch->tail) == ch->head)
+	{
+		nd->blk = ch;
+		nd->blk_rd = true;
+		return IO_WAIT;
+	}
+	
+	*val = ch->buff[ch->head & ch->mask];
+	st_rel(&ch->head, ch->head + 1);
+	wake(&ch->wr_wait);
+	return IO_DONE;
+}
+
+static int chan_out(void * ctx, byte port, byte val)
+{
+	/* OUT DATA to a channel; wait if it's full */
+	node * nd = ctx;
+	chan * ch = nd->out[port];
+	
+	if (NULL == ch)
+		return IO_DONE;
+	
+	if (ch->tail - ld_acq(&ch->head) >= ch->cap)
+	{
+		nd->blk = ch;
+		nd->blk_rd = false;
+		return IO_WAIT;
+	}
+	
+	ch->buff[ch->tail & ch->mask] = val;
+	st_rel(&ch->tail, ch->tail + 1);
+	wake(&ch->rd_wait);
+	return IO_DONE;
+}
+
+static void play_node(node * nd, replay_log * log)
+{
+	/* run nd on log as far as it got when recorded
+	 * a wait costs a step, as it did then
+	 * a node left waiting on a channel makes its call once more */
+	jcpu * cpu = &nd->cpu;
+	
+	replay_play(log, cpu);
+	while (cpu->icount < log->end && !jcpu_halted(cpu) && !log->failed)
+	{
+		jcpu_step(cpu);
+		cpu->wait = false;
+	}
+	
+	if (log->next != log->nevs)
+		log->failed = true;
+	
+	if (!log->failed && !jcpu_halted(cpu) && NET_BLOCKED == log->state)
+	{
+		jcpu_step(cpu);
+		cpu->wait = false;
+	}
+	
+	if (jcpu_halted(cpu))
+		nd->state = NET_HALTED;
+	else if (log->failed)
+		nd->state = NET_BLOCKED;
+	else
+		nd->state = log->state;
+	return;
+}
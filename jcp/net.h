@@ -0,0 +1,76 @@
+/* net.h -- the network of cpus public interface */
+/* ver. 1.01 */
+#ifndef NET_H
+#define NET_H
+
+#include "jcpu.h"
+#include "replay.h"
+
+#define NET_CHAN_CAP	16		// default channel capacity in bytes
+#define NET_MAX_THRDS	64		// the most threads net_run() uses
+
+enum {NET_HALTED, NET_BLOCKED, NET_STOPPED};
+/* how a node ended up; halted, waiting on a channel forever, or out of steps */
+
+typedef struct net_ net;
+/* a network of nodes with private ram, connected by channels */
+
+net * net_new(int nnodes);
+/* returns: A pointer to the new network, NULL if there is no memory.
+ *
+ * description: Makes a network of nnodes nodes with nothing loaded
+ * and no channels. */
+
+void net_free(net * nw);
+/* returns: Nothing.
+ *
+ * description: Frees everything allocated for nw. */
+
+void net_load(net * nw, int node, const byte * code, int csize);
+/* returns: Nothing.
+ *
+ * description: Loads code in the ram of node. */
+
+int net_chan(net * nw, int from, byte out_port, int to, byte in_port, int cap);
+/* returns: 0 on success, -1 if a node or port is wrong or already connected.
+ *
+ * description: Makes a channel of cap bytes. OUT DATA to out_port on node
+ * from puts a byte in it, IN DATA from in_port on node to takes it out.
+ * Both wait when the channel is full or empty. Ports start at PORT_LOCAL. */
+
+int net_run(net * nw, int nthreads, unsigned long steps);
+/* returns: 0 on success, -1 if the threads could not be started.
+ *
+ * description: Runs every node until it halts, executes steps instructions,
+ * or waits on a channel nobody will ever serve. The nodes are spread over
+ * nthreads threads, each with a work queue of its own; idle threads steal from
+ * the others. A node waiting on a channel leaves the queues until the other
+ * end of the channel wakes it up. */
+
+void net_record(net * nw, replay_log * logs);
+/* returns: Nothing.
+ *
+ * description: Records the input of every node from its channels; node n
+ * in logs[n]. logs must be zeroed and as long as the number of nodes. Call
+ * before net_run(). */
+
+void net_play(net * nw, replay_log * logs, int nthreads);
+/* returns: Nothing.
+ *
+ * description: Runs every node on its own with the input in its log instead
+ * of the channels, until it halts or gets to the icount in logs[n].end, where
+ * it takes logs[n].state. The nodes are dealt to nthreads threads with no
+ * other work to share; if the threads can't be started, the caller plays them
+ * all. A node which goes another way than the log ends up
+ * NET_BLOCKED, with logs[n].failed set. */
+
+const jcpu * net_cpu(const net * nw, int node);
+/* returns: The core of node.
+ *
+ * description: For looking at the state of a node after net_run(). */
+
+int net_state(const net * nw, int node);
+/* returns: NET_HALTED, NET_BLOCKED, or NET_STOPPED.
+ *
+ * description: Tells how node ended up after net_run(). */
+#endif
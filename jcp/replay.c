@@ -0,0 +1,291 @@
+/* replay.c -- records and plays back the input of a core */
+/* ver. 1.0 */
+
+/* A recording is what the device outside a core did, call by call, in
+ * the order of the instructions. The bytes read are what the program sees.
+ * The waits matter too, since every one of them counts down the timer, so
+ * they decide where an interrupt comes. A call which waits and then reads is
+ * one event; one which waits until an interrupt comes is an event of its
+ * own, made when the next call shows it was left. An OUT DATA which didn't
+ * wait is left out. Played back, a core gets the same bytes after the same
+ * number of waits, so it goes the same way with no device at all. */
+
+/* Author: Vladimir Dinev */
+#include <stdlib.h>
+#include <string.h>
+#include "replay.h"
+
+// the head of a recording
+typedef struct file_head_ {
+	char magic[8];			// REPLAY_MAGIC, no '\0'
+	uint32_t version;		// REPLAY_VER
+	uint32_t nlogs;			// how many logs follow
+} file_head;
+
+// the head of every log in a recording, before its events
+typedef struct log_head_ {
+	uint64_t end;
+	uint64_t nevs;
+	uint32_t state;
+	uint32_t pad;			// to 8 bytes
+} log_head;
+
+static int rec_in(void * ctx, byte port, byte * val);
+static int rec_out(void * ctx, byte port, byte val);
+static void rec_call(replay_log * log, byte kind, byte port, byte val, int res);
+static int play_in(void * ctx, byte port, byte * val);
+static int play_out(void * ctx, byte port, byte val);
+static int play_call(replay_log * log, byte kind, byte port, byte * val);
+static void add(replay_log * log, const replay_ev * ev);
+
+/* -------------------- PUBLIC INTERFACE START -------------------- */
+void replay_record(replay_log * log, jcpu * cpu)
+{
+	/* keep the device and put the recorder in its place */
+	jcpu_dev dev = {rec_in, rec_out, log};
+	
+	log->cpu = cpu;
+	log->dev = cpu->dev;
+	jcpu_attach(cpu, &dev);
+	return;
+}
+
+void replay_play(replay_log * log, jcpu * cpu)
+{
+	/* put the player in place of the device */
+	jcpu_dev dev = {play_in, play_out, log};
+	
+	log->cpu = cpu;
+	log->next = 0;
+	log->waited = 0;
+	log->failed = false;
+	jcpu_attach(cpu, &dev);
+	return;
+}
+
+int replay_write(FILE * fp, const replay_log * logs, int nlogs)
+{
+	/* write the head, then the head and the events of every log */
+	file_head fh;
+	log_head lh;
+	int i;
+	
+	memset(&fh, 0, sizeof(fh));
+	memcpy(fh.magic, REPLAY_MAGIC, sizeof(fh.magic));
+	fh.version = REPLAY_VER;
+	fh.nlogs = nlogs;
+	if (fwrite(&fh, sizeof(fh), 1, fp) != 1)
+		return -1;
+	
+	for (i = 0; i < nlogs; ++i)
+	{
+		memset(&lh, 0, sizeof(lh));
+		lh.end = logs[i].end;
+		lh.nevs = logs[i].nevs;
+		lh.state = logs[i].state;
+		if (fwrite(&lh, sizeof(lh), 1, fp) != 1 ||
+			(logs[i].nevs > 0 &&
+			fwrite(logs[i].evs, sizeof(replay_ev), logs[i].nevs, fp) != (size_t)logs[i].nevs))
+			return -1;
+	}
+	
+	return 0;
+}
+
+replay_log * replay_read(FILE * fp, int * nlogs)
+{
+	/* read the head, then the head and the events of every log */
+	replay_log * logs;
+	file_head fh;
+	log_head lh;
+	uint32_t i;
+	
+	if (fread(&fh, sizeof(fh), 1, fp) != 1 ||
+		strncmp(fh.magic, REPLAY_MAGIC, sizeof(fh.magic)) != 0 || fh.version != REPLAY_VER ||
+		(logs = calloc(fh.nlogs + 1, sizeof(*logs))) == NULL)
+		return NULL;
+	
+	for (i = 0; i < fh.nlogs; ++i)
+	{
+		if (fread(&lh, sizeof(lh), 1, fp) != 1 ||
+			(logs[i].evs = malloc(lh.nevs * sizeof(replay_ev) + 1)) == NULL ||
+			fread(logs[i].evs, sizeof(replay_ev), lh.nevs, fp) != lh.nevs)
+		{
+			replay_free(logs, i + 1);
+			return NULL;
+		}
+		
+		logs[i].nevs = logs[i].cap = lh.nevs;
+		logs[i].end = lh.end;
+		logs[i].state = lh.state;
+	}
+	
+	*nlogs = fh.nlogs;
+	return logs;
+}
+
+void replay_free(replay_log * logs, int nlogs)
+{
+	/* free the events of every log, then the logs */
+	int i;
+	
+	for (i = 0; i < nlogs; ++i)
+		free(logs[i].evs);
+	free(logs);
+	return;
+}
+/* -------------------- PUBLIC INTERFACE END -------------------- */
+
+static int rec_in(void * ctx, byte port, byte * val)
+{
+	/* ask the device and log what it said
+	 * no device reads as 0, as in jcpu.c */
+	replay_log * log = ctx;
+	int res = IO_DONE;
+	
+	if (log->dev.in != NULL)
+		res = log->dev.in(log->dev.ctx, port, val);
+	else
+		*val = 0;
+	
+	rec_call(log, REPLAY_IN, port, *val, res);
+	return res;
+}
+
+static int rec_out(void * ctx, byte port, byte val)
+{
+	/* pass val on to the device and log if it had to wait */
+	replay_log * log = ctx;
+	int res = IO_DONE;
+	
+	if (log->dev.out != NULL)
+		res = log->dev.out(log->dev.ctx, port, val);
+	
+	rec_call(log, REPLAY_OUT, port, val, res);
+	return res;
+}
+
+static void rec_call(replay_log * log, byte kind, byte port, byte val, int res)
+{
+	/* log the waits of an earlier call if this is another one; an
+	 * interrupt came while it waited, the handler counts in icount
+	 * count a wait, or log the call and the waits before it */
+	uint64_t icount = log->cpu->icount;
+	replay_ev ev;
+	
+	if (log->pend.waits > 0 &&
+		(log->pend.icount != icount || log->pend.port != port || log->pend.kind != kind))
+	{
+		ev = log->pend;
+		ev.kind = REPLAY_WAIT;
+		add(log, &ev);
+		log->pend.waits = 0;
+	}
+	
+	if (IO_WAIT == res)
+	{
+		log->pend.icount = icount;
+		log->pend.port = port;
+		log->pend.kind = kind;
+		++log->pend.waits;
+		return;
+	}
+	
+	if (REPLAY_IN == kind || log->pend.waits > 0)
+	{
+		memset(&ev, 0, sizeof(ev));
+		ev.icount = icount;
+		ev.waits = log->pend.waits;
+		ev.kind = kind;
+		ev.port = port;
+		ev.val = val;
+		add(log, &ev);
+	}
+	
+	log->pend.waits = 0;
+	return;
+}
+
+static int play_in(void * ctx, byte port, byte * val)
+{
+	/* IN DATA from the log */
+	return play_call(ctx, REPLAY_IN, port, val);
+}
+
+static int play_out(void * ctx, byte port, byte val)
+{
+	/* OUT DATA goes nowhere, but waits as logged */
+	return play_call(ctx, REPLAY_OUT, port, &val);
+}
+
+static int play_call(replay_log * log, byte kind, byte port, byte * val)
+{
+	/* a call after the last event at the end of the log is the one
+	 * the core was left waiting on
+	 * an OUT DATA with no event of its own didn't wait
+	 * otherwise the call has to be the next event; wait as many times
+	 * as it did, then read its byte. A REPLAY_WAIT event is done after
+	 * its last wait, since then the interrupt comes */
+	uint64_t icount = log->cpu->icount;
+	replay_ev * ev = &log->evs[log->next];
+	bool here = (log->next < log->nevs && ev->icount == icount);
+	
+	if (!log->failed && log->next == log->nevs && icount >= log->end)
+		return IO_WAIT;
+	
+	if (!log->failed && REPLAY_OUT == kind && !here &&
+		(log->next == log->nevs || ev->icount > icount))
+		return IO_DONE;
+	
+	if (log->failed || !here || ev->port != port ||
+		(ev->kind != kind && ev->kind != REPLAY_WAIT))
+	{
+		log->failed = true;
+		return IO_WAIT;
+	}
+	
+	if (log->waited < ev->waits)
+	{
+		if (++log->waited == ev->waits && REPLAY_WAIT == ev->kind)
+		{
+			++log->next;
+			log->waited = 0;
+		}
+		
+		return IO_WAIT;
+	}
+	
+	if (REPLAY_IN == kind)
+		*val = ev->val;
+	
+	++log->next;
+	log->waited = 0;
+	return IO_DONE;
+}
+
+static void add(replay_log * log, const replay_ev * ev)
+{
+	/* put ev at the end of the log, which doubles when full
+	 * if there's no memory the log is cut short and failed */
+	replay_ev * evs;
+	long cap;
+	
+	if (log->failed)
+		return;
+	
+	if (log->nevs == log->cap)
+	{
+		cap = (log->cap > 0) ? log->cap * 2 : 256;
+		if ((evs = realloc(log->evs, cap * sizeof(*evs))) == NULL)
+		{
+			log->failed = true;
+			return;
+		}
+		
+		log->evs = evs;
+		log->cap = cap;
+	}
+	
+	log->evs[log->nevs++] = *ev;
+	return;
+}
@@ -0,0 +1,73 @@
+/* replay.h -- records and plays back the input of a core public interface */
+/* ver. 1.0 */
+#ifndef REPLAY_H
+#define REPLAY_H
+
+#include <stdio.h>
+#include <stdint.h>
+#include "jcpu.h"
+
+#define REPLAY_MAGIC	"JCPREPLY"	// the first 8 bytes of a recording
+#define REPLAY_VER		1			// the recording layout version
+
+enum {REPLAY_IN, REPLAY_OUT, REPLAY_WAIT};
+/* what an event is; an IN DATA and the byte it read, an OUT DATA which had
+ * to wait, or an IN/OUT DATA which waited until an interrupt came */
+
+// a call to the device; fixed size fields and no padding
+typedef struct replay_ev_ {
+	uint64_t icount;		// the instructions before it
+	uint32_t waits;			// how many times it had to wait first
+	byte kind;				// REPLAY_IN, REPLAY_OUT, or REPLAY_WAIT
+	byte port;				// the device
+	byte val;				// what IN DATA read
+	byte pad;				// to 8 bytes
+} replay_ev;
+
+// the input of one core
+typedef struct replay_log_ {
+	replay_ev * evs;		// the events in order
+	long nevs;				// how many
+	long cap;				// how many fit
+	uint64_t end;			// the icount the core ended up with; up to the caller
+	int state;				// how the core ended up; up to the caller
+	bool failed;			// out of memory, or the core went another way
+	/* the rest is used only while recording or playing */
+	const jcpu * cpu;		// the core
+	jcpu_dev dev;			// the device being recorded
+	replay_ev pend;			// the waits of the last call, not logged yet
+	long next;				// the event to play next
+	uint32_t waited;		// times it has waited on it
+} replay_log;
+
+void replay_record(replay_log * log, jcpu * cpu);
+/* returns: Nothing.
+ *
+ * description: Puts log between cpu and its device. Every byte the device
+ * gives to IN DATA is logged with the icount it was read at, and so is every
+ * wait, since the timer counts those. log must be zeroed first. */
+
+void replay_play(replay_log * log, jcpu * cpu);
+/* returns: Nothing.
+ *
+ * description: Puts log in place of the device of cpu. IN DATA reads the bytes
+ * of log and waits as many times as it did when recorded; OUT DATA goes
+ * nowhere. If cpu makes a call which isn't the next one in log, log->failed
+ * is set and the call waits forever. A call at log->end after the last
+ * event waits too, without failing, as the core was left waiting there. */
+
+int replay_write(FILE * fp, const replay_log * logs, int nlogs);
+/* returns: 0 on success, -1 if fp can't be written.
+ *
+ * description: Writes nlogs logs to fp in the byte order of the host. */
+
+replay_log * replay_read(FILE * fp, int * nlogs);
+/* returns: The logs in fp, NULL if fp isn't a recording or there's no memory.
+ *
+ * description: Reads all logs in fp and puts their number in nlogs. */
+
+void replay_free(replay_log * logs, int nlogs);
+/* returns: Nothing.
+ *
+ * description: Frees logs and their events. */
+#endif
@@ -0,0 +1,604 @@
+/* serve.c -- runs programs for the clients of a Unix domain socket */
+/* ver. 1.0 */
+
+/* Every connection has a thread which reads its requests and one which
+ * writes its answers. The reader puts the runs on a pipe shared by all
+ * connections, which the workers take them from; a pipe write of a pointer
+ * is atomic, so a pipe is a queue which blocks the workers while it's empty
+ * and the readers while it's full. A worker puts the answer on the pipe of
+ * the connection, where the writer picks it up. Every answer costs the reader
+ * a byte of a third pipe, which the writer gives back once the answer is
+ * out, so a client which doesn't read can't hold up the workers. Each worker
+ * keeps its machine loaded, so a run of the same code as the last one only
+ * takes a jcpu_reset(). */
+
+/* Author: Vladimir Dinev */
+#include "os_def.h"
+#include <stdio.h>
+#include <stdlib.h>
+#include <string.h>
+#ifndef WINDOWS
+#include <errno.h>
+#include <signal.h>
+#include <time.h>
+#include <unistd.h>
+#include <pthread.h>
+#include <sys/socket.h>
+#include <sys/stat.h>
+#include <sys/un.h>
+#endif
+#include "serve.h"
+
+#ifndef WINDOWS
+#define add(p,v)	__atomic_add_fetch((p), (v), __ATOMIC_RELAXED)
+#define sub(p,v)	__atomic_sub_fetch((p), (v), __ATOMIC_RELAXED)
+#define ld_rlx(p)	__atomic_load_n((p), __ATOMIC_RELAXED)
+
+// the server
+typedef struct server_ {
+	int queue[2];					// the pipe of the runs
+	int nthreads;					// how many workers
+	unsigned long max_steps;		// the most instructions a run gets
+	uint64_t queued, running;		// runs waiting and being run
+	uint64_t done, icount;			// runs finished and their instructions
+	uint64_t conns;					// connections open
+	double start;					// when it started
+} server;
+
+// a connection
+typedef struct conn_ {
+	server * sv;
+	int fd;							// the socket
+	int answers[2];					// the pipe of the answers
+	int credits[2];					// a byte for every answer the reader may ask for
+	unsigned long asked;			// answers the reader asked for
+} conn;
+
+// a run on its way
+typedef struct job_ {
+	conn * cn;						// whom it's for
+	serve_req req;
+	byte code[RAM_S];
+	serve_poke pokes[SERVE_MAX_POKES];
+} job;
+
+// an answer on its way; the body follows the head in one piece
+typedef struct answer_ {
+	serve_ans head;
+	union {
+		serve_state st;
+		serve_stats stats;
+	} body;
+} answer;
+
+// a worker and its machine
+typedef struct worker_ {
+	server * sv;
+	jcpu cpu;
+	byte ram[RAM_S];
+	byte code[RAM_S];				// what the machine has loaded
+	int csize;						// its size; 0 when nothing is
+} worker;
+
+// the answer there was no memory for
+static answer lost;
+
+static void * work(void * arg);
+static void run_job(worker * wk, const job * jb, answer * an);
+static void * conn_read(void * arg);
+static void * conn_write(void * arg);
+static bool read_req(int fd, job * jb);
+static void put_answer(conn * cn, answer * an);
+static answer * new_answer(const serve_req * req, int status, unsigned int size);
+static void get_stats(server * sv, serve_stats * st);
+static int read_all(int fd, void * buff, size_t size);
+static int write_all(int fd, const void * buff, size_t size);
+static bool start_thread(void * (*fn)(void *), void * arg);
+static double now(void);
+#endif
+
+/* -------------------- PUBLIC INTERFACE START -------------------- */
+#ifdef WINDOWS
+int serve_run(const char * path, int nthreads, unsigned long max_steps)
+{
+	/* no Unix domain sockets here */
+	fprintf(stderr, "Err: the server needs Unix domain sockets\n");
+	return -1;
+}
+
+int serve_connect(const char * path)
+{
+	/* no Unix domain sockets here */
+	fprintf(stderr, "Err: the server needs Unix domain sockets\n");
+	return -1;
+}
+
+int serve_query(int fd, serve_stats * st)
+{
+	/* no Unix domain sockets here */
+	return -1;
+}
+#else
+int serve_run(const char * path, int nthreads, unsigned long max_steps)
+{
+	/* make the socket, unless another server has it already
+	 * start the workers
+	 * start a reader and a writer for every connection */
+	static server sv;
+	static const char credits[SERVE_IN_FLIGHT];
+	struct sockaddr_un addr;
+	worker * wks;
+	conn * cn;
+	answer * an;
+	struct stat st;
+	int lfd, fd, i;
+	
+	if (strlen(path) >= sizeof(addr.sun_path))
+	{
+		fprintf(stderr, "Err: the socket path \"%s\" is too long\n", path);
+		return -1;
+	}
+	
+	if ((fd = serve_connect(path)) >= 0)
+	{
+		close(fd);
+		fprintf(stderr, "Err: a server is already on \"%s\"\n", path);
+		return -1;
+	}
+	
+	memset(&addr, 0, sizeof(addr));
+	addr.sun_family = AF_UNIX;
+	strcpy(addr.sun_path, path);
+	
+	// only a socket left by a server gone away is removed
+	if (lstat(path, &st) == 0)
+	{
+		if (!S_ISSOCK(st.st_mode))
+		{
+			fprintf(stderr, "Err: \"%s\" is not a socket\n", path);
+			return -1;
+		}
+		unlink(path);
+	}
+	
+	if ((lfd = socket(AF_UNIX, SOCK_STREAM, 0)) < 0 ||
+		bind(lfd, (struct sockaddr *)&addr, sizeof(addr)) != 0 || listen(lfd, SOMAXCONN) != 0)
+	{
+		fprintf(stderr, "Err: could not listen on \"%s\"\n", path);
+		return -1;
+	}
+	
+	// a client gone away is an error to write(), not a signal
+	signal(SIGPIPE, SIG_IGN);
+	
+	if (nthreads < 1)
+		nthreads = 1;
+	if (nthreads > SERVE_MAX_THRDS)
+		nthreads = SERVE_MAX_THRDS;
+	
+	sv.nthreads = nthreads;
+	sv.max_steps = max_steps;
+	sv.start = now();
+	if (pipe(sv.queue) != 0 || (wks = calloc(nthreads, sizeof(*wks))) == NULL)
+	{
+		fprintf(stderr, "Err: could not start the workers\n");
+		return -1;
+	}
+	
+	for (i = 0; i < nthreads; ++i)
+	{
+		wks[i].sv = &sv;
+		jcpu_init(&wks[i].cpu, wks[i].ram, 0);
+		if (!start_thread(work, &wks[i]))
+		{
+			fprintf(stderr, "Err: could not start the workers\n");
+			return -1;
+		}
+	}
+	
+	while (true)
+	{
+		if ((fd = accept(lfd, NULL, NULL)) < 0)
+		{
+			if (EINTR == errno || ECONNABORTED == errno)
+				continue;
+			fprintf(stderr, "Err: could not accept on \"%s\"\n", path);
+			return -1;
+		}
+		
+		if ((cn = calloc(1, sizeof(*cn))) == NULL)
+		{
+			close(fd);
+			continue;
+		}
+		
+		cn->sv = &sv;
+		cn->fd = fd;
+		cn->credits[0] = cn->credits[1] = -1;
+		if (pipe(cn->answers) != 0)
+		{
+			close(fd);
+			free(cn);
+			continue;
+		}
+		
+		// the pipe holds a lot more than SERVE_IN_FLIGHT bytes
+		if (pipe(cn->credits) != 0 || write_all(cn->credits[1], credits, sizeof(credits)) != 0 ||
+			!start_thread(conn_write, cn))
+		{
+			close(cn->answers[0]);
+			close(cn->answers[1]);
+			close(cn->credits[0]);
+			close(cn->credits[1]);
+			close(fd);
+			free(cn);
+			continue;
+		}
+		
+		add(&sv.conns, 1);
+		if (!start_thread(conn_read, cn))
+		{
+			// the writer sees no answers are coming and cleans up
+			an = NULL;
+			write_all(cn->answers[1], &an, sizeof(an));
+		}
+	}
+	
+	return 0;
+}
+
+int serve_connect(const char * path)
+{
+	/* connect to the socket at path */
+	struct sockaddr_un addr;
+	int fd;
+	
+	if (strlen(path) >= sizeof(addr.sun_path) || (fd = socket(AF_UNIX, SOCK_STREAM, 0)) < 0)
+		return -1;
+	
+	memset(&addr, 0, sizeof(addr));
+	addr.sun_family = AF_UNIX;
+	strcpy(addr.sun_path, path);
+	if (connect(fd, (struct sockaddr *)&addr, sizeof(addr)) != 0)
+	{
+		close(fd);
+		return -1;
+	}
+	
+	return fd;
+}
+
+int serve_query(int fd, serve_stats * st)
+{
+	/* ask for the stats and read the answer */
+	serve_req req;
+	serve_ans ans;
+	
+	memset(&req, 0, sizeof(req));
+	req.magic = SERVE_MAGIC;
+	req.version = SERVE_VER;
+	req.kind = SERVE_STATS;
+	if (write_all(fd, &req, sizeof(req)) != 0 || read_all(fd, &ans, sizeof(ans)) != 0 ||
+		ans.magic != SERVE_MAGIC || ans.status != SERVE_OK || ans.size != sizeof(*st) ||
+		read_all(fd, st, sizeof(*st)) != 0)
+		return -1;
+	
+	return 0;
+}
+#endif
+/* -------------------- PUBLIC INTERFACE END -------------------- */
+
+#ifndef WINDOWS
+static void * work(void * arg)
+{
+	/* take a run off the queue, run it, and
+	 * put the answer on the pipe of its connection */
+	worker * wk = arg;
+	server * sv = wk->sv;
+	answer * an;
+	job * jb;
+	
+	while (read_all(sv->queue[0], &jb, sizeof(jb)) == 0)
+	{
+		sub(&sv->queued, 1);
+		add(&sv->running, 1);
+		
+		if ((an = new_answer(&jb->req, SERVE_OK, sizeof(an->body.st))) != NULL)
+		{
+			run_job(wk, jb, an);
+			add(&sv->icount, an->body.st.icount);
+		}
+		
+		sub(&sv->running, 1);
+		add(&sv->done, 1);
+		put_answer(jb->cn, an);
+		free(jb);
+	}
+	
+	return NULL;
+}
+
+static void run_job(worker * wk, const job * jb, answer * an)
+{
+	/* load the code, unless it's what's loaded already, and put
+	 * the core back to power on; jcpu_load() alone would keep
+	 * the registers of the last job
+	 * poke the inputs and run */
+	jcpu * cpu = &wk->cpu;
+	serve_state * st = &an->body.st;
+	const serve_poke * pk, * end = jb->pokes + jb->req.npokes;
+	unsigned long n;
+	
+	if (wk->csize != (int)jb->req.csize || memcmp(wk->code, jb->code, wk->csize) != 0)
+	{
+		jcpu_load(cpu, jb->code, jb->req.csize);
+		memcpy(wk->code, jb->code, jb->req.csize);
+		wk->csize = jb->req.csize;
+	}
+	
+	jcpu_reset(cpu);
+	
+	for (pk = jb->pokes; pk < end; ++pk)
+	{
+		if (pk->where < RAM_S)
+			jcpu_poke(cpu, pk->where, pk->val);
+		else
+			cpu->regs[pk->where - RAM_S] = pk->val;
+	}
+	
+	n = (jb->req.steps < wk->sv->max_steps) ? jb->req.steps : wk->sv->max_steps;
+	for ( ; n > 0 && !jcpu_halted(cpu); --n)
+		jcpu_step(cpu);
+	
+	st->icount = cpu->icount;
+	st->digest = cpu->digest;
+	memcpy(st->regs, cpu->regs, NUM_REGS);
+	st->halted = jcpu_halted(cpu);
+	memcpy(st->ram, cpu->ram, RAM_S);
+	return;
+}
+
+static void * conn_read(void * arg)
+{
+	/* read requests until the client is done or sends a bad one
+	 * every answer takes a credit first
+	 * then tell the writer no more are coming */
+	conn * cn = arg;
+	server * sv = cn->sv;
+	serve_stats st;
+	answer * an;
+	job * jb;
+	char credit;
+	
+	while (read_all(cn->credits[0], &credit, 1) == 0)
+	{
+		if ((jb = malloc(sizeof(*jb))) == NULL)
+			break;
+		
+		jb->cn = cn;
+		if (read_all(cn->fd, &jb->req, sizeof(jb->req)) != 0)
+		{
+			free(jb);
+			break;
+		}
+		
+		if (!read_req(cn->fd, jb))
+		{
+			++cn->asked;
+			put_answer(cn, new_answer(&jb->req, SERVE_BAD, 0));
+			free(jb);
+			break;
+		}
+		
+		++cn->asked;
+		if (SERVE_STATS == jb->req.kind)
+		{
+			get_stats(sv, &st);
+			if ((an = new_answer(&jb->req, SERVE_OK, sizeof(st))) != NULL)
+				an->body.stats = st;
+			put_answer(cn, an);
+			free(jb);
+			continue;
+		}
+		
+		add(&sv->queued, 1);
+		if (write_all(sv->queue[1], &jb, sizeof(jb)) != 0)
+		{
+			sub(&sv->queued, 1);
+			put_answer(cn, new_answer(&jb->req, SERVE_BAD, 0));
+			free(jb);
+			break;
+		}
+	}
+	
+	// nothing is read after this; what was asked is final
+	jb = NULL;
+	write_all(cn->answers[1], &jb, sizeof(jb));
+	return NULL;
+}
+
+static void * conn_write(void * arg)
+{
+	/* write the answers as they come, and give their credits back
+	 * once the reader is done and all it asked for is out,
+	 * close the connection
+	 * if the client is gone, the answers are dropped */
+	conn * cn = arg;
+	answer * an;
+	unsigned long written = 0;
+	bool ok = true, last = false;
+	
+	while (!last || written != cn->asked)
+	{
+		if (read_all(cn->answers[0], &an, sizeof(an)) != 0)
+			break;
+		
+		if (NULL == an)
+		{
+			last = true;
+			continue;
+		}
+		
+		if (&lost == an)
+		{
+			// the client would wait for it forever; let it know
+			ok = false;
+			shutdown(cn->fd, SHUT_RDWR);
+		}
+		else
+		{
+			if (ok && write_all(cn->fd, an, sizeof(an->head) + an->head.size) != 0)
+				ok = false;
+			free(an);
+		}
+		
+		++written;
+		write_all(cn->credits[1], "", 1);
+	}
+	
+	close(cn->fd);
+	close(cn->answers[0]);
+	close(cn->answers[1]);
+	close(cn->credits[0]);
+	close(cn->credits[1]);
+	sub(&cn->sv->conns, 1);
+	free(cn);
+	return NULL;
+}
+
+static bool read_req(int fd, job * jb)
+{
+	/* check the head of the request, then read the rest of it
+	 * return false if it's bad */
+	serve_req * req = &jb->req;
+	uint32_t i;
+	
+	if (req->magic != SERVE_MAGIC || req->version != SERVE_VER)
+		return false;
+	
+	if (SERVE_STATS == req->kind)
+		return true;
+	
+	if (req->kind != SERVE_RUN || req->csize < 1 || req->csize > RAM_S ||
+		req->npokes > SERVE_MAX_POKES ||
+		read_all(fd, jb->code, req->csize) != 0 ||
+		read_all(fd, jb->pokes, req->npokes * sizeof(serve_poke)) != 0)
+		return false;
+	
+	for (i = 0; i < req->npokes; ++i)
+	{
+		if (jb->pokes[i].where >= RAM_S + NUM_REGS)
+			return false;
+	}
+	
+	return true;
+}
+
+static void put_answer(conn * cn, answer * an)
+{
+	/* pass an on to the writer; NULL is
+	 * one there was no memory for */
+	if (NULL == an)
+		an = &lost;
+	
+	write_all(cn->answers[1], &an, sizeof(an));
+	return;
+}
+
+static answer * new_answer(const serve_req * req, int status, unsigned int size)
+{
+	/* an answer to req with size bytes of body */
+	answer * an;
+	
+	if ((an = malloc(sizeof(*an))) == NULL)
+		return NULL;
+	
+	memset(&an->head, 0, sizeof(an->head));
+	an->head.magic = SERVE_MAGIC;
+	an->head.id = req->id;
+	an->head.kind = req->kind;
+	an->head.status = status;
+	an->head.size = size;
+	return an;
+}
+
+static void get_stats(server * sv, serve_stats * st)
+{
+	/* read the counters; each one is right, if not all at the same time */
+	st->queued = ld_rlx(&sv->queued);
+	st->running = ld_rlx(&sv->running);
+	st->done = ld_rlx(&sv->done);
+	st->icount = ld_rlx(&sv->icount);
+	st->conns = ld_rlx(&sv->conns);
+	st->workers = sv->nthreads;
+	st->usecs = (now() - sv->start) * 1e6;
+	return;
+}
+
+static int read_all(int fd, void * buff, size_t size)
+{
+	/* read size bytes, however many reads it takes
+	 * return 0, or -1 on an error or the end of input */
+	char * p = buff;
+	ssize_t n;
+	
+	while (size > 0)
+	{
+		if ((n = read(fd, p, size)) <= 0)
+		{
+			if (n < 0 && EINTR == errno)
+				continue;
+			return -1;
+		}
+		
+		p += n;
+		size -= n;
+	}
+	
+	return 0;
+}
+
+static int write_all(int fd, const void * buff, size_t size)
+{
+	/* write size bytes, however many writes it takes
+	 * return 0, or -1 on an error */
+	const char * p = buff;
+	ssize_t n;
+	
+	while (size > 0)
+	{
+		if ((n = write(fd, p, size)) < 0)
+		{
+			if (EINTR == errno)
+				continue;
+			return -1;
+		}
+		
+		p += n;
+		size -= n;
+	}
+	
+	return 0;
+}
+
+static bool start_thread(void * (*fn)(void *), void * arg)
+{
+	/* start a thread nobody waits for */
+	pthread_t thrd;
+	
+	if (pthread_create(&thrd, NULL, fn, arg) != 0)
+		return false;
+	
+	pthread_detach(thrd);
+	return true;
+}
+
+static double now(void)
+{
+	/* wall clock seconds for the stats */
+	struct timespec ts;
+	
+	clock_gettime(CLOCK_MONOTONIC, &ts);
+	return ts.tv_sec + ts.tv_nsec / 1e9;
+}
+#endif
@@ -0,0 +1,103 @@
+/* serve.h -- the execution server public interface */
+/* ver. 1.0 */
+#ifndef SERVE_H
+#define SERVE_H
+
+#include <stdint.h>
+#include "jcpu.h"
+
+#define SERVE_MAGIC		0x4A435044U	// "JCPD"
+#define SERVE_VER		1			// the protocol version
+#define SERVE_MAX_POKES	(RAM_S + NUM_REGS)	// the most pokes in a request
+#define SERVE_MAX_THRDS	64			// the most workers
+#define SERVE_IN_FLIGHT	1024		// the most requests of a connection not answered yet
+
+/* The protocol
+ * A client connects to the socket and sends requests, one after the
+ * other, without waiting for the answers. Every request is a serve_req,
+ * followed for SERVE_RUN by csize bytes of code and npokes serve_poke.
+ * Every answer is a serve_ans, followed by size bytes; a serve_state for a
+ * SERVE_RUN which went well, a serve_stats for SERVE_STATS, nothing
+ * otherwise. The answers come as the runs finish, so not necessarily in the
+ * order of the requests; id tells them apart. A bad request gets a
+ * SERVE_BAD answer and the connection is closed after it. Once
+ * SERVE_IN_FLIGHT requests of a connection wait for their answers, the server
+ * reads no more of them until the client reads some answers. All fields are
+ * in the byte order of the host, which is the only one the socket reaches. */
+
+enum {SERVE_RUN, SERVE_STATS};
+/* what a request asks for; run a program, or how the server is doing */
+
+enum {SERVE_OK, SERVE_BAD};
+/* how a request went */
+
+// the start of a request; fixed size fields and no padding
+typedef struct serve_req_ {
+	uint32_t magic;			// SERVE_MAGIC
+	uint32_t version;		// SERVE_VER
+	uint32_t id;			// anything; comes back in the answer
+	uint32_t kind;			// SERVE_RUN or SERVE_STATS
+	uint32_t csize;			// bytes of code which follow, 1 to RAM_S
+	uint32_t npokes;		// pokes after the code, up to SERVE_MAX_POKES
+	uint64_t steps;			// the most instructions to run
+} serve_req;
+
+// an input byte put in the machine before the run
+typedef struct serve_poke_ {
+	uint16_t where;			// a ram address, or RAM_S + a register
+	byte val;				// what goes there
+	byte pad;				// to 4 bytes
+} serve_poke;
+
+// the start of an answer
+typedef struct serve_ans_ {
+	uint32_t magic;			// SERVE_MAGIC
+	uint32_t id;			// of the request
+	uint32_t kind;			// of the request
+	uint32_t status;		// SERVE_OK or SERVE_BAD
+	uint32_t size;			// bytes which follow
+	uint32_t pad;			// to 8 bytes
+} serve_ans;
+
+// how a run ended up
+typedef struct serve_state_ {
+	uint64_t icount;		// instructions executed
+	uint64_t digest;		// jcpu_digest() of the ram
+	byte regs[NUM_REGS];
+	byte halted;			// 1 if it halted, 0 if it ran out of steps
+	byte pad[4];			// to 8 bytes
+	byte ram[RAM_S];
+} serve_state;
+
+// how the server is doing
+typedef struct serve_stats_ {
+	uint64_t queued;		// runs waiting for a worker
+	uint64_t running;		// runs the workers are on
+	uint64_t done;			// runs finished since the start
+	uint64_t icount;		// instructions they executed
+	uint64_t conns;			// connections open
+	uint64_t workers;		// how many workers there are
+	uint64_t usecs;			// microseconds since the start
+} serve_stats;
+
+int serve_run(const char * path, int nthreads, unsigned long max_steps);
+/* returns: -1 if the socket can't be made, otherwise it doesn't return.
+ *
+ * description: Listens on the Unix domain socket path and serves every
+ * connection on a thread of its own, with nthreads workers shared by all.
+ * A worker keeps its machine loaded between runs and, when the next run has
+ * the same code, only puts it back with jcpu_reset(). Every run starts from
+ * a powered on core, whatever ran before it. No run gets more than
+ * max_steps instructions, whatever it asks for. */
+
+int serve_connect(const char * path);
+/* returns: The connected socket, -1 if there is none at path.
+ *
+ * description: Connects to the server at path, for a client. */
+
+int serve_query(int fd, serve_stats * st);
+/* returns: 0 on success, -1 if the server didn't answer.
+ *
+ * description: Asks the server on fd how it's doing and puts it in st.
+ * No other request should be waiting on fd. */
+#endif
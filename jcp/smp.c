@@ -0,0 +1,148 @@
+/* smp.c -- runs several jcpu cores on one shared ram */
+/* ver. 1.01 */
+
+/* Every core either gets a host thread, or all of them take turns
+ * on a single thread in a fixed order. The ram is shared through the
+ * cores' ram pointers; jcpu.c does the atomic accesses. */
+
+/* Author: Vladimir Dinev */
+#include "os_def.h"
+#include <stdbool.h>
+#ifndef WINDOWS
+#include <pthread.h>
+#endif
+#include "smp.h"
+
+typedef struct core_run_ {
+	jcpu * cpu;				// the core to run
+	unsigned long steps;	// how many instructions it may execute
+	bool halted;			// the core halted before running out of steps
+} core_run;
+
+static bool run_core(jcpu * cpu, unsigned long steps);
+static int run_rrobin(jcpu * cores, int ncores, unsigned long steps, unsigned long quantum);
+static int run_threads(jcpu * cores, int ncores, unsigned long steps);
+
+int smp_run(jcpu * cores, int ncores, unsigned long steps, int mode, unsigned long quantum)
+{
+	/* run the cores the requested way */
+	if (ncores < 1 || ncores > SMP_MAX_CORES)
+		return -1;
+	
+	if (SMP_RROBIN == mode)
+		return run_rrobin(cores, ncores, steps, (quantum > 0) ? quantum : 1);
+	
+	return run_threads(cores, ncores, steps);
+}
+
+static bool run_core(jcpu * cpu, unsigned long steps)
+{
+	/* step cpu until it halts or runs out of steps
+	 * through the stepper if the core is set to use it
+	 * return true if it halted */
+	fpcv_t step = (cpu->stepper) ? jcpu_step_ticks : jcpu_step;
+	
+	while (steps-- > 0)
+	{
+		if (jcpu_halted(cpu))
+			return true;
+		
+		step(cpu);
+	}
+	
+	return jcpu_halted(cpu);
+}
+
+static int run_rrobin(jcpu * cores, int ncores, unsigned long steps, unsigned long quantum)
+{
+	/* give every core quantum instructions in turn
+	 * until all are done */
+	unsigned long left[SMP_MAX_CORES];
+	bool done[SMP_MAX_CORES];
+	int i, running, halted;
+	unsigned long q;
+	
+	for (i = 0; i < ncores; ++i)
+	{
+		left[i] = steps;
+		done[i] = false;
+	}
+	
+	halted = 0;
+	do
+	{
+		running = 0;
+		for (i = 0; i < ncores; ++i)
+		{
+			if (done[i])
+				continue;
+			
+			q = (left[i] < quantum) ? left[i] : quantum;
+			left[i] -= q;
+			
+			if (run_core(&cores[i], q))
+			{
+				done[i] = true;
+				++halted;
+			}
+			else if (0 == left[i])
+				done[i] = true;
+			else
+				++running;
+		}
+	} while (running > 0);
+	
+	return halted;
+}
+
+#ifdef WINDOWS
+static DWORD WINAPI core_thread(LPVOID arg)
+#else
+static void * core_thread(void * arg)
+#endif
+{
+	/* the body of a core's host thread */
+	core_run * cr = arg;
+	
+	cr->halted = run_core(cr->cpu, cr->steps);
+	return 0;
+}
+
+static int run_threads(jcpu * cores, int ncores, unsigned long steps)
+{
+	/* start a thread per core
+	 * wait for all of them */
+	core_run runs[SMP_MAX_CORES];
+	int i, started, halted;
+#ifdef WINDOWS
+	HANDLE thrd[SMP_MAX_CORES];
+#else
+	pthread_t thrd[SMP_MAX_CORES];
+#endif
+
+	for (started = 0; started < ncores; ++started)
+	{
+		runs[started].cpu = &cores[started];
+		runs[started].steps = steps;
+#ifdef WINDOWS
+		if ((thrd[started] = CreateThread(NULL, 0, core_thread, &runs[started], 0, NULL)) == NULL)
+			break;
+#else
+		if (pthread_create(&thrd[started], NULL, core_thread, &runs[started]) != 0)
+			break;
+#endif
+	}
+	
+	for (i = halted = 0; i < started; ++i)
+	{
+#ifdef WINDOWS
+		WaitForSingleObject(thrd[i], INFINITE);
+		CloseHandle(thrd[i]);
+#else
+		pthread_join(thrd[i], NULL);
+#endif
+		halted += runs[i].halted;
+	}
+	
+	return (started < ncores) ? -1 : halted;
+}
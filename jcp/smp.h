@@ -0,0 +1,22 @@
+/* smp.h -- the smp module public interface */
+/* ver. 1.01 */
+#ifndef SMP_H
+#define SMP_H
+
+#include "jcpu.h"
+
+#define SMP_MAX_CORES	16		// the most cores smp_run() takes
+
+enum {SMP_THREADS, SMP_RROBIN};
+/* enum constants for the run mode */
+
+int smp_run(jcpu * cores, int ncores, unsigned long steps, int mode, unsigned long quantum);
+/* returns: The number of cores which halted, -1 if a thread could not be started.
+ * 
+ * description: Runs ncores cores until each one halts or executes steps
+ * instructions. The cores should be initialized with the same ram.
+ * With SMP_THREADS every core gets a host thread of its own. With SMP_RROBIN
+ * the cores take turns on the calling thread, quantum instructions at a time,
+ * so a program always gives the same result. Cores with cpu->stepper set
+ * run with jcpu_step_ticks(). */
+#endif
@@ -0,0 +1,101 @@
+/* lib_check.c -- checks that a libjcpu machine can run one program after another */
+/* ver. 1.0 */
+
+/* Loads two programs in turn on the same machine and compares every run
+ * with one of the same program on a new machine. Only the interface of
+ * libjcpu.h is used, the way a program linked with the library would.
+ * Exits with 1 when a run differs. */
+
+/* Author: Vladimir Dinev */
+#include <stdio.h>
+#include "../libjcpu.h"
+
+#define CHK_STEPS	100000		// the most instructions of a run
+#define CHK_RUNS	4			// runs on the same machine, the two programs in turn
+
+// bin/example_code/asm/fibonacci_asm.txt, assembled
+static const unsigned char fib[] = {
+	0x20, 0x40, 0x21, 0x01, 0x89, 0x11, 0x23, 0x01, 0x8C, 0x86, 0x12, 0x8C,
+	0x23, 0xA4, 0xF3, 0x52, 0x13, 0x40, 0x04, 0x40, 0x13
+};
+
+// bin/example_code/asm/fizzbuzz_asm.txt, assembled
+static const unsigned char fizz[] = {
+	0x20, 0x40, 0x23, 0x03, 0xF7, 0x52, 0x09, 0x40, 0x19, 0x23, 0x05, 0xE5,
+	0xFB, 0x52, 0x11, 0x40, 0x16, 0xEA, 0x23, 0x03, 0x40, 0x18, 0x23, 0x01,
+	0x13, 0x23, 0x05, 0xFB, 0x52, 0x20, 0x40, 0x24, 0x23, 0x02, 0x13, 0xEA,
+	0x23, 0x01, 0x60, 0x8C, 0x8D, 0x8E, 0x23, 0xA4, 0xF3, 0x52, 0x31, 0x40,
+	0x02, 0x40, 0x31
+};
+
+typedef struct prog_ {
+	const char * name;
+	const unsigned char * code;
+	int csize;
+} prog;
+
+static const prog progs[] = {
+	{"fibonacci", fib, sizeof(fib)},
+	{"fizzbuzz", fizz, sizeof(fizz)}
+};
+
+static int same(const jcp_machine * a, const jcp_machine * b);
+
+int main(void)
+{
+	/* run the programs in turn on m, each also on a new machine */
+	jcp_machine * m, * fresh;
+	const prog * pg;
+	int i, bad = 0;
+	
+	if ((m = jcp_new()) == NULL)
+	{
+		fprintf(stderr, "Err: no memory for a machine\n");
+		return 1;
+	}
+	
+	for (i = 0; i < CHK_RUNS; ++i)
+	{
+		pg = &progs[i % 2];
+		if ((fresh = jcp_new()) == NULL)
+		{
+			fprintf(stderr, "Err: no memory for a machine\n");
+			return 1;
+		}
+		
+		jcp_load(m, pg->code, pg->csize);
+		jcp_run(m, CHK_STEPS);
+		jcp_load(fresh, pg->code, pg->csize);
+		jcp_run(fresh, CHK_STEPS);
+		
+		if (!same(m, fresh))
+		{
+			fprintf(stderr, "Err: run %d of %s differs from a new machine\n", i, pg->name);
+			bad = 1;
+		}
+		
+		jcp_free(fresh);
+	}
+	
+	jcp_free(m);
+	printf("lib_check: %d runs, %s\n", CHK_RUNS, (bad) ? "failed" : "ok");
+	return bad;
+}
+
+static int same(const jcp_machine * a, const jcp_machine * b)
+{
+	/* the same registers, ram, and counts */
+	int reg;
+	
+	if (jcp_icount(a) != jcp_icount(b) || jcp_halted(a) != jcp_halted(b) ||
+		jcp_digest(a) != jcp_digest(b))
+		return 0;
+	
+	for (reg = 0; reg < JCP_NUM_REGS; ++reg)
+	{
+		if (jcp_get_reg(a, reg) != jcp_get_reg(b, reg))
+			return 0;
+	}
+	
+	return 1;
+}
@@ -0,0 +1,197 @@
+/* serve_check.c -- checks that jcpd runs every program from power on */
+/* ver. 1.0 */
+
+/* Starts a server with a single worker, sends it two programs in turn on
+ * one connection, and compares every answer with a run of the same program
+ * on a new jcpu. The worker has to load a program other than the last one
+ * every time, so one which kept the registers of the last run would start
+ * where it stopped. Exits with 1 when an answer differs. */
+
+/* Author: Vladimir Dinev */
+#include "../os_def.h"
+#include <stdio.h>
+#include <stdlib.h>
+#include <string.h>
+#ifndef WINDOWS
+#include <unistd.h>
+#include <pthread.h>
+#endif
+#include "../serve.h"
+#include "../jcpu.h"
+
+#define CHK_SOCK	"serve_check.sock"	// where the server listens
+#define CHK_STEPS	100000				// the most instructions of a run
+#define CHK_RUNS	4					// runs sent, the two programs in turn
+#define CHK_TRIES	100					// connects tried while the server starts
+
+// bin/example_code/asm/fibonacci_asm.txt, assembled
+static const byte fib[] = {
+	0x20, 0x40, 0x21, 0x01, 0x89, 0x11, 0x23, 0x01, 0x8C, 0x86, 0x12, 0x8C,
+	0x23, 0xA4, 0xF3, 0x52, 0x13, 0x40, 0x04, 0x40, 0x13
+};
+
+// bin/example_code/asm/fizzbuzz_asm.txt, assembled
+static const byte fizz[] = {
+	0x20, 0x40, 0x23, 0x03, 0xF7, 0x52, 0x09, 0x40, 0x19, 0x23, 0x05, 0xE5,
+	0xFB, 0x52, 0x11, 0x40, 0x16, 0xEA, 0x23, 0x03, 0x40, 0x18, 0x23, 0x01,
+	0x13, 0x23, 0x05, 0xFB, 0x52, 0x20, 0x40, 0x24, 0x23, 0x02, 0x13, 0xEA,
+	0x23, 0x01, 0x60, 0x8C, 0x8D, 0x8E, 0x23, 0xA4, 0xF3, 0x52, 0x31, 0x40,
+	0x02, 0x40, 0x31
+};
+
+typedef struct prog_ {
+	const char * name;
+	const byte * code;
+	int csize;
+} prog;
+
+static const prog progs[] = {
+	{"fibonacci", fib, sizeof(fib)},
+	{"fizzbuzz", fizz, sizeof(fizz)}
+};
+
+#ifdef WINDOWS
+int main(void)
+{
+	/* no Unix domain sockets here */
+	printf("serve_check: the server needs Unix domain sockets; skipped\n");
+	return 0;
+}
+#else
+static void * serve(void * arg);
+static int send_run(int fd, int id, const prog * pg);
+static int read_state(int fd, serve_state states[CHK_RUNS]);
+static int check(const prog * pg, const serve_state * st);
+static int io_all(int fd, void * buff, size_t len, bool wr);
+
+int main(void)
+{
+	/* start the server, send the runs, then read and check the answers */
+	static serve_state states[CHK_RUNS];
+	pthread_t thrd;
+	int i, fd = -1, bad = 0;
+	
+	if (pthread_create(&thrd, NULL, serve, NULL) != 0)
+	{
+		fprintf(stderr, "Err: could not start the server\n");
+		return 1;
+	}
+	
+	for (i = 0; i < CHK_TRIES && (fd = serve_connect(CHK_SOCK)) < 0; ++i)
+		usleep(10000);
+	
+	if (fd < 0)
+	{
+		fprintf(stderr, "Err: there is no server on \"%s\"\n", CHK_SOCK);
+		return 1;
+	}
+	
+	for (i = 0; i < CHK_RUNS; ++i)
+	{
+		if (send_run(fd, i, &progs[i % 2]) != 0)
+		{
+			fprintf(stderr, "Err: could not send run %d\n", i);
+			return 1;
+		}
+	}
+	
+	for (i = 0; i < CHK_RUNS; ++i)
+	{
+		if (read_state(fd, states) != 0)
+		{
+			fprintf(stderr, "Err: the server didn't answer\n");
+			return 1;
+		}
+	}
+	
+	for (i = 0; i < CHK_RUNS; ++i)
+	{
+		if (check(&progs[i % 2], &states[i]) != 0)
+		{
+			fprintf(stderr, "Err: run %d of %s differs from a new machine\n", i, progs[i % 2].name);
+			bad = 1;
+		}
+	}
+	
+	close(fd);
+	unlink(CHK_SOCK);
+	printf("serve_check: %d runs, %s\n", CHK_RUNS, (bad) ? "failed" : "ok");
+	return bad;
+}
+
+static void * serve(void * arg)
+{
+	/* one worker, so every run follows the last on the same machine */
+	serve_run(CHK_SOCK, 1, CHK_STEPS);
+	return NULL;
+}
+
+static int send_run(int fd, int id, const prog * pg)
+{
+	/* send a run of pg without pokes */
+	serve_req req;
+	
+	memset(&req, 0, sizeof(req));
+	req.magic = SERVE_MAGIC;
+	req.version = SERVE_VER;
+	req.id = id;
+	req.kind = SERVE_RUN;
+	req.csize = pg->csize;
+	req.steps = CHK_STEPS;
+	if (io_all(fd, &req, sizeof(req), true) != 0 ||
+		io_all(fd, (void *)pg->code, pg->csize, true) != 0)
+		return -1;
+	
+	return 0;
+}
+
+static int read_state(int fd, serve_state states[CHK_RUNS])
+{
+	/* read an answer in the place of its run */
+	serve_ans ans;
+	
+	if (io_all(fd, &ans, sizeof(ans), false) != 0 || ans.magic != SERVE_MAGIC ||
+		ans.status != SERVE_OK || ans.id >= CHK_RUNS || ans.size != sizeof(serve_state))
+		return -1;
+	
+	return io_all(fd, &states[ans.id], sizeof(serve_state), false);
+}
+
+static int check(const prog * pg, const serve_state * st)
+{
+	/* run pg on a new machine and compare */
+	static byte ram[RAM_S];
+	jcpu cpu;
+	unsigned long n;
+	
+	jcpu_init(&cpu, ram, 0);
+	jcpu_load(&cpu, pg->code, pg->csize);
+	for (n = CHK_STEPS; n > 0 && !jcpu_halted(&cpu); --n)
+		jcpu_step(&cpu);
+	
+	if (st->icount != cpu.icount || st->halted != jcpu_halted(&cpu) ||
+		st->digest != cpu.digest || memcmp(st->regs, cpu.regs, NUM_REGS) != 0)
+		return -1;
+	
+	return 0;
+}
+
+static int io_all(int fd, void * buff, size_t len, bool wr)
+{
+	/* write or read all of len */
+	byte * p = buff;
+	ssize_t n;
+	
+	while (len > 0)
+	{
+		n = (wr) ? write(fd, p, len) : read(fd, p, len);
+		if (n <= 0)
+			return -1;
+		
+		p += n;
+		len -= n;
+	}
+	
+	return 0;
+}
+#endif